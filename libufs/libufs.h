@@ -64,6 +64,10 @@ UFS_API int ufs_ptime(int64_t time, const char* fmt, FILE* fp);
  * 文件描述符
 */
 
+typedef struct ufs_iovec_t {
+    const void* base;
+    size_t len;
+} ufs_iovec_t;
 typedef struct ufs_vfs_t {
     const char* type;
 
@@ -76,6 +80,11 @@ typedef struct ufs_vfs_t {
     int (*pwrite)(struct ufs_vfs_t* vfs, const void* buf, size_t len, int64_t off, size_t* pwriten);
     // 同步文件
     int (*sync)(struct ufs_vfs_t* vfs);
+    // 带偏移量的聚集写入（将iov中的iovcnt段依次写入到off开始的连续位置，可以只写入一部分）
+    // 可以为NULL，此时逐段调用pwrite
+    int (*pwritev)(struct ufs_vfs_t* vfs, const ufs_iovec_t* iov, int iovcnt, int64_t off, size_t* pwriten);
+    // 同步文件数据（类似fdatasync，可以为NULL，此时调用sync）
+    int (*datasync)(struct ufs_vfs_t* vfs);
 } ufs_vfs_t;
 // 打开一个文件，当无法独立占有文件时报错
 UFS_API int ufs_vfs_open_file(ufs_vfs_t** pfd, const char* path);
@@ -103,7 +112,8 @@ UFS_API char* ufs_vfs_get_memory(ufs_vfs_t* vfs, size_t* psize);
 
 #define UFS_BNUM_COMPACT (0) // 块号：兼容块（不使用此块，以便兼容BIOS/UEFI）
 #define UFS_BNUM_SB (1) // 块号：超级块
-#define UFS_BNUM_JORNAL (2) // 块号：日志块
+#define UFS_BNUM_JORNAL (2) // 块号：日志块（默认的环形日志区）
+#define UFS_BNUM_JORNAL_SB (UFS_BNUM_JORNAL + UFS_JORNAL_NUM) // 块号：日志超级块（默认的环形日志区）
 #define UFS_BNUM_ILIST (UFS_BNUM_JORNAL + UFS_JORNAL_NUM + 1) // 块号：inode开始块
 #define UFS_BNUM_ZLIST (UFS_BNUM_JORNAL + UFS_JORNAL_NUM + 2) // 块号：zone开始块
 #define UFS_BNUM_START (UFS_BNUM_JORNAL + UFS_JORNAL_NUM + 3) // 块号：开始块
@@ -191,13 +201,128 @@ typedef struct ufs_context_t {
 
 // 创建磁盘
 UFS_API int ufs_new(ufs_t** pufs, ufs_vfs_t* vfs);
+#define UFS_DURABILITY_STRICT   0 // 持久化级别：每次提交完全刷盘（默认）
+#define UFS_DURABILITY_ORDERED  1 // 持久化级别：使用数据刷盘（类似fdatasync）作为屏障，断电时可能丢失磁盘缓存中的提交
+#define UFS_DURABILITY_PERIODIC 2 // 持久化级别：同步请求按时间间隔合并，期间崩溃可能丢失最近的修改，但不会破坏一致性
+#define UFS_DURABILITY_NONE     3 // 持久化级别：从不刷盘（适用于内存文件和一次性的镜像）
+typedef struct ufs_mount_opt_t {
+    // 后台检查点的时间间隔（毫秒，0表示不按时间间隔唤醒）
+    uint32_t checkpoint_interval;
+    // 日志使用率（百分比）达到该值时唤醒后台检查点（0表示不按使用率唤醒）
+    // 两者均为0时不启动后台检查点，日志只在同步或日志已满时由调用线程写入；单线程模式下忽略这两项
+    uint32_t checkpoint_threshold;
+    // 持久化级别（UFS_DURABILITY_*）
+    // 不经过日志直接写入的文件数据在之后的提交记录之前刷盘（UFS_DURABILITY_NONE除外）；
+    // 但新分配区块的提交可能先于写入的数据，崩溃后这样的块中可能是旧内容
+    int durability;
+    // UFS_DURABILITY_PERIODIC的刷盘间隔（毫秒，0表示1000毫秒）
+    uint32_t sync_interval;
+    // data=journal：不超过该字节数（最大为60KB）的文件写入经过日志（随机的小写入变为日志区中的顺序写入），0表示文件数据总是直接写入
+    uint32_t data_jornal;
+    // 日志恢复时并行写回区块的线程数（0或1表示在调用线程中写回；单线程模式下忽略）
+    uint32_t recovery_threads;
+    // 快速提交：普通文件自上次完整提交后只有大小和时间发生变化时，ufs_fsync只将这部分作为单独的小提交写入日志，
+    // 不提交其他文件的修改（只对UFS_DURABILITY_STRICT和UFS_DURABILITY_ORDERED有效）
+    int fast_commit;
+    // 延迟分配：普通文件写入未分配的块时先保存在内存中，写回（缓冲区已满、同步、关闭或截断）时才分配区块，
+    // 连续写入的块可以一次分配连续的区块（未同步的数据在崩溃时丢失）
+    int delay_alloc;
+    // 后台回收：删除的文件在最后一次关闭时加入孤儿链表后立即返回，由后台线程每批最多释放该数量的块
+    // （0表示在关闭的线程中一次释放；单线程模式下或磁盘没有孤儿链表时忽略，见ufs_format_opt_t.orphan），崩溃后挂载时继续回收
+    uint32_t reclaim_batch;
+    // 后台回收批次之间的间隔（毫秒，0表示不间隔）
+    uint32_t reclaim_interval;
+    // 为格式化时没有启用区块缓存的磁盘启用区块缓存（见ufs_format_opt_t.zcache），之后旧版本无法挂载该磁盘
+    int zcache_upgrade;
+} ufs_mount_opt_t;
+// 使用指定选项创建磁盘（opt为NULL时等价于ufs_new）
+UFS_API int ufs_new_ex(ufs_t** pufs, ufs_vfs_t* vfs, const ufs_mount_opt_t* opt);
+typedef struct ufs_mount_stat_t {
+    uint64_t replay_commits; // 重放的提交数
+    uint64_t replay_blocks; // 重放时写回的区块数
+    uint64_t replay_time; // 日志恢复的耗时（毫秒）
+    uint32_t replay_threads; // 写回使用的线程数（没有需要写回的区块时为0）
+} ufs_mount_stat_t;
+/**
+ * 获取挂载时日志恢复的统计信息
+ *
+ * 错误；
+ *   [UFS_EINVAL] ufs或stat为NULL
+*/
+UFS_API int ufs_mount_stat(ufs_t* ufs, ufs_mount_stat_t* stat);
 // 创建并格式化磁盘
 UFS_API int ufs_new_format(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size);
+typedef struct ufs_format_opt_t {
+    // 环形日志区的块数（0表示使用默认的日志区，否则至少为UFS_JORNAL_NUM）
+    // 日志区越大，连续提交之间需要的检查点越少
+    uint64_t jornal_size;
+    // 挂载选项（NULL表示使用默认选项）
+    const ufs_mount_opt_t* mount;
+    // 空闲区块的管理方式（UFS_ZALLOC_*）
+    int zalloc;
+    // 延迟构建空闲链表：格式化时不逐个压入空闲的区块和inode，只在超级块中记录从未使用过的范围，
+    // 链表耗尽时再从中依次取出，格式化的耗时与磁盘大小无关（使用位图时只对inode有效）
+    int lazy;
+    // 区块缓存：每个线程从各自的槽中分配和释放单个区块，减少对空闲区块列表的争用
+    int zcache;
+    // 区块范围编码：空闲区块链表中相邻的区块合并为一项保存，格式化和释放连续区块时写入的节点更少，
+    // 之后旧版本无法挂载该磁盘（使用位图时无效）
+    int zrange;
+    // 孤儿链表：删除仍被打开的文件时记录在磁盘上，崩溃后挂载时回收其区块，也可以由后台回收（见ufs_mount_opt_t.reclaim_batch），
+    // 之后旧版本无法挂载该磁盘
+    int orphan;
+} ufs_format_opt_t;
+#define UFS_ZALLOC_LIST 0 // 空闲区块组织为链表（默认）
+#define UFS_ZALLOC_BITMAP 1 // 空闲区块由位图管理，可以查找连续的空闲区块
+// 使用指定选项创建并格式化磁盘（opt为NULL时等价于ufs_new_format）
+UFS_API int ufs_new_format_ex(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size, const ufs_format_opt_t* opt);
 // 同步磁盘内容
 UFS_API int ufs_sync(ufs_t* ufs);
-// 销毁磁盘
+// 销毁磁盘（未结束的事务会被提交）
 UFS_API void ufs_destroy(ufs_t* ufs);
 
+/**
+ * 事务
+ *
+ * 事务属于开始它的上下文，期间该上下文的修改（包括通过该上下文打开的文件的修改）都保留在待提交的日志中，
+ * 同步请求被推迟，提交事务时作为一次日志写入原子地落盘。
+ * 其他上下文的修改操作（创建、截断、删除、重命名、修改属性，以及其打开的文件的写入、同步和关闭）
+ * 会等待事务结束后再执行，不会被中止撤销（单线程模式下返回UFS_EAGAIN）。
+ * 事务期间所属的上下文不能同时在多个线程中使用。
+ * 修改超过单次提交的容量时在内存中继续收集，提交事务时写为多条记录组成的一次提交，崩溃后重放时全部生效或全部不生效。
+ * 事务的大小受日志区大小限制（格式化时由ufs_format_opt_t.jornal_size设置）。
+ * 不经过日志直接写入的文件数据不属于事务，中止时无法撤销。
+ * 同一时刻一个磁盘上只能有一个事务。
+*/
+/**
+ * 开始事务（之前的修改会先被提交）
+ *
+ * 错误：
+ *   [UFS_EINVAL] context为NULL或已经处于事务中
+ *   [UFS_EAGAIN] 其他上下文的事务尚未结束
+*/
+UFS_API int ufs_txn_begin(ufs_context_t* context);
+/**
+ * 提交事务并刷盘
+ *
+ * 写入日志失败时事务保持未结束，可以中止。
+ *
+ * 错误：
+ *   [UFS_EINVAL] context为NULL或不处于事务中
+ *   [UFS_EOVERFLOW] 事务超过日志区大小
+*/
+UFS_API int ufs_txn_commit(ufs_context_t* context);
+/**
+ * 中止事务，丢弃尚未提交的修改，并从磁盘重新读取空闲列表和已打开文件的inode
+ *
+ * 事务中新建的文件应当在中止前关闭。
+ * 重新读取失败时内存状态可能与磁盘不一致，此时应当不经同步重新挂载。
+ *
+ * 错误：
+ *   [UFS_EINVAL] context为NULL或不处于事务中
+*/
+UFS_API int ufs_txn_abort(ufs_context_t* context);
+
 typedef struct ufs_statvfs_t {
     uint64_t f_bsize;
     uint64_t f_namemax;
@@ -218,6 +343,33 @@ typedef struct ufs_statvfs_t {
 */
 UFS_API int ufs_statvfs(ufs_t* ufs, ufs_statvfs_t* stat);
 
+typedef struct ufs_bpool_stat_t {
+    uint64_t alloc; // 累计分配次数
+    uint64_t refill; // 向系统申请块组的次数
+    uint64_t fallback; // 缓冲池用尽（或者关闭了缓冲池）时单独向系统申请缓冲区的次数
+    uint64_t total; // 缓冲池持有的缓冲区数量
+    uint64_t used; // 正在使用的缓冲区数量
+    uint64_t peak; // 同时使用的缓冲区数量的峰值
+} ufs_bpool_stat_t;
+/**
+ * 获取区块缓冲池的统计信息
+ *
+ * 日志和事务使用的区块缓冲区来自进程内共享的缓冲池，缓冲池按需增长且不会缩小。
+ * 缓冲池达到上限后，超出的缓冲区单独向系统申请并在释放时归还。
+ * 定义了LIBUFS_NO_BPOOL或者使用AddressSanitizer构建时不使用缓冲池。
+ *
+ * 错误；
+ *   [UFS_EINVAL] stat为NULL
+*/
+UFS_API int ufs_bpool_stat(ufs_bpool_stat_t* stat);
+/**
+ * 预先向缓冲池中填充缓冲区，直到缓冲池持有的缓冲区不少于num个
+ *
+ * 错误；
+ *   [UFS_ENOMEM] 内存不足或者超过缓冲池的上限
+*/
+UFS_API int ufs_bpool_reserve(size_t num);
+
 
 struct ufs_file_t;
 typedef struct ufs_file_t ufs_file_t;
@@ -0,0 +1,221 @@
+#include "libufs_internel.h"
+
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+// 内存检查工具下不使用缓冲池，使每个缓冲区都能被单独检查（也可以定义LIBUFS_NO_BPOOL强制关闭）
+#if !defined(LIBUFS_NO_BPOOL) && defined(__SANITIZE_ADDRESS__)
+    #define LIBUFS_NO_BPOOL
+#endif
+#if !defined(LIBUFS_NO_BPOOL) && defined(__has_feature)
+    #if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+        #define LIBUFS_NO_BPOOL
+    #endif
+#endif
+
+/**
+ * 区块缓冲池
+ *
+ * 缓冲区以块组为单位向系统申请，块组按自身大小对齐，第一块存放块组信息，其余的块作为缓冲区，
+ * 因此缓冲区按UFS_BLOCK_SIZE对齐，并且可以直接由地址找到所属的块组。
+ * 空闲的缓冲区组成一个无锁栈：栈顶的高32位为版本号（每次修改加1，避免ABA问题），低32位为缓冲区编号，
+ * 链接存放在块组信息中而不是缓冲区内，因此读到过期的栈顶也不会访问已经被使用的缓冲区。
+ * 块组申请后不再归还系统。块组数量达到上限后，超出的缓冲区单独向系统申请并在释放时直接归还系统，
+ * 两种缓冲区由块组地址的哈希表区分。定义了LIBUFS_NO_BPOOL时所有缓冲区都单独申请。
+*/
+#define _CHUNK_BLOCKS 64 // 块组的块数（包括块组信息）
+#define _CHUNK_SIZE (_CHUNK_BLOCKS * UFS_BLOCK_SIZE)
+#define _CHUNK_MAX 4096 // 最大块组数量
+#define _CHUNK_SET_SIZE (_CHUNK_MAX * 2) // 块组地址哈希表的大小（2的幂）
+typedef struct _chunk_t {
+    uint32_t index; // 块组编号
+    ulatomic32_t next[_CHUNK_BLOCKS]; // 空闲栈中下一个缓冲区的编号（0表示栈底）
+} _chunk_t;
+
+static ulatomic64_t _stat_alloc = ULATOMIC64_INIT;
+static ulatomic64_t _stat_refill = ULATOMIC64_INIT;
+static ulatomic64_t _stat_fallback = ULATOMIC64_INIT;
+static ulatomic64_t _stat_used = ULATOMIC64_INIT;
+static ulatomic64_t _stat_peak = ULATOMIC64_INIT;
+
+static void* _alloc_aligned(size_t size, size_t align) {
+#if defined(_WIN32)
+    return _aligned_malloc(size, align);
+#else
+    void* ret;
+    return posix_memalign(&ret, align, size) ? NULL : ret;
+#endif
+}
+static void _free_aligned(void* ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+static void _count_alloc(void) {
+    ulatomic64_raw_t used, peak;
+    ulatomic_fetch_add_explicit_64(&_stat_alloc, 1, ulatomic_memory_order_relaxed);
+    used = ulatomic_fetch_add_explicit_64(&_stat_used, 1, ulatomic_memory_order_relaxed) + 1;
+    peak = ulatomic_load_explicit_64(&_stat_peak, ulatomic_memory_order_relaxed);
+    while(peak < used && !ulatomic_compare_exchange_weak_64(&_stat_peak, &peak, used)) { }
+}
+// 单独向系统申请一个缓冲区
+static void* _alloc_single(void) {
+    void* buf = _alloc_aligned(UFS_BLOCK_SIZE, UFS_BLOCK_SIZE);
+    if(ufs_unlikely(buf == NULL)) return NULL;
+    ulatomic_fetch_add_explicit_64(&_stat_fallback, 1, ulatomic_memory_order_relaxed);
+    _count_alloc();
+    return buf;
+}
+static void _free_single(void* buf) {
+    ulatomic_fetch_sub_explicit_64(&_stat_used, 1, ulatomic_memory_order_relaxed);
+    _free_aligned(buf);
+}
+
+#ifdef LIBUFS_NO_BPOOL // 所有缓冲区都单独申请
+
+UFS_HIDDEN void* ufs_block_alloc(void) {
+    return _alloc_single();
+}
+UFS_HIDDEN void ufs_block_free(void* buf) {
+    if(buf == NULL) return;
+    _free_single(buf);
+}
+UFS_API int ufs_bpool_reserve(size_t num) {
+    (void)num;
+    return 0;
+}
+
+#else
+
+static ulatomiciptr_t _chunks[_CHUNK_MAX];
+static ulatomiciptr_t _chunk_set[_CHUNK_SET_SIZE]; // 开放寻址，只插入不删除
+static ulatomic32_t _chunk_num = ULATOMIC32_INIT;
+static ulatomic64_t _top = ULATOMIC64_INIT;
+
+// 缓冲区编号为 块组编号 * _CHUNK_BLOCKS + 块组内序号（序号从1开始，因此编号不会为0）
+static _chunk_t* _get_chunk(uint32_t id) {
+    return ul_reinterpret_cast(_chunk_t*,
+        ulatomic_load_explicit_iptr(_chunks + id / _CHUNK_BLOCKS, ulatomic_memory_order_relaxed));
+}
+static char* _id2buf(uint32_t id) {
+    return ul_reinterpret_cast(char*, _get_chunk(id)) + (id % _CHUNK_BLOCKS) * UFS_BLOCK_SIZE;
+}
+static uint32_t _buf2id(const void* buf) {
+    const uintptr_t addr = ul_reinterpret_cast(uintptr_t, buf);
+    const _chunk_t* chunk = ul_reinterpret_cast(const _chunk_t*, addr & ~ul_static_cast(uintptr_t, _CHUNK_SIZE - 1));
+    return chunk->index * _CHUNK_BLOCKS + ul_static_cast(uint32_t, (addr & (_CHUNK_SIZE - 1)) / UFS_BLOCK_SIZE);
+}
+
+static size_t _chunk_hash(uintptr_t base) {
+    return ul_static_cast(size_t, (ul_static_cast(uint64_t, base / _CHUNK_SIZE) * UINT64_C(0x9E3779B97F4A7C15)) >> 32)
+        & (_CHUNK_SET_SIZE - 1);
+}
+static void _chunk_set_insert(uintptr_t base) {
+    ulatomiciptr_raw_t expect;
+    size_t h = _chunk_hash(base);
+    for(;; h = (h + 1) & (_CHUNK_SET_SIZE - 1)) {
+        expect = 0;
+        if(ulatomic_compare_exchange_strong_iptr(_chunk_set + h, &expect, ul_static_cast(ulatomiciptr_raw_t, base))) return;
+    }
+}
+// 缓冲区是否来自块组
+static int _chunk_set_find(const void* buf) {
+    ulatomiciptr_raw_t v;
+    const uintptr_t base = ul_reinterpret_cast(uintptr_t, buf) & ~ul_static_cast(uintptr_t, _CHUNK_SIZE - 1);
+    size_t h = _chunk_hash(base);
+    for(;; h = (h + 1) & (_CHUNK_SET_SIZE - 1)) {
+        v = ulatomic_load_explicit_iptr(_chunk_set + h, ulatomic_memory_order_acquire);
+        if(v == ul_static_cast(ulatomiciptr_raw_t, base)) return 1;
+        if(v == 0) return 0;
+    }
+}
+
+#define _top_make(ver, id) ul_static_cast(ulatomic64_raw_t, (ul_static_cast(uint64_t, ver) << 32) | (id))
+#define _top_ver(top) ul_static_cast(uint32_t, ul_static_cast(uint64_t, top) >> 32)
+#define _top_id(top) ul_static_cast(uint32_t, ul_static_cast(uint64_t, top) & 0xFFFFFFFFu)
+
+// 将first到last的链（已经链接好）压入空闲栈
+static void _push_chain(uint32_t first, uint32_t last) {
+    _chunk_t* chunk = _get_chunk(last);
+    ulatomic64_raw_t top = ulatomic_load_explicit_64(&_top, ulatomic_memory_order_relaxed);
+    do {
+        ulatomic_store_explicit_32(chunk->next + last % _CHUNK_BLOCKS,
+            ul_static_cast(ulatomic32_raw_t, _top_id(top)), ulatomic_memory_order_relaxed);
+    } while(!ulatomic_compare_exchange_weak_64(&_top, &top, _top_make(_top_ver(top) + 1, first)));
+}
+static uint32_t _pop(void) {
+    uint32_t id, next;
+    ulatomic64_raw_t top = ulatomic_load_explicit_64(&_top, ulatomic_memory_order_acquire);
+    do {
+        id = _top_id(top);
+        if(id == 0) return 0;
+        next = ul_static_cast(uint32_t, ulatomic_load_explicit_32(_get_chunk(id)->next + id % _CHUNK_BLOCKS, ulatomic_memory_order_relaxed));
+    } while(!ulatomic_compare_exchange_weak_64(&_top, &top, _top_make(_top_ver(top) + 1, next)));
+    return id;
+}
+
+// 申请新的块组，除第一个缓冲区外全部压入空闲栈，返回第一个缓冲区的编号（失败时返回0）
+static uint32_t _refill(void) {
+    _chunk_t* chunk;
+    uint32_t i, base;
+    const ulatomic32_raw_t index = ulatomic_fetch_add_explicit_32(&_chunk_num, 1, ulatomic_memory_order_relaxed);
+    if(ufs_unlikely(index >= _CHUNK_MAX)) {
+        ulatomic_fetch_sub_explicit_32(&_chunk_num, 1, ulatomic_memory_order_relaxed);
+        return 0;
+    }
+    chunk = ul_reinterpret_cast(_chunk_t*, _alloc_aligned(_CHUNK_SIZE, _CHUNK_SIZE));
+    if(ufs_unlikely(chunk == NULL)) return 0; // 编号留空即可，该编号的缓冲区不会出现在空闲栈中
+    ulatomic_fetch_add_explicit_64(&_stat_refill, 1, ulatomic_memory_order_relaxed);
+    chunk->index = ul_static_cast(uint32_t, index);
+    ulatomic_store_explicit_iptr(_chunks + index, ul_reinterpret_cast(ulatomiciptr_raw_t, chunk), ulatomic_memory_order_relaxed);
+    _chunk_set_insert(ul_reinterpret_cast(uintptr_t, chunk));
+    base = chunk->index * _CHUNK_BLOCKS;
+    for(i = 2; i < _CHUNK_BLOCKS - 1; ++i)
+        ulatomic_store_explicit_32(chunk->next + i, ul_static_cast(ulatomic32_raw_t, base + i + 1), ulatomic_memory_order_relaxed);
+    _push_chain(base + 2, base + _CHUNK_BLOCKS - 1);
+    return base + 1;
+}
+
+UFS_HIDDEN void* ufs_block_alloc(void) {
+    uint32_t id = _pop();
+    if(id == 0) {
+        id = _refill();
+        // 块组已达上限或者申请块组失败
+        if(ufs_unlikely(id == 0)) return _alloc_single();
+    }
+    _count_alloc();
+    return _id2buf(id);
+}
+UFS_HIDDEN void ufs_block_free(void* buf) {
+    uint32_t id;
+    if(buf == NULL) return;
+    if(ufs_unlikely(!_chunk_set_find(buf))) { _free_single(buf); return; }
+    id = _buf2id(buf);
+    ulatomic_fetch_sub_explicit_64(&_stat_used, 1, ulatomic_memory_order_relaxed);
+    _push_chain(id, id);
+}
+UFS_API int ufs_bpool_reserve(size_t num) {
+    uint32_t id;
+    while(ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_refill, ulatomic_memory_order_relaxed)) * (_CHUNK_BLOCKS - 1) < num) {
+        id = _refill();
+        if(ufs_unlikely(id == 0)) return UFS_ENOMEM;
+        _push_chain(id, id);
+    }
+    return 0;
+}
+
+#endif
+
+UFS_API int ufs_bpool_stat(ufs_bpool_stat_t* stat) {
+    if(ufs_unlikely(stat == NULL)) return UFS_EINVAL;
+    stat->alloc = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_alloc, ulatomic_memory_order_relaxed));
+    stat->refill = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_refill, ulatomic_memory_order_relaxed));
+    stat->fallback = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_fallback, ulatomic_memory_order_relaxed));
+    stat->total = stat->refill * (_CHUNK_BLOCKS - 1);
+    stat->used = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_used, ulatomic_memory_order_relaxed));
+    stat->peak = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&_stat_peak, ulatomic_memory_order_relaxed));
+    return 0;
+}
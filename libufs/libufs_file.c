@@ -358,6 +358,15 @@ static int _open(ufs_context_t* context, ufs_minode_t** pminode, const char* pat
     return _open_ex(context, pminode, path, flag, mode, 0);
 }
 
+// 执行修改操作，其他上下文的公开事务期间先等待事务结束
+#define _TXN_CALL(ufs, context, call) do { \
+    int _txn_ec = ufs_txn_enter((ufs), (context)); \
+    if(ufs_unlikely(_txn_ec)) return _txn_ec; \
+    _txn_ec = (call); \
+    ufs_txn_leave((ufs), (context)); \
+    return _txn_ec; \
+} while(0)
+
 
 
 typedef struct ufs_file_t {
@@ -367,12 +376,13 @@ typedef struct ufs_file_t {
     ulatomic_spinlock_t lock;
     int32_t uid;
     int32_t gid;
+    const ufs_context_t* context; // 打开文件的上下文（只用于判断文件的修改是否属于公开事务）
 } ufs_file_t;
 #define _OPEN_APPEND 8
 static void _file_lock(ufs_file_t* file) { ulatomic_spinlock_lock(&file->lock); }
 static void _file_unlock(ufs_file_t* file) { ulatomic_spinlock_unlock(&file->lock); }
 
-UFS_API int ufs_open(ufs_context_t* context, ufs_file_t** pfile, const char* path, unsigned long flag, uint16_t mask) {
+static int _ufs_open(ufs_context_t* context, ufs_file_t** pfile, const char* path, unsigned long flag, uint16_t mask) {
     ufs_file_t* file;
     int ec;
     ufs_minode_t* minode;
@@ -396,6 +406,7 @@ UFS_API int ufs_open(ufs_context_t* context, ufs_file_t** pfile, const char* pat
     file->flag = 0;
     file->uid = context->uid;
     file->gid = context->gid;
+    file->context = context;
     ulatomic_spinlock_init(&file->lock);
     if(flag & UFS_O_RDONLY) file->flag |= UFS_R_OK;
     if(flag & UFS_O_WRONLY) file->flag |= UFS_W_OK;
@@ -432,18 +443,32 @@ UFS_API int ufs_open(ufs_context_t* context, ufs_file_t** pfile, const char* pat
     *pfile = file;
     return 0;
 }
+UFS_API int ufs_open(ufs_context_t* context, ufs_file_t** pfile, const char* path, unsigned long flag, uint16_t mask) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    // 只有创建和截断会修改磁盘
+    if(!(flag & (UFS_O_CREAT | UFS_O_TRUNC))) return _ufs_open(context, pfile, path, flag, mask);
+    _TXN_CALL(context->ufs, context, _ufs_open(context, pfile, path, flag, mask));
+}
 
 UFS_API int ufs_creat(ufs_context_t* context, ufs_file_t** pfile, const char* path, uint16_t mask) {
     return ufs_open(context, pfile, path, UFS_O_CREAT | UFS_O_WRONLY | UFS_O_TRUNC, mask);
 }
 
-UFS_API int ufs_close(ufs_file_t* file) {
+static int _ufs_close(ufs_file_t* file) {
     int ec;
     if(ufs_unlikely(file == NULL)) return UFS_EBADF;
     ec = ufs_fileset_close(&file->minode->ufs->fileset, file->minode->inum);
     ufs_free(file);
     return ec;
 }
+UFS_API int ufs_close(ufs_file_t* file) {
+    ufs_t* ufs;
+    const ufs_context_t* context;
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    ufs = file->minode->ufs;
+    context = file->context;
+    _TXN_CALL(ufs, context, _ufs_close(file));
+}
 
 UFS_API int ufs_read(ufs_file_t* file, void* buf, size_t len, size_t* pread) {
     size_t read;
@@ -466,7 +491,7 @@ UFS_API int ufs_read(ufs_file_t* file, void* buf, size_t len, size_t* pread) {
     return 0;
 }
 
-UFS_API int ufs_write(ufs_file_t* file, const void* buf, size_t len, size_t* pwriten) {
+static int _ufs_write(ufs_file_t* file, const void* buf, size_t len, size_t* pwriten) {
     size_t writen;
     int ec;
     pwriten = pwriten ? pwriten : &writen;
@@ -486,6 +511,10 @@ UFS_API int ufs_write(ufs_file_t* file, const void* buf, size_t len, size_t* pwr
     if(pwriten) *pwriten = writen;
     return 0;
 }
+UFS_API int ufs_write(ufs_file_t* file, const void* buf, size_t len, size_t* pwriten) {
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    _TXN_CALL(file->minode->ufs, file->context, _ufs_write(file, buf, len, pwriten));
+}
 
 UFS_API int ufs_pread(ufs_file_t* file, void* buf, size_t len, uint64_t off, size_t* pread) {
     size_t read;
@@ -506,7 +535,7 @@ UFS_API int ufs_pread(ufs_file_t* file, void* buf, size_t len, uint64_t off, siz
     return 0;
 }
 
-UFS_API int ufs_pwrite(ufs_file_t* file, const void* buf, size_t len, uint64_t off, size_t* pwriten) {
+static int _ufs_pwrite(ufs_file_t* file, const void* buf, size_t len, uint64_t off, size_t* pwriten) {
     size_t writen;
     int ec;
     pwriten = pwriten ? pwriten : &writen;
@@ -525,6 +554,10 @@ UFS_API int ufs_pwrite(ufs_file_t* file, const void* buf, size_t len, uint64_t o
     if(pwriten) *pwriten = writen;
     return 0;
 }
+UFS_API int ufs_pwrite(ufs_file_t* file, const void* buf, size_t len, uint64_t off, size_t* pwriten) {
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    _TXN_CALL(file->minode->ufs, file->context, _ufs_pwrite(file, buf, len, off, pwriten));
+}
 
 UFS_API int ufs_seek(ufs_file_t* file, int64_t off, int wherence, uint64_t* poff) {
     int ec = 0;
@@ -573,7 +606,7 @@ UFS_API int ufs_tell(ufs_file_t* file, uint64_t* poff) {
     return 0;
 }
 
-UFS_API int ufs_fallocate(ufs_file_t* file, uint64_t off, uint64_t len) {
+static int _ufs_fallocate(ufs_file_t* file, uint64_t off, uint64_t len) {
     int ec;
     if(ufs_unlikely(file == NULL)) return UFS_EBADF;
     _file_lock(file);
@@ -584,8 +617,12 @@ UFS_API int ufs_fallocate(ufs_file_t* file, uint64_t off, uint64_t len) {
     _file_unlock(file);
     return ec;
 }
+UFS_API int ufs_fallocate(ufs_file_t* file, uint64_t off, uint64_t len) {
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    _TXN_CALL(file->minode->ufs, file->context, _ufs_fallocate(file, off, len));
+}
 
-UFS_API int ufs_ftruncate(ufs_file_t* file, uint64_t size) {
+static int _ufs_ftruncate(ufs_file_t* file, uint64_t size) {
     int ec;
     if(ufs_unlikely(file == NULL)) return UFS_EBADF;
     _file_lock(file);
@@ -597,8 +634,12 @@ UFS_API int ufs_ftruncate(ufs_file_t* file, uint64_t size) {
     _file_unlock(file);
     return ec;
 }
+UFS_API int ufs_ftruncate(ufs_file_t* file, uint64_t size) {
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    _TXN_CALL(file->minode->ufs, file->context, _ufs_ftruncate(file, size));
+}
 
-UFS_API int ufs_fsync(ufs_file_t* file, int only_data) {
+static int _ufs_fsync(ufs_file_t* file, int only_data) {
     int ec;
     if(ufs_unlikely(file == NULL)) return UFS_EBADF;
     _file_lock(file);
@@ -608,6 +649,10 @@ UFS_API int ufs_fsync(ufs_file_t* file, int only_data) {
     _file_unlock(file);
     return ec;
 }
+UFS_API int ufs_fsync(ufs_file_t* file, int only_data) {
+    if(ufs_unlikely(file == NULL)) return UFS_EBADF;
+    _TXN_CALL(file->minode->ufs, file->context, _ufs_fsync(file, only_data));
+}
 
 
 typedef struct ufs_dir_t {
@@ -723,7 +768,7 @@ UFS_API int ufs_closedir(ufs_dir_t* dir) {
 
 
 
-UFS_API int ufs_mkdir(ufs_context_t* context, const char* path, uint16_t mode) {
+static int _ufs_mkdir(ufs_context_t* context, const char* path, uint16_t mode) {
     int ec;
     ufs_minode_t* minode;
 
@@ -734,8 +779,12 @@ UFS_API int ufs_mkdir(ufs_context_t* context, const char* path, uint16_t mode) {
     if(ufs_unlikely(ec)) return ec;
     return ufs_fileset_close(&context->ufs->fileset, minode->inum);
 }
+UFS_API int ufs_mkdir(ufs_context_t* context, const char* path, uint16_t mode) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_mkdir(context, path, mode));
+}
 
-UFS_API int ufs_rmdir(ufs_context_t* context, const char* path) {
+static int _ufs_rmdir(ufs_context_t* context, const char* path) {
     int ec;
     ufs_minode_t* minode = NULL;
     ufs_minode_t* ppath_minode;
@@ -779,8 +828,12 @@ UFS_API int ufs_rmdir(ufs_context_t* context, const char* path) {
     ufs_minode_unlock(minode);
     return ufs_fileset_close(&context->ufs->fileset, minode->inum);
 }
+UFS_API int ufs_rmdir(ufs_context_t* context, const char* path) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_rmdir(context, path));
+}
 
-UFS_API int ufs_unlink(ufs_context_t* context, const char* path) {
+static int _ufs_unlink(ufs_context_t* context, const char* path) {
     int ec;
     ufs_minode_t* minode = NULL;
     ufs_minode_t* ppath_minode;
@@ -816,8 +869,12 @@ UFS_API int ufs_unlink(ufs_context_t* context, const char* path) {
     ufs_minode_unlock(minode);
     return ufs_fileset_close(&context->ufs->fileset, minode->inum);
 }
+UFS_API int ufs_unlink(ufs_context_t* context, const char* path) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_unlink(context, path));
+}
 
-UFS_API int ufs_link(ufs_context_t* context, const char* target, const char* source) {
+static int _ufs_link(ufs_context_t* context, const char* target, const char* source) {
     int ec;
     ufs_minode_t* tinode = NULL;
     ufs_minode_t* sinode;
@@ -831,8 +888,12 @@ UFS_API int ufs_link(ufs_context_t* context, const char* target, const char* sou
     ufs_fileset_close(&context->ufs->fileset, tinode->inum);
     return 0;
 }
+UFS_API int ufs_link(ufs_context_t* context, const char* target, const char* source) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_link(context, target, source));
+}
 
-UFS_API int ufs_symlink(ufs_context_t* context, const char* target, const char* source) {
+static int _ufs_symlink(ufs_context_t* context, const char* target, const char* source) {
     int ec, ec2;
     ufs_transcation_t transcation;
     size_t len, writen;
@@ -858,6 +919,10 @@ UFS_API int ufs_symlink(ufs_context_t* context, const char* target, const char*
     ec2 = ufs_fileset_close(&context->ufs->fileset, minode->inum);
     return ec ? ec : ec2;
 }
+UFS_API int ufs_symlink(ufs_context_t* context, const char* target, const char* source) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_symlink(context, target, source));
+}
 
 UFS_API int ufs_readlink(ufs_context_t* context, const char* source, char** presolved) {
     int ec;
@@ -918,7 +983,7 @@ UFS_API int ufs_stat(ufs_context_t* context, const char* path, ufs_stat_t* stat)
     return 0;
 }
 
-UFS_API int ufs_chmod(ufs_context_t* context, const char* path, uint16_t mask) {
+static int _ufs_chmod(ufs_context_t* context, const char* path, uint16_t mask) {
     int ec;
     ufs_minode_t* minode;
     if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
@@ -933,8 +998,12 @@ UFS_API int ufs_chmod(ufs_context_t* context, const char* path, uint16_t mask) {
     ufs_fileset_close(&context->ufs->fileset, minode->inum);
     return ec;
 }
+UFS_API int ufs_chmod(ufs_context_t* context, const char* path, uint16_t mask) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_chmod(context, path, mask));
+}
 
-UFS_API int ufs_chown(ufs_context_t* context, const char* path, int32_t uid, int32_t gid) {
+static int _ufs_chown(ufs_context_t* context, const char* path, int32_t uid, int32_t gid) {
     int ec;
     ufs_minode_t* minode;
     if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
@@ -950,6 +1019,10 @@ UFS_API int ufs_chown(ufs_context_t* context, const char* path, int32_t uid, int
     ufs_fileset_close(&context->ufs->fileset, minode->inum);
     return ec;
 }
+UFS_API int ufs_chown(ufs_context_t* context, const char* path, int32_t uid, int32_t gid) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_chown(context, path, uid, gid));
+}
 
 UFS_API int ufs_access(ufs_context_t* context, const char* path, int access) {
     int ec, x;
@@ -969,7 +1042,7 @@ UFS_API int ufs_access(ufs_context_t* context, const char* path, int access) {
     return ec;
 }
 
-UFS_API int ufs_utimes(ufs_context_t* context, const char* path, int64_t* ctime, int64_t* atime, int64_t* mtime) {
+static int _ufs_utimes(ufs_context_t* context, const char* path, int64_t* ctime, int64_t* atime, int64_t* mtime) {
     int ec;
     ufs_minode_t* minode;
     if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
@@ -986,7 +1059,11 @@ UFS_API int ufs_utimes(ufs_context_t* context, const char* path, int64_t* ctime,
     ufs_fileset_close(&context->ufs->fileset, minode->inum);
     return ec;
 }
-UFS_API int ufs_truncate(ufs_context_t* context, const char* path, uint64_t size) {
+UFS_API int ufs_utimes(ufs_context_t* context, const char* path, int64_t* ctime, int64_t* atime, int64_t* mtime) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_utimes(context, path, ctime, atime, mtime));
+}
+static int _ufs_truncate(ufs_context_t* context, const char* path, uint64_t size) {
     int ec;
     ufs_minode_t* minode;
     if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
@@ -1000,7 +1077,11 @@ UFS_API int ufs_truncate(ufs_context_t* context, const char* path, uint64_t size
     ufs_fileset_close(&context->ufs->fileset, minode->inum);
     return ec;
 }
-UFS_API int ufs_rename(ufs_context_t* context, const char* oldname, const char* newname) {
+UFS_API int ufs_truncate(ufs_context_t* context, const char* path, uint64_t size) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_truncate(context, path, size));
+}
+static int _ufs_rename(ufs_context_t* context, const char* oldname, const char* newname) {
     int ec;
     ufs_minode_t* minode;
     ufs_minode_t* ppath_minode;
@@ -1041,19 +1122,32 @@ UFS_API int ufs_rename(ufs_context_t* context, const char* oldname, const char*
 
     return ufs_fileset_close(&context->ufs->fileset, minode->inum);
 }
-UFS_API int ufs_physics_addr(ufs_context_t* context, const char* name, ufs_physics_addr_t* addr) {
+UFS_API int ufs_rename(ufs_context_t* context, const char* oldname, const char* newname) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_rename(context, oldname, newname));
+}
+static int _ufs_physics_addr(ufs_context_t* context, const char* name, ufs_physics_addr_t* addr) {
     int ec, i;
     ufs_minode_t* minode;
     ec = _open(context, &minode, name, _UFS_O_NOFOLLOW, 0664);
     if(ufs_unlikely(ec)) return ec;
 
     ufs_minode_lock(minode);
+    ec = ufs_minode_flush(minode); // 延迟分配的块还没有区块
     addr->inode_off = minode->inum * UFS_INODE_DISK_SIZE;
     for(i = 0; i < 16; ++i)
         addr->zone_off[i] = minode->inode.zones[i] * UFS_BLOCK_SIZE;
     ufs_minode_unlock(minode);
+    if(ufs_unlikely(ec)) {
+        ufs_fileset_close(&context->ufs->fileset, minode->inum);
+        return ec;
+    }
     return ufs_fileset_close(&context->ufs->fileset, minode->inum);
 }
+UFS_API int ufs_physics_addr(ufs_context_t* context, const char* name, ufs_physics_addr_t* addr) {
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    _TXN_CALL(context->ufs, context, _ufs_physics_addr(context, name, addr));
+}
 
 UFS_HIDDEN void ufs_file_debug(const ufs_file_t* file, FILE* fp) {
     fprintf(fp, "file [%p]\n", ufs_const_cast(void*, file));
@@ -49,11 +49,11 @@ UFS_HIDDEN int ufs_fileset_open(ufs_fileset_t* ufs_restrict _fs, uint64_t inum,
     ulatomic_spinlock_lock(&fs->lock);
     node = ul_reinterpret_cast(_node_t*, ulrb_find(fs->root, &inum, _node_comp, NULL));
     if(node) {
-        ulatomic_spinlock_unlock(&fs->lock);
-        ufs_minode_lock(&node->minode);
+        // 引用计数由集合的锁保护：释放锁之后最后一次关闭可能释放该节点，
+        // 而其他线程可能持有该inode的锁等待集合的锁
         if(node->minode.share == UINT32_MAX) ec = UFS_EOVERFLOW;
         else { ++node->minode.share; ec = 0; }
-        ufs_minode_unlock(&node->minode);
+        ulatomic_spinlock_unlock(&fs->lock);
         *pinode = &node->minode;
         return ec;
     }
@@ -99,13 +99,14 @@ UFS_HIDDEN int ufs_fileset_close(ufs_fileset_t* _fs, uint64_t inum) {
     node = ul_reinterpret_cast(_node_t*, ulrb_find(fs->root, &inum, _node_comp, NULL));
     if(ufs_unlikely(node == NULL)) { ulatomic_spinlock_unlock(&fs->lock); return UFS_EBADF; }
 
-    ufs_minode_lock(&node->minode);
     if(--node->minode.share == 0) {
+        // 删除的文件只加入孤儿链表，区块由后台回收释放
+        ufs_minode_lock(&node->minode);
         ec = ufs_minode_deinit(&node->minode);
         node = ul_reinterpret_cast(_node_t*, ulrb_remove(&fs->root, &inum, _node_comp, NULL));
+        ufs_minode_unlock(&node->minode);
         ufs_free(node);
     }
-    ufs_minode_unlock(&node->minode);
 
     ulatomic_spinlock_unlock(&fs->lock);
     return ec;
@@ -124,3 +125,39 @@ UFS_HIDDEN void ufs_fileset_sync(ufs_fileset_t* _fs) {
     ulrb_walk_preorder(fs->root, _node_walk, NULL);
     ulatomic_spinlock_unlock(&fs->lock);
 }
+
+static void _node_flush(void* opaque, const ulrb_node_t* _node) {
+    _node_t* node = ul_reinterpret_cast(_node_t*, ufs_const_cast(ulrb_node_t*, _node));
+    int* pec = ul_reinterpret_cast(int*, opaque);
+    int ec;
+    ufs_minode_lock(&node->minode);
+    ec = ufs_minode_flush(&node->minode);
+    ufs_minode_unlock(&node->minode);
+    if(ufs_unlikely(ec) && *pec == 0) *pec = ec;
+}
+UFS_HIDDEN int ufs_fileset_flush(ufs_fileset_t* _fs) {
+    int ec = 0;
+    _fileset_t* fs = ul_reinterpret_cast(_fileset_t*, _fs);
+    ulatomic_spinlock_lock(&fs->lock);
+    ulrb_walk_preorder(fs->root, _node_flush, &ec);
+    ulatomic_spinlock_unlock(&fs->lock);
+    return ec;
+}
+
+static void _node_reload(void* opaque, const ulrb_node_t* _node) {
+    _node_t* node = ul_reinterpret_cast(_node_t*, ufs_const_cast(ulrb_node_t*, _node));
+    int* pec = ul_reinterpret_cast(int*, opaque);
+    int ec;
+    ufs_minode_lock(&node->minode);
+    ec = ufs_minode_reload(&node->minode);
+    ufs_minode_unlock(&node->minode);
+    if(ufs_unlikely(ec) && *pec == 0) *pec = ec;
+}
+UFS_HIDDEN int ufs_fileset_reload(ufs_fileset_t* _fs) {
+    int ec = 0;
+    _fileset_t* fs = ul_reinterpret_cast(_fileset_t*, _fs);
+    ulatomic_spinlock_lock(&fs->lock);
+    ulrb_walk_preorder(fs->root, _node_reload, &ec);
+    ulatomic_spinlock_unlock(&fs->lock);
+    return ec;
+}
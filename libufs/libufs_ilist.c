@@ -8,7 +8,7 @@ static void _trans_ilist(_ufs_ilist_item_t* item) {
 }
 static _ufs_ilist_item_t* _todisk_alloc(const _ufs_ilist_item_t* item) {
     int i;
-    _ufs_ilist_item_t* ret = ul_reinterpret_cast(_ufs_ilist_item_t*, ufs_malloc(UFS_BLOCK_SIZE));
+    _ufs_ilist_item_t* ret = ul_reinterpret_cast(_ufs_ilist_item_t*, ufs_block_alloc());
     if(ufs_unlikely(ret == NULL)) return ret;
     ret->next = ul_trans_u64_le(item->next);
     for(i = 0; i < item->num; ++i)
@@ -35,8 +35,8 @@ static int _write_ilist(const _ufs_ilist_item_t* ufs_restrict item, ufs_transcat
     _ufs_ilist_item_t* ret;
     ret = _todisk_alloc(item);
     if(ufs_unlikely(ret == NULL)) return UFS_ENOMEM;
-    return ufs_transcation_add(transcation, ret, inum / UFS_INODE_PER_BLOCK, UFS_JORNAL_ADD_MOVE,
-        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE);
+    return ufs_transcation_add(transcation, ret, inum / UFS_INODE_PER_BLOCK,
+        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE, UFS_JORNAL_ADD_MOVE);
 }
 
 static int _rewind_ilist(_ufs_ilist_t* ufs_restrict ilist, ufs_transcation_t* ufs_restrict transcation, uint64_t inum) {
@@ -72,29 +72,88 @@ static int _write_multi_ilist(const _ufs_ilist_t* ufs_restrict ilist, ufs_transc
     return 0;
 }
 
-UFS_HIDDEN int ufs_ilist_init(ufs_ilist_t* ilist, uint64_t start, uint64_t block) {
-    int ec;
+#define _UNDO_POP 0 // 从栈中弹出
+#define _UNDO_POP_ITEM 1 // 弹出空的栈顶节点
+#define _UNDO_PUSH 2 // 压入栈中
+#define _UNDO_PUSH_ITEM 3 // 压入新的栈顶节点
+#define _UNDO_SYNC 4 // 只修改了stop
+#define _UNDO_SNAP 5 // 整体修改缓存，需要快照
+#define _UNDO_POP_LAZY 6 // 取出未使用过的inode
+// 在修改之前记录操作，撤销日志已满时改为快照
+static void _undo_log(ufs_ilist_t* ilist, int op, uint64_t inum) {
+    _ufs_ilist_undo_t* undo;
+    if(ilist->undo_snap) return;
+    if(op == _UNDO_SNAP || ilist->undo_num == UFS_ILIST_UNDO_MAX) {
+        ilist->backup = ilist->now;
+        ilist->undo_snap = 1;
+        return;
+    }
+    undo = ilist->undo + ilist->undo_num++;
+    undo->inum = inum;
+    undo->op = op;
+    undo->stop = ilist->now.stop;
+}
+UFS_HIDDEN void ufs_ilist_rollback(ufs_ilist_t* ilist) {
+    _ufs_ilist_t* now = &ilist->now;
+    const _ufs_ilist_undo_t* undo;
+    if(ilist->undo_snap) *now = ilist->backup;
+    while(ilist->undo_num > 0) {
+        undo = ilist->undo + --ilist->undo_num;
+        switch(undo->op) {
+        case _UNDO_POP:
+            now->item[now->top - 1].stack[now->item[now->top - 1].num++] = undo->inum;
+            ++now->block;
+            break;
+        case _UNDO_POP_ITEM:
+            now->item[now->top - 1].inum = now->item[now->top].next = undo->inum;
+            now->item[now->top].num = 0;
+            ++now->top;
+            ++now->block;
+            break;
+        case _UNDO_PUSH:
+            --now->item[now->top - 1].num;
+            --now->block;
+            break;
+        case _UNDO_PUSH_ITEM:
+            --now->top;
+            --now->block;
+            break;
+        case _UNDO_POP_LAZY:
+            --now->lazy;
+            ++now->block;
+            break;
+        default:
+            break;
+        }
+        now->stop = undo->stop;
+    }
+    ilist->undo_snap = 0;
+}
 
+UFS_HIDDEN int ufs_ilist_init(ufs_ilist_t* ilist, uint64_t start, uint64_t block, uint64_t lazy, uint64_t lazy_end) {
     ilist->bnum = start;
+    ilist->lazy_end = lazy_end;
     // ilist->transcation = NULL;
     ulatomic_spinlock_init(&ilist->lock);
+    return ufs_ilist_reload(ilist, block, lazy);
+}
+UFS_HIDDEN int ufs_ilist_reload(ufs_ilist_t* ilist, uint64_t block, uint64_t lazy) {
+    int ec;
 
     ilist->now.block = block;
-    ec = _rewind_ilist(&ilist->now, ilist->transcation, start);
+    ilist->now.lazy = lazy;
+    ec = _rewind_ilist(&ilist->now, ilist->transcation, ilist->bnum);
     if(ufs_unlikely(ec)) return ec;
     if(ufs_unlikely(ilist->now.top == 0)) { // 内存中必须至少滞留一个块
         ilist->now.item[0].next = 0;
         ilist->now.item[0].num = 0;
-        ilist->now.block = 0;
+        ilist->now.block = ilist->lazy_end - lazy;
         ilist->now.top = 1;
         ilist->now.stop = 0;
     }
 
-    ilist->backup.item[0].next = 0;
-    ilist->backup.item[0].num = 0;
-    ilist->backup.block = 0;
-    ilist->backup.top = 1;
-    ilist->backup.stop = 0;
+    ilist->undo_num = 0;
+    ilist->undo_snap = 0;
     return 0;
 }
 UFS_HIDDEN void ufs_ilist_deinit(ufs_ilist_t* ilist) {
@@ -102,20 +161,28 @@ UFS_HIDDEN void ufs_ilist_deinit(ufs_ilist_t* ilist) {
 }
 UFS_HIDDEN int ufs_ilist_create_empty(ufs_ilist_t* ilist, uint64_t start) {
     ilist->bnum = start;
+    ilist->lazy_end = 0;
     ilist->transcation = NULL;
     ulatomic_spinlock_init(&ilist->lock);
 
     ilist->now.item[0].next = 0;
     ilist->now.item[0].num = 0;
     ilist->now.block = 0;
+    ilist->now.lazy = 0;
     ilist->now.top = 1;
     ilist->now.stop = 0;
 
-    ilist->backup.item[0].next = 0;
-    ilist->backup.item[0].num = 0;
-    ilist->backup.block = 0;
-    ilist->backup.top = 1;
-    ilist->backup.stop = 0;
+    ilist->undo_num = 0;
+    ilist->undo_snap = 0;
+    return 0;
+}
+UFS_HIDDEN int ufs_ilist_create_lazy(ufs_ilist_t* ilist, uint64_t start, uint64_t lazy, uint64_t lazy_end) {
+    int ec;
+    ec = ufs_ilist_create_empty(ilist, start);
+    if(ufs_unlikely(ec)) return ec;
+    ilist->lazy_end = lazy_end;
+    ilist->now.lazy = lazy;
+    ilist->now.block = lazy_end - lazy;
     return 0;
 }
 
@@ -124,12 +191,18 @@ UFS_HIDDEN int ufs_ilist_sync(ufs_ilist_t* ilist) {
     uint64_t block = ul_trans_u64_le(ilist->now.block);
 
     ufs_assert(ilist->now.top > 0);
+    _undo_log(ilist, _UNDO_SYNC, 0);
     ec = _write_multi_ilist(&ilist->now, ilist->transcation, ilist->now.stop, ilist->now.top - 1);
     if(ufs_unlikely(ec)) return ec;
     ec = _write_ilist(ilist->now.item + ilist->now.top - 1, ilist->transcation, ilist->bnum);
     if(ufs_unlikely(ec)) return ec;
     ec = ufs_transcation_add(ilist->transcation, &block, UFS_BNUM_SB, offsetof(ufs_sb_t, iblock), 8, UFS_JORNAL_ADD_COPY);
     if(ufs_unlikely(ec)) return ec;
+    if(ilist->lazy_end) {
+        uint64_t lazy = ul_trans_u64_le(ilist->now.lazy);
+        ec = ufs_transcation_add(ilist->transcation, &lazy, UFS_BNUM_ILIST, UFS_LAZY_OFFSET + offsetof(ufs_lazy_t, ilazy), 8, UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) return ec;
+    }
     ilist->now.stop = ilist->now.top;
     return 0;
 }
@@ -140,20 +213,28 @@ UFS_HIDDEN int ufs_ilist_pop(ufs_ilist_t* ufs_restrict ilist, uint64_t* ufs_rest
     ufs_assert(n > 0);
     if(ilist->now.item[n - 1].num != 0) { // 栈还足够
         _ufs_ilist_item_t* item = ilist->now.item + n - 1;
+        _undo_log(ilist, _UNDO_POP, item->stack[item->num - 1]);
         *pinum = item->stack[--item->num];
         --ilist->now.block;
         ilist->now.stop = ufs_min(ilist->now.stop, n - 1);
         return 0;
     }
     if(n > 1) { // 内存中还存有多余的链表
+        _undo_log(ilist, _UNDO_POP_ITEM, ilist->now.item[n - 1].next);
         *pinum = ilist->now.item[n - 1].next;
         ilist->now.top = --n;
         --ilist->now.block;
         ilist->now.stop = ufs_min(ilist->now.stop, ilist->now.top);
         return 0;
     }
-    if(ilist->now.item[0].next == 0) // 磁盘耗尽
-        return UFS_ENOSPC;
+    if(ilist->now.item[0].next == 0) { // 链表耗尽，取出未使用过的inode
+        if(ilist->now.lazy >= ilist->lazy_end) return UFS_ENOSPC; // 磁盘耗尽
+        _undo_log(ilist, _UNDO_POP_LAZY, 0);
+        *pinum = ilist->now.lazy++;
+        --ilist->now.block;
+        return 0;
+    }
+    _undo_log(ilist, _UNDO_SNAP, 0);
     *pinum = ilist->now.item[0].next;
     ec = _rewind_ilist(&ilist->now, ilist->transcation, *pinum);
     if(ufs_unlikely(ec)) { *pinum = 0; return ec; }
@@ -167,17 +248,22 @@ UFS_HIDDEN int ufs_ilist_push(ufs_ilist_t* ilist, uint64_t inum) {
     ufs_assert(n > 0);
     if(ilist->now.item[n - 1].num != UFS_ILIST_ENTRY_NUM_MAX) {  // 栈还足够
         _ufs_ilist_item_t* item = ilist->now.item + n - 1;
+        _undo_log(ilist, _UNDO_PUSH, inum);
         item->stack[item->num++] = inum;
         ++ilist->now.block;
         ilist->now.stop = ufs_min(ilist->now.stop, n - 1);
         return 0;
     }
-    if(n == UFS_ILIST_CACHE_LIST_LIMIT) { // 内存中空间不足，我们写回链表
-        ec = _write_multi_ilist(&ilist->now, ilist->transcation, 0, UFS_ILIST_CACHE_LIST_LIMIT);
+    if(n == UFS_ILIST_CACHE_LIST_LIMIT) { // 内存中空间不足，我们写回链表（栈顶节点保存在固定位置，同步时再写入）
+        _undo_log(ilist, _UNDO_SNAP, 0);
+        ec = _write_multi_ilist(&ilist->now, ilist->transcation, 0, UFS_ILIST_CACHE_LIST_LIMIT - 1);
         if(ufs_unlikely(ec)) return ec;
         memmove(ilist->now.item, ilist->now.item + UFS_ILIST_CACHE_LIST_LIMIT / 2,
-            (UFS_ILIST_CACHE_LIST_LIMIT - UFS_ILIST_CACHE_LIST_LIMIT / 2) / 2 * sizeof(ilist->now.item[0]));
+            (UFS_ILIST_CACHE_LIST_LIMIT - UFS_ILIST_CACHE_LIST_LIMIT / 2) * sizeof(ilist->now.item[0]));
         n = UFS_ILIST_CACHE_LIST_LIMIT / 2;
+        ilist->now.stop = n - 1;
+    } else {
+        _undo_log(ilist, _UNDO_PUSH_ITEM, inum);
     }
     ilist->now.item[n - 1].inum = ilist->now.item[n].next = inum;
     ilist->now.item[n].num = 0;
@@ -193,10 +279,9 @@ UFS_HIDDEN void ufs_ilist_debug(const ufs_ilist_t* ilist, FILE* fp) {
     fprintf(fp, "\ttranscation: [%p]\n", ufs_const_cast(void*, ilist->transcation));
 
     fprintf(fp, "\tavailable: %" PRIu64 "\n", ilist->now.block);
+    if(ilist->lazy_end) fprintf(fp, "\tuntouched: [%" PRIu64 ", %" PRIu64 ")\n", ilist->now.lazy, ilist->lazy_end);
     fprintf(fp, "\tcached length: %d\n", ilist->now.top);
     fprintf(fp, "\tsynced length: %d\n", ilist->now.stop);
 
-    fprintf(fp, "\t<backup>available: %" PRIu64 "\n", ilist->now.block);
-    fprintf(fp, "\t<backup>cached length: %d\n", ilist->now.top);
-    fprintf(fp, "\t<backup>synced length: %d\n", ilist->now.stop);
+    fprintf(fp, "\tundo length: %d%s\n", ilist->undo_num, ilist->undo_snap ? " (snapshot)" : "");
 }
@@ -102,11 +102,67 @@ UFS_API int ufs_ptime(int64_t time, const char* fmt, FILE* fp) {
     return ret;
 }
 
+// 根据挂载选项设置持久化级别并启动后台任务
+static int _apply_mount_opt(ufs_t* ufs, const ufs_mount_opt_t* opt) {
+    int ec, ckpt, reclaim;
+    uint32_t interval;
+    ufs->pool.opaque = NULL;
+    ulatomic_spinlock_init(&ufs->pool.lck);
+    ufs->data_jornal = 0;
+    ufs->fast_commit = 0;
+    ufs->delay_alloc = 0;
+    ulatomic_store_explicit_64(&ufs->delayed, 0, ulatomic_memory_order_relaxed);
+    ulatomic_store_explicit_32(&ufs->txn, UFS_TXN_NONE, ulatomic_memory_order_relaxed);
+    ulatomic_spinlock_init(&ufs->txn_lock);
+    ufs->txn_owner = NULL;
+    ufs->txn_ops = 0;
+    ec = ufs_event_init(&ufs->txn_event);
+    if(ufs_unlikely(ec)) return ec;
+    if(opt == NULL) return 0;
+    // 单次写入涉及的区块需要放入同一个事务
+    ufs->data_jornal = ufs_min(opt->data_jornal, UFS_DATA_JORNAL_MAX);
+    ec = ufs_jornal_set_durability(&ufs->jornal, opt->durability, opt->sync_interval);
+    if(ufs_unlikely(ec)) goto fail_event;
+    // 其余级别的同步本来就不会立即刷盘
+    ufs->fast_commit = opt->fast_commit
+        && (opt->durability == UFS_DURABILITY_STRICT || opt->durability == UFS_DURABILITY_ORDERED);
+    ufs->delay_alloc = opt->delay_alloc != 0;
+    // UFS_DURABILITY_PERIODIC时后台检查点至少按刷盘间隔唤醒
+    interval = opt->checkpoint_interval;
+    if(opt->durability == UFS_DURABILITY_PERIODIC && (interval == 0 || interval > ufs->jornal.sync_interval))
+        interval = ufs->jornal.sync_interval;
+    ckpt = interval != 0 || opt->checkpoint_threshold != 0;
+    reclaim = opt->reclaim_batch != 0 && ufs->orphan.enabled;
+    if(!ckpt && !reclaim) return 0;
+#ifdef LIBUFS_NO_THREAD_SAFE
+    return 0;
+#else
+    // 后台检查点和后台回收各自占用一个工作线程
+    ec = ufs_threadpool_init(&ufs->pool, ckpt + reclaim);
+    if(ufs_unlikely(ec)) goto fail_event;
+    ec = ufs_jornal_start_checkpointer(&ufs->jornal, &ufs->pool, interval, opt->checkpoint_threshold);
+    if(ufs_likely(ec == 0)) {
+        ec = ufs_orphan_start_reclaimer(ufs, &ufs->pool, opt->reclaim_batch, opt->reclaim_interval);
+        if(ufs_unlikely(ec)) ufs_jornal_stop_checkpointer(&ufs->jornal);
+    }
+    if(ufs_likely(ec == 0)) return 0;
+    ufs_threadpool_deinit(&ufs->pool);
+#endif
+
+fail_event:
+    ufs_event_deinit(&ufs->txn_event);
+    return ec;
+}
+
 UFS_API int ufs_new(ufs_t** pufs, ufs_vfs_t* vfs) {
+    return ufs_new_ex(pufs, vfs, NULL);
+}
+UFS_API int ufs_new_ex(ufs_t** pufs, ufs_vfs_t* vfs, const ufs_mount_opt_t* opt) {
     int ec;
     uint64_t tmp;
     ufs_t* ufs;
     ufs_transcation_t transcation;
+    ufs_lazy_t lazy;
 
     if(pufs == NULL) return EINVAL;
     if(vfs == NULL) return EINVAL;
@@ -114,6 +170,8 @@ UFS_API int ufs_new(ufs_t** pufs, ufs_vfs_t* vfs) {
     ufs = ul_reinterpret_cast(ufs_t*, ufs_malloc(sizeof(ufs_t)));
     if(ufs_unlikely(ufs == NULL)) return ENOMEM;
     ufs->vfs = vfs;
+    ufs->zlist.bitmap = NULL;
+    ufs->zcache.slots = NULL;
 
     // 初始化日志
     ec = ufs_jornal_init(&ufs->jornal, vfs);
@@ -121,46 +179,99 @@ UFS_API int ufs_new(ufs_t** pufs, ufs_vfs_t* vfs) {
 
     // 读取超级块
     ec = ufs_vfs_pread(vfs, &ufs->sb, sizeof(ufs->sb), UFS_BNUM_SB * UFS_BLOCK_SIZE, &tmp);
-    if(ufs_unlikely(ec)) goto fail_return;
+    if(ufs_unlikely(ec)) goto fail_jornal;
 
     // 检查配置是否正确
     if(ufs->sb.magic[0] != UFS_MAGIC1 && ufs->sb.magic[1] != UFS_MAGIC2) {
-        ec = EINVAL; goto fail_return;
+        ec = EINVAL; goto fail_jornal;
     }
-    if(ufs->sb.jornal_num != UFS_JORNAL_NUM && ufs->sb.ext_offset != 0) {
-        ec = EINVAL; goto fail_return;
+    if(ufs->sb.jornal_num != UFS_JORNAL_NUM || (ufs->sb.ext_offset & ~UFS_SB_EXT_MASK) != 0) {
+        ec = EINVAL; goto fail_jornal;
     }
     if((ul_static_cast(uint64_t, 1) << ufs->sb.block_size_log2) != UFS_BLOCK_SIZE) {
-        ec = EINVAL; goto fail_return;
+        ec = EINVAL; goto fail_jornal;
     }
-    ufs->sb.iblock_max = ul_trans_u64_le(ufs->sb.iblock_max);
-    ufs->sb.zblock_max = ul_trans_u64_le(ufs->sb.zblock_max);
     
     // 修复日志
-    ec = ufs_fix_jornal(vfs, &ufs->sb);
-    if(ufs_unlikely(ec)) goto fail_return;
+    ec = ufs_fix_jornal(&ufs->jornal, &ufs->sb,
+        opt ? ul_static_cast(int, ufs_min(opt->recovery_threads, 64u)) : 0, &ufs->mstat);
+    if(ufs_unlikely(ec)) goto fail_jornal;
+
+    // 重放日志可能修改了超级块，重新读取
+    ec = ufs_vfs_pread(vfs, &ufs->sb, sizeof(ufs->sb), UFS_BNUM_SB * UFS_BLOCK_SIZE, &tmp);
+    if(ufs_unlikely(ec)) goto fail_jornal;
+    ufs->sb.iblock_max = ul_trans_u64_le(ufs->sb.iblock_max);
+    ufs->sb.zblock_max = ul_trans_u64_le(ufs->sb.zblock_max);
+
+    // 读取未使用过的区块和inode的范围
+    memset(&lazy, 0, sizeof(lazy));
+    if(ufs->sb.ext_offset & UFS_SB_EXT_LAZY) {
+        ec = ufs_vfs_pread(vfs, &lazy, sizeof(lazy), UFS_BNUM_ILIST * UFS_BLOCK_SIZE + UFS_LAZY_OFFSET, &tmp);
+        if(ufs_unlikely(ec)) goto fail_jornal;
+    }
 
     ufs_transcation_init(&transcation, &ufs->jornal);
     ufs->ilist.transcation = &transcation;
     ufs->zlist.transcation = &transcation;
 
     // 初始化ilist
-    ec = ufs_ilist_init(&ufs->ilist, UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK, ul_trans_u64_le(ufs->sb.iblock));
-    if(ufs_unlikely(ec)) goto fail_return;
+    ec = ufs_ilist_init(&ufs->ilist, UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK, ul_trans_u64_le(ufs->sb.iblock),
+        ul_trans_u64_le(lazy.ilazy), ul_trans_u64_le(lazy.ilazy_end));
+    if(ufs_unlikely(ec)) goto fail_transcation;
 
     // 初始化zlist
-    ec = ufs_zlist_init(&ufs->zlist, UFS_BNUM_ZLIST, ul_trans_u64_le(ufs->sb.zblock));
-    if(ufs_unlikely(ec)) goto fail_return;
+    if(ufs->sb.ext_offset & UFS_SB_EXT_ZBITMAP)
+        ec = ufs_zlist_init_bitmap(&ufs->zlist, UFS_BNUM_ZLIST);
+    else
+        ec = ufs_zlist_init(&ufs->zlist, UFS_BNUM_ZLIST, ul_trans_u64_le(ufs->sb.zblock),
+            ul_trans_u64_le(lazy.zlazy), ul_trans_u64_le(lazy.zlazy_end));
+    if(ufs_unlikely(ec)) goto fail_ilist;
+    ufs->zlist.range = (ufs->sb.ext_offset & UFS_SB_EXT_ZRANGE) != 0;
+
+    ufs->ilist.transcation = NULL;
+    ufs->zlist.transcation = NULL;
     
     // 初始化文件集合
     ec = ufs_fileset_init(&ufs->fileset, ufs);
-    if(ufs_unlikely(ec)) goto fail_return;
-    
-    ufs->ilist.transcation = NULL;
-    ufs->zlist.transcation = NULL;
+    if(ufs_unlikely(ec)) goto fail_zlist;
+
+    // 按挂载选项为磁盘启用区块缓存，扩展标记与之后写入的目录按顺序提交
+    if(opt && opt->zcache_upgrade && !(ufs->sb.ext_offset & UFS_SB_EXT_ZCACHE)) {
+        ufs->sb.ext_offset |= UFS_SB_EXT_ZCACHE;
+        ec = ufs_jornal_add(&ufs->jornal, &ufs->sb.ext_offset, UFS_BNUM_SB, offsetof(ufs_sb_t, ext_offset), 1, UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) goto fail_fileset;
+    }
+
+    // 初始化区块缓存
+    ec = ufs_zcache_init(&ufs->zcache, &ufs->zlist, &ufs->jornal, (ufs->sb.ext_offset & UFS_SB_EXT_ZCACHE) != 0);
+    if(ufs_unlikely(ec)) goto fail_fileset;
+
+    // 读取孤儿链表
+    ec = ufs_orphan_init(ufs);
+    if(ufs_unlikely(ec)) goto fail_zcache;
+
+    // 启动后台任务（失败时已经停止了启动的后台任务并释放线程池）
+    ec = _apply_mount_opt(ufs, opt);
+    if(ufs_unlikely(ec)) goto fail_zcache;
+    // 没有后台回收时在挂载时继续上次未完成的回收（出错时留到下次挂载）
+    ufs_orphan_reclaim_all(ufs);
+    ufs_transcation_deinit(&transcation);
     *pufs = ufs;
     return 0;
 
+    // 按初始化的相反顺序释放
+fail_zcache:
+    ufs_zcache_deinit(&ufs->zcache);
+fail_fileset:
+    ufs_fileset_deinit(&ufs->fileset);
+fail_zlist:
+    ufs_zlist_deinit(&ufs->zlist);
+fail_ilist:
+    ufs_ilist_deinit(&ufs->ilist);
+fail_transcation:
+    ufs_transcation_deinit(&transcation);
+fail_jornal:
+    ufs_jornal_deinit(&ufs->jornal);
 fail_return:
     ufs_free(ufs);
     return ec;
@@ -172,21 +283,31 @@ static uint8_t _log2(uint64_t x) {
     return i;
 }
 UFS_API int ufs_new_format(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size) {
+    return ufs_new_format_ex(pufs, vfs, size, NULL);
+}
+UFS_API int ufs_new_format_ex(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size, const ufs_format_opt_t* opt) {
     int ec;
-    uint64_t iblk, zblk;
+    uint64_t iblk, zblk, jblk, zstart;
     ufs_t* ufs;
 
     if(pufs == NULL) return EINVAL;
     if(vfs == NULL) return EINVAL;
+    jblk = opt ? opt->jornal_size : 0;
+    if(jblk != 0 && jblk < UFS_JORNAL_NUM) return EINVAL;
+    if(opt && opt->zalloc != UFS_ZALLOC_LIST && opt->zalloc != UFS_ZALLOC_BITMAP) return EINVAL;
 
     ufs = ul_reinterpret_cast(ufs_t*, ufs_malloc(sizeof(ufs_t)));
     if(ufs_unlikely(ufs == NULL)) return ENOMEM;
     ufs->vfs = vfs;
+    ufs->zlist.bitmap = NULL;
+    ufs->zcache.slots = NULL;
 
     // 初始化日志
     ec = ufs_jornal_init(&ufs->jornal, vfs);
     if(ufs_unlikely(ec)) goto fail_return;
     
+    memset(&ufs->mstat, 0, sizeof(ufs->mstat));
+
     // 初始化超级块
     memset(&ufs->sb, 0, sizeof(ufs->sb));
     ufs->sb.magic[0] = UFS_MAGIC1;
@@ -197,72 +318,140 @@ UFS_API int ufs_new_format(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size) {
 
     // 初始化文件集合
     ec = ufs_fileset_init(&ufs->fileset, ufs);
-    if(ufs_unlikely(ec)) goto fail_return;
+    if(ufs_unlikely(ec)) goto fail_jornal;
 
-    // 计算inode和zone数量
+    // 计算inode和zone数量（自定义大小的日志区位于inode之后，并额外占用一个日志超级块）
     size = size / UFS_BLOCK_SIZE;
-    if(size < UFS_BNUM_START) { ec = UFS_ENOSPC; goto fail_return; }
+    if(size < UFS_BNUM_START) { ec = UFS_ENOSPC; goto fail_fileset; }
     size -= UFS_BNUM_START;
+    if(jblk != 0) {
+        if(size <= jblk + 1) { ec = UFS_ENOSPC; goto fail_fileset; }
+        size -= jblk + 1;
+    }
     iblk = ((UFS_INODE_DEFAULT_RATIO / UFS_BLOCK_SIZE) * UFS_INODE_PER_BLOCK + 1);
     iblk = size / iblk;
     zblk = size - iblk;
-    if(iblk == 0 || zblk == 0) { ec = UFS_ENOSPC; goto fail_return; }
-
-    // 创建ilist
-    do {
+    if(iblk == 0 || zblk == 0) { ec = UFS_ENOSPC; goto fail_fileset; }
+
+    // 初始化日志区
+    if(jblk == 0) {
+        ec = ufs_format_jornal(&ufs->jornal, UFS_BNUM_JORNAL, UFS_JORNAL_NUM);
+        zstart = UFS_BNUM_START + iblk;
+    } else {
+        ufs->sb.ext_offset = UFS_SB_EXT_JORNAL;
+        ufs->sb.jornal_bnum = ul_trans_u64_le(UFS_BNUM_START + iblk);
+        ufs->sb.jornal_size = ul_trans_u64_le(jblk);
+        ec = ufs_format_jornal(&ufs->jornal, UFS_BNUM_START + iblk, jblk);
+        zstart = UFS_BNUM_START + iblk + jblk + 1;
+    }
+    if(ufs_unlikely(ec)) goto fail_fileset;
+
+    // 创建ilist（延迟构建时只记录未使用过的inode的范围）
+    if(opt && opt->lazy) {
+        ec = ufs_ilist_create_lazy(&ufs->ilist, UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK,
+            UFS_INUM_ROOT + 1, (UFS_BNUM_START + iblk) * UFS_INODE_PER_BLOCK);
+        if(ufs_unlikely(ec)) goto fail_fileset;
+        ufs->sb.ext_offset |= UFS_SB_EXT_LAZY;
+    } else do {
         ufs_transcation_t transcation;
         uint64_t i, e;
         ufs_transcation_init(&transcation, &ufs->jornal);
         ufs->ilist.transcation = &transcation;
         ec = ufs_ilist_create_empty(&ufs->ilist, UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK);
-        if(ufs_unlikely(ec)) goto fail_return;
+        if(ufs_unlikely(ec)) { ufs_transcation_deinit(&transcation); goto fail_fileset; }
         e = UFS_INUM_ROOT + 1;
         i = (UFS_BNUM_START + iblk) * UFS_INODE_PER_BLOCK - 1;
         ufs_ilist_lock(&ufs->ilist, &transcation);
         for(; i >= e; --i) {
             ec = ufs_ilist_push(&ufs->ilist, i);
             if(ufs_unlikely(ec)) break;
-            if(transcation.num >= UFS_JORNAL_NUM - UFS_ILIST_CACHE_LIST_LIMIT) {
+            if(transcation.num >= UFS_JORNAL_OP_MAX - UFS_ILIST_CACHE_LIST_LIMIT) {
                 ec = ufs_transcation_commit_all(&transcation);
                 if(ufs_unlikely(ec)) break;
             }
         }
+        // 最后一次写回的节点还留在事务中
+        if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
         ufs_ilist_unlock(&ufs->ilist);
         ufs_transcation_deinit(&transcation);
-        if(ufs_unlikely(ec)) goto fail_return2;
+        if(ufs_unlikely(ec)) goto fail_ilist;
     } while(0);
 
-    // 初始化zlist
-    do {
+    // 初始化zlist（使用位图时第一个区块同样保留不用）
+    if(opt && opt->zalloc == UFS_ZALLOC_BITMAP) do {
+        ufs_transcation_t transcation;
+        ufs_transcation_init(&transcation, &ufs->jornal);
+        ufs->zlist.transcation = &transcation;
+        ec = ufs_zlist_create_empty(&ufs->zlist, UFS_BNUM_ZLIST);
+        if(ufs_unlikely(ec)) { ufs_transcation_deinit(&transcation); goto fail_ilist; }
+        ufs_zlist_lock(&ufs->zlist, &transcation);
+        ec = ufs_zlist_create_bitmap(&ufs->zlist, UFS_BNUM_ZLIST, zstart + 1, zblk - 1);
+        if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+        ufs_zlist_unlock(&ufs->zlist);
+        ufs_transcation_deinit(&transcation);
+        if(ufs_unlikely(ec)) goto fail_zlist;
+        ufs->sb.ext_offset |= UFS_SB_EXT_ZBITMAP;
+    } while(0);
+    else if(opt && opt->lazy) {
+        ec = ufs_zlist_create_lazy(&ufs->zlist, UFS_BNUM_ZLIST, zstart + 1, zstart + zblk);
+        if(ufs_unlikely(ec)) goto fail_ilist;
+        if(opt->zrange) {
+            ufs->zlist.range = 1;
+            ufs->sb.ext_offset |= UFS_SB_EXT_ZRANGE;
+        }
+    } else do {
         ufs_transcation_t transcation;
         uint64_t i, e;
-        e = UFS_BNUM_START + iblk + 1;
-        i = UFS_BNUM_START + iblk + zblk - 1;
+        e = zstart + 1;
+        i = zstart + zblk - 1;
         ufs_transcation_init(&transcation, &ufs->jornal);
         ufs->zlist.transcation = &transcation;
         ec = ufs_zlist_create_empty(&ufs->zlist, UFS_BNUM_ZLIST);
-        if(ufs_unlikely(ec)) goto fail_return2;
+        if(ufs_unlikely(ec)) { ufs_transcation_deinit(&transcation); goto fail_ilist; }
+        // 使用区块范围编码时逆序压入的区块相邻，合并为少数几项
+        if(opt && opt->zrange) {
+            ufs->zlist.range = 1;
+            ufs->sb.ext_offset |= UFS_SB_EXT_ZRANGE;
+        }
         ufs_zlist_lock(&ufs->zlist, &transcation);
         for(; i >= e; --i) {
             ec = ufs_zlist_push(&ufs->zlist, i);
             if(ufs_unlikely(ec)) break;
-            if(transcation.num == UFS_JORNAL_NUM - UFS_ZLIST_CACHE_LIST_LIMIT) {
+            if(transcation.num >= UFS_JORNAL_OP_MAX - UFS_ZLIST_CACHE_LIST_LIMIT) {
                 ec = ufs_transcation_commit_all(&transcation);
                 if(ufs_unlikely(ec)) break;
             }
         }
+        // 最后一次写回的节点还留在事务中
+        if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
         ufs_zlist_unlock(&ufs->zlist);
         ufs_transcation_deinit(&transcation);
-        if(ufs_unlikely(ec)) goto fail_return2;
+        if(ufs_unlikely(ec)) goto fail_zlist;
     } while(0);
 
+    if(opt && opt->orphan) ufs->sb.ext_offset |= UFS_SB_EXT_ORPHAN;
+    if(opt && opt->zcache) ufs->sb.ext_offset |= UFS_SB_EXT_ZCACHE;
     ufs->sb.iblock_max = ul_trans_u64_le(ufs->ilist.now.block + 1);
     ufs->sb.iblock = ul_trans_u64_le(ufs->ilist.now.block);
     ufs->sb.zblock_max = ufs->sb.zblock = ul_trans_u64_le(ufs->zlist.now.block);
     ec = ufs_jornal_add(&ufs->jornal, &ufs->sb, UFS_BNUM_SB, 0, sizeof(ufs->sb), UFS_JORNAL_ADD_COPY);
-    if(ufs_unlikely(ec)) goto fail_return2;
+    if(ufs_unlikely(ec)) goto fail_zlist;
+    if(ufs->sb.ext_offset & UFS_SB_EXT_LAZY) {
+        ufs_lazy_t lazy;
+        lazy.zlazy = ul_trans_u64_le(ufs->zlist.now.lazy);
+        lazy.zlazy_end = ul_trans_u64_le(ufs->zlist.lazy_end);
+        lazy.ilazy = ul_trans_u64_le(ufs->ilist.now.lazy);
+        lazy.ilazy_end = ul_trans_u64_le(ufs->ilist.lazy_end);
+        ec = ufs_jornal_add(&ufs->jornal, &lazy, UFS_BNUM_ILIST, UFS_LAZY_OFFSET, sizeof(lazy), UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) goto fail_zlist;
+    }
+    if(ufs->sb.ext_offset & UFS_SB_EXT_ORPHAN) { // 空的孤儿链表
+        uint64_t head = 0;
+        ec = ufs_jornal_add(&ufs->jornal, &head, UFS_BNUM_ILIST, UFS_ORPHAN_OFFSET, 8, UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) goto fail_zlist;
+    }
     ec = ufs_sync(ufs);
-    if(ufs_unlikely(ec)) goto fail_return2;
+    if(ufs_unlikely(ec)) goto fail_zlist;
 
     ufs->sb.iblock_max = ul_trans_u64_le(ufs->sb.iblock_max);
     ufs->sb.iblock = ul_trans_u64_le(ufs->sb.iblock);
@@ -281,14 +470,34 @@ UFS_API int ufs_new_format(ufs_t** pufs, ufs_vfs_t* vfs, uint64_t size) {
         inode.uid = 0;
         inode.gid = 0;
         memset(inode.zones, 0, sizeof(inode.zones));
+        inode.orphan = 0;
         ec = _write_inode_direct(&ufs->jornal, &inode, UFS_INUM_ROOT);
-        if(ufs_unlikely(ec)) goto fail_return2;
+        if(ufs_unlikely(ec)) goto fail_zlist;
     } while(0);
 
+    // 初始化区块缓存
+    ec = ufs_zcache_init(&ufs->zcache, &ufs->zlist, &ufs->jornal, (ufs->sb.ext_offset & UFS_SB_EXT_ZCACHE) != 0);
+    if(ufs_unlikely(ec)) goto fail_zlist;
+
+    ec = ufs_orphan_init(ufs);
+    if(ufs_unlikely(ec)) goto fail_zcache;
+
+    // 启动后台任务（失败时已经停止了启动的后台任务并释放线程池）
+    ec = _apply_mount_opt(ufs, opt ? opt->mount : NULL);
+    if(ufs_unlikely(ec)) goto fail_zcache;
     *pufs = ufs;
     return 0;
 
-fail_return2:
+    // 按初始化的相反顺序释放
+fail_zcache:
+    ufs_zcache_deinit(&ufs->zcache);
+fail_zlist:
+    ufs_zlist_deinit(&ufs->zlist);
+fail_ilist:
+    ufs_ilist_deinit(&ufs->ilist);
+fail_fileset:
+    ufs_fileset_deinit(&ufs->fileset);
+fail_jornal:
     ufs_jornal_deinit(&ufs->jornal);
 fail_return:
     ufs_free(ufs);
@@ -324,14 +533,173 @@ do_return:
     return ec;
 }
 
+UFS_API int ufs_mount_stat(ufs_t* ufs, ufs_mount_stat_t* stat) {
+    if(ufs_unlikely(ufs == NULL || stat == NULL)) return UFS_EINVAL;
+    *stat = ufs->mstat;
+    return 0;
+}
+
+static void _txn_release(ufs_t* ufs);
 UFS_API void ufs_destroy(ufs_t* ufs) {
     if(ufs_unlikely(ufs == NULL)) return;
+    ulatomic_store_explicit_32(&ufs->txn, UFS_TXN_DONE, ulatomic_memory_order_relaxed);
+    // 提交未结束的事务，无法提交时丢弃
+    if(ufs_unlikely(ufs_jornal_unhold(&ufs->jornal, 0))) ufs_jornal_unhold(&ufs->jornal, 1);
+    _txn_release(ufs); // 唤醒等待事务结束的后台回收
+    ufs_jornal_stop_checkpointer(&ufs->jornal);
+    ufs_orphan_stop_reclaimer(ufs);
+    ufs_threadpool_deinit(&ufs->pool);
+    ufs_event_deinit(&ufs->orphan.event);
+    ufs_event_deinit(&ufs->txn_event);
+    ufs_fileset_flush(&ufs->fileset); // 延迟分配的块需要在归还缓存之前分配
+    ufs_zcache_release(&ufs->zcache); // 缓存的区块归还zlist，使得卸载后的镜像中不留下缓存
     ufs_sync(ufs);
     ufs_fileset_deinit(&ufs->fileset);
+    ufs_jornal_flush(&ufs->jornal); // UFS_DURABILITY_PERIODIC时ufs_sync可能没有提交
+    ufs_jornal_checkpoint(&ufs->jornal);
+    ufs_zcache_deinit(&ufs->zcache);
+    ufs_zlist_deinit(&ufs->zlist);
+    ufs_jornal_deinit(&ufs->jornal);
     ufs_free(ufs);
 }
 
+#define _TXN_WAIT 10 // 等待公开事务结束或修改操作完成的轮询间隔（毫秒）
+UFS_HIDDEN int ufs_txn_enter(ufs_t* ufs, const ufs_context_t* context) {
+    ulatomic_spinlock_lock(&ufs->txn_lock);
+    while(ufs->txn_owner != NULL && ufs->txn_owner != context) {
+        ulatomic_spinlock_unlock(&ufs->txn_lock);
+#ifdef LIBUFS_NO_THREAD_SAFE
+        return UFS_EAGAIN; // 单线程模式下事务不会在等待期间结束
+#else
+        ufs_event_wait(&ufs->txn_event, _TXN_WAIT);
+        ulatomic_spinlock_lock(&ufs->txn_lock);
+#endif
+    }
+    // 属于事务的修改操作不计数
+    if(ufs->txn_owner == NULL) ++ufs->txn_ops;
+    ulatomic_spinlock_unlock(&ufs->txn_lock);
+    return 0;
+}
+UFS_HIDDEN void ufs_txn_leave(ufs_t* ufs, const ufs_context_t* context) {
+    int notify = 0;
+    ulatomic_spinlock_lock(&ufs->txn_lock);
+    // 开始时没有事务，期间其他上下文开始的事务正在等待修改操作完成
+    if(ufs->txn_owner != context) notify = --ufs->txn_ops == 0 && ufs->txn_owner != NULL;
+    ulatomic_spinlock_unlock(&ufs->txn_lock);
+    if(notify) ufs_event_notify(&ufs->txn_event);
+}
+// context是否是当前公开事务所属的上下文
+static int _txn_owned(const ufs_context_t* context) {
+    int owned;
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return 0;
+    ulatomic_spinlock_lock(&context->ufs->txn_lock);
+    owned = context->ufs->txn_owner == context;
+    ulatomic_spinlock_unlock(&context->ufs->txn_lock);
+    return owned;
+}
+// 结束公开事务，唤醒等待的修改操作
+static void _txn_release(ufs_t* ufs) {
+    ulatomic_spinlock_lock(&ufs->txn_lock);
+    ufs->txn_owner = NULL;
+    ulatomic_spinlock_unlock(&ufs->txn_lock);
+    ufs_event_notify(&ufs->txn_event);
+}
+// 事务写入的文件数据检查点之后才恢复为直接读写（检查点失败时保持经过日志，留到下一次事务结束）
+static void _txn_finish(ufs_t* ufs) {
+    ulatomic_store_explicit_32(&ufs->txn, UFS_TXN_DONE, ulatomic_memory_order_release);
+    if(ufs_likely(ufs_jornal_checkpoint(&ufs->jornal) == 0))
+        ulatomic_store_explicit_32(&ufs->txn, UFS_TXN_NONE, ulatomic_memory_order_release);
+    _txn_release(ufs);
+}
+
+UFS_API int ufs_txn_begin(ufs_context_t* context) {
+    int ec;
+    ufs_t* ufs;
+    if(ufs_unlikely(context == NULL || context->ufs == NULL)) return UFS_EINVAL;
+    ufs = context->ufs;
+    ulatomic_spinlock_lock(&ufs->txn_lock);
+    if(ufs->txn_owner != NULL) {
+        ec = ufs->txn_owner == context ? UFS_EINVAL : UFS_EAGAIN;
+        ulatomic_spinlock_unlock(&ufs->txn_lock);
+        return ec;
+    }
+    // 之后其他上下文的修改操作等待事务结束，已经开始的修改操作不属于事务，需要先完成
+    ufs->txn_owner = context;
+    while(ufs->txn_ops != 0) {
+        ulatomic_spinlock_unlock(&ufs->txn_lock);
+        ufs_event_wait(&ufs->txn_event, _TXN_WAIT);
+        ulatomic_spinlock_lock(&ufs->txn_lock);
+    }
+    ulatomic_spinlock_unlock(&ufs->txn_lock);
+    // 事务之前写入的数据不应随事务中止而撤销
+    ec = ufs_fileset_flush(&ufs->fileset);
+    if(ufs_likely(ec == 0)) ec = ufs_jornal_hold(&ufs->jornal);
+    if(ufs_unlikely(ec)) {
+        _txn_release(ufs);
+        return ec;
+    }
+    ulatomic_store_explicit_32(&ufs->txn, UFS_TXN_ACTIVE, ulatomic_memory_order_release);
+    return 0;
+}
+UFS_API int ufs_txn_commit(ufs_context_t* context) {
+    int ec;
+    if(ufs_unlikely(!_txn_owned(context))) return UFS_EINVAL;
+    // 超过一个批次的事务在此时写入，失败时事务保持未结束
+    ec = ufs_jornal_unhold(&context->ufs->jornal, 0);
+    if(ufs_unlikely(ec)) return ec;
+    // 不受持久化级别影响，保证事务作为一次提交写入
+    ec = ufs_jornal_flush(&context->ufs->jornal);
+    _txn_finish(context->ufs);
+    return ec;
+}
+// 从日志/磁盘重新读取空闲列表和已打开文件的inode
+static int _reload_cache(ufs_t* ufs) {
+    int ec;
+    uint64_t block, lazy = 0;
+    ufs_transcation_t transcation;
+
+    ufs_transcation_init(&transcation, &ufs->jornal);
+
+    ufs_ilist_lock(&ufs->ilist, &transcation);
+    ec = ufs_jornal_read(&ufs->jornal, &block, UFS_BNUM_SB, offsetof(ufs_sb_t, iblock), 8);
+    if(ufs_likely(ec == 0) && ufs->ilist.lazy_end)
+        ec = ufs_jornal_read(&ufs->jornal, &lazy, UFS_BNUM_ILIST, UFS_LAZY_OFFSET + offsetof(ufs_lazy_t, ilazy), 8);
+    if(ufs_likely(ec == 0)) ec = ufs_ilist_reload(&ufs->ilist, ul_trans_u64_le(block), ul_trans_u64_le(lazy));
+    ufs_ilist_unlock(&ufs->ilist);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    lazy = 0;
+    ufs_zlist_lock(&ufs->zlist, &transcation);
+    ec = ufs_jornal_read(&ufs->jornal, &block, UFS_BNUM_SB, offsetof(ufs_sb_t, zblock), 8);
+    if(ufs_likely(ec == 0) && ufs->zlist.lazy_end)
+        ec = ufs_jornal_read(&ufs->jornal, &lazy, UFS_BNUM_ILIST, UFS_LAZY_OFFSET + offsetof(ufs_lazy_t, zlazy), 8);
+    if(ufs_likely(ec == 0)) ec = ufs_zlist_reload(&ufs->zlist, ul_trans_u64_le(block), ul_trans_u64_le(lazy));
+    ufs_zlist_unlock(&ufs->zlist);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    ec = ufs_zcache_reload(&ufs->zcache);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    ec = ufs_orphan_reload(ufs);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    ec = ufs_fileset_reload(&ufs->fileset);
+
+do_return:
+    ufs_transcation_deinit(&transcation);
+    return ec;
+}
+UFS_API int ufs_txn_abort(ufs_context_t* context) {
+    int ec;
+    if(ufs_unlikely(!_txn_owned(context))) return UFS_EINVAL;
+    ufs_jornal_unhold(&context->ufs->jornal, 1);
+    ec = _reload_cache(context->ufs);
+    _txn_finish(context->ufs);
+    return ec;
+}
+
 UFS_API int ufs_statvfs(ufs_t* ufs, ufs_statvfs_t* stat) {
+    uint64_t delayed;
     if(ufs_unlikely(ufs == NULL || stat == NULL)) return UFS_EINVAL;
 
     stat->f_bsize = UFS_BLOCK_SIZE;
@@ -341,6 +709,10 @@ UFS_API int ufs_statvfs(ufs_t* ufs, ufs_statvfs_t* stat) {
     ufs_zlist_lock(&ufs->zlist, NULL);
     stat->f_bavail = stat->f_bfree = ufs->zlist.now.block;
     ufs_zlist_unlock(&ufs->zlist);
+    stat->f_bavail = stat->f_bfree += ufs_zcache_cached(&ufs->zcache);
+    // 延迟分配的块已经占用了空间
+    delayed = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&ufs->delayed, ulatomic_memory_order_relaxed));
+    stat->f_bavail = stat->f_bfree -= ufs_min(stat->f_bfree, delayed);
 
     stat->f_files = ufs->sb.iblock_max;
     ufs_ilist_lock(&ufs->ilist, NULL);
@@ -15,6 +15,18 @@ ul_hapi int ufs_popcount(unsigned v) {
     int c; for(c = 0; v; v >>= 1) c += (v & 1); return c;
 #endif
 }
+// 末尾0的个数（v不能为0）
+ul_hapi int ufs_ctz64(uint64_t v) {
+#ifdef __has_builtin
+    #if __has_builtin(__builtin_ctzll)
+        return __builtin_ctzll(v);
+    #else
+        int i; for(i = 0; !(v & 1); v >>= 1) ++i; return i;
+    #endif
+#else
+    int i; for(i = 0; !(v & 1); v >>= 1) ++i; return i;
+#endif
+}
 ul_hapi int ufs_clz(unsigned v) {
 #ifdef __has_builtin
     #if __has_builtin(__builtin_popcount)
@@ -26,6 +38,8 @@ ul_hapi int ufs_clz(unsigned v) {
     int i; for(i = 0; !(v & (1u << (sizeof(unsigned) - 1))); v <<= 1) ++i; return i;
 #endif
 }
+// 计算CRC32C校验和（crc为之前数据的校验和，初始为0）
+UFS_HIDDEN uint32_t ufs_crc32c(uint32_t crc, const void* buf, size_t len);
 
 typedef struct ufs_sb_t {
     uint8_t magic[2]; // 魔数
@@ -38,7 +52,7 @@ typedef struct ufs_sb_t {
     uint8_t jornal_last1; // 日志终止标记1
     uint8_t jornal_last0; // 日志终止标记0
     uint8_t block_size_log2; // 块的大小（2的指数）
-    uint8_t ext_offset; // 扩展标记（仅作向后兼容，当前版本为0）
+    uint8_t ext_offset; // 扩展标记（UFS_SB_EXT_*的组合）
     uint32_t _jd3;
 
 #define UFS_BLOCK_OFFSET offsetof(ufs_sb_t, iblock)
@@ -46,9 +60,31 @@ typedef struct ufs_sb_t {
     uint64_t zblock; // zone块数
     uint64_t iblock_max; // 最大inode块数
     uint64_t zblock_max; // 最大zone块数
+
+    uint64_t jornal_bnum; // 环形日志区起始块号（设置UFS_SB_EXT_JORNAL时有效）
+    uint64_t jornal_size; // 环形日志区块数（设置UFS_SB_EXT_JORNAL时有效，其后一块为日志超级块）
 } ufs_sb_t;
+#define UFS_SB_EXT_JORNAL 1 // 日志区由jornal_bnum和jornal_size指定（否则使用默认的日志区）
+#define UFS_SB_EXT_ZBITMAP 2 // 空闲区块由位图管理（位图的描述保存在UFS_BNUM_ZLIST中）
+#define UFS_SB_EXT_LAZY 4 // 空闲链表延迟构建（未使用过的区块和inode的范围保存在UFS_INUM_LAZY中）
+#define UFS_SB_EXT_ZRANGE 8 // zlist栈中的一项可以记录一段连续的区块
+#define UFS_SB_EXT_ORPHAN 16 // 孤儿链表的链表头保存在UFS_INUM_ORPHAN中
+#define UFS_SB_EXT_ZCACHE 32 // 区块缓存的目录保存在UFS_INUM_ZCACHE中
+#define UFS_SB_EXT_MASK (UFS_SB_EXT_JORNAL | UFS_SB_EXT_ZBITMAP | UFS_SB_EXT_LAZY | UFS_SB_EXT_ZRANGE | UFS_SB_EXT_ORPHAN \
+    | UFS_SB_EXT_ZCACHE)
 #define UFS_SB_DISK_SIZE sizeof(ufs_sb_t)
 
+// 从未使用过的区块[zlazy, zlazy_end)和inode[ilazy, ilazy_end)，它们不在空闲链表中，链表耗尽时才依次取出
+// 超级块已没有空间，保存在ilist头部所在块中未使用的inode位置
+typedef struct ufs_lazy_t {
+    uint64_t zlazy;
+    uint64_t zlazy_end;
+    uint64_t ilazy;
+    uint64_t ilazy_end;
+} ufs_lazy_t;
+#define UFS_INUM_LAZY (UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK + 2)
+#define UFS_LAZY_OFFSET ((UFS_INUM_LAZY % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE)
+
 typedef struct ufs_inode_t {
     uint32_t nlink; // 链接数
     uint16_t mode; // 模式
@@ -82,6 +118,7 @@ typedef struct ufs_inode_t {
 
     */
     uint64_t zones[16];
+    uint64_t orphan; // 孤儿链表中的下一个inode（只在链接数为0且尚未回收时有效）
 } ufs_inode_t;
 #define UFS_INODE_MEMORY_SIZE (sizeof(ufs_inode_t))
 #define UFS_ZONE_PER_BLOCK (UFS_BLOCK_SIZE / 8)
@@ -92,6 +129,17 @@ typedef struct ufs_t ufs_t;
 
 
 
+/**
+ * 区块缓冲池
+ *
+ * 日志和事务中的区块缓冲区（UFS_JORNAL_ADD_MOVE/UFS_JORNAL_ADD_COPY）均从缓冲池中分配，并按UFS_BLOCK_SIZE对齐。
+ * 由ufs_block_alloc分配的缓冲区必须使用ufs_block_free释放，反之亦然。
+*/
+UFS_HIDDEN void* ufs_block_alloc(void);
+UFS_HIDDEN void ufs_block_free(void* buf);
+
+
+
 /**
  * 文件描述符
 */
@@ -104,12 +152,15 @@ ul_hapi int ufs_vfs_pwrite(ufs_vfs_t* vfs, const void* buf, size_t len, int64_t
     return vfs->pwrite(vfs, buf, len, off, pwriten);
 }
 ul_hapi int ufs_vfs_sync(ufs_vfs_t* vfs) { return vfs->sync(vfs); }
+ul_hapi int ufs_vfs_datasync(ufs_vfs_t* vfs) { return vfs->datasync ? vfs->datasync(vfs) : vfs->sync(vfs); }
 
 #define ufs_vfs_offset(bnum) ul_static_cast(int64_t, (bnum) * UFS_BLOCK_SIZE)
 #define ufs_vfs_offset2(bnum, off) ul_static_cast(int64_t, (bnum) * UFS_BLOCK_SIZE + off)
 
 UFS_HIDDEN int ufs_vfs_pread_check(ufs_vfs_t* ufs_restrict vfs, void* ufs_restrict buf, size_t len, int64_t off);
 UFS_HIDDEN int ufs_vfs_pwrite_check(ufs_vfs_t* ufs_restrict vfs, const void* ufs_restrict buf, size_t len, int64_t off);
+/* 将iov中的iovcnt段写入到off开始的连续位置（iov的内容会被修改） */
+UFS_HIDDEN int ufs_vfs_pwritev_check(ufs_vfs_t* ufs_restrict vfs, ufs_iovec_t* ufs_restrict iov, int iovcnt, int64_t off);
 /* 拷贝文件描述符的两块区域（区域重叠为UB行为） */
 UFS_HIDDEN int ufs_vfs_copy(ufs_vfs_t* vfs, int64_t off_in, int64_t off_out, size_t len);
 UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off);
@@ -121,48 +172,201 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off);
  *
  * 当我们需要写入元信息或者目录信息时，为了防止突然的断电/硬盘损坏导致的部分数据缺失，我们提供了日志写入功能。
  * 日志写入可以保证写入操作要么完全完成，要么没有发生。
+ * 日志采用重做（redo）方式，日志区是一个环形缓冲区：
+ * - 每次提交在头部顺序写入一个记录块（序列号、目标块号和CRC32C校验和）和新区块，刷盘一次后即完成提交，随后写回原位置（不等待落盘）
+ * - 已提交的事务留在日志区中，直到日志区空间不足时才进行检查点：刷盘后推进尾部，并将尾部位置写入日志超级块
+ * - 挂载时从尾部开始按序列号依次重放校验通过的提交
+ * 每个区块记录其修改范围，修改范围较小的区块只记录修改的字节（增量记录），紧凑排列在完整区块之后。
+ * 已提交但未检查点的区块如果被重新分配作为数据块（不经过日志写入），重放旧的内容会覆盖新数据，
+ * 因此分配的zone直接写入之前需要调用ufs_jornal_reuse，必要时先进行检查点。
+ * ufs_jornal_reuse可能刷盘，只能在释放zlist和区块缓存的锁之后调用（分配函数本身不调用）。
  * 我们的日志写入依赖于以下假设：
  * - 磁盘的写入一定是线性的，即其始终从磁盘的一端向另一端逐字节写入（每次刷盘的顺序可以不一致）
 */
+#define UFS_JORNAL_OP_MAX (UFS_JORNAL_NUM - 1) // 单次提交的最大区块数（每次提交还需要一个记录块）
+#define UFS_DATA_JORNAL_MAX (UFS_BLOCK_SIZE * (UFS_JORNAL_OP_MAX / 2)) // 单次经过日志的文件写入的最大字节数（涉及的区块需要放入同一个事务）
 typedef struct ufs_jornal_op_t {
     uint64_t bnum; // 目标写入区块块号
-    const void* buf; // 写入内容
+    const void* buf; // 写入内容（完整的区块）
+    uint16_t off; // 修改范围的起始偏移
+    uint16_t len; // 修改范围的长度（UFS_BLOCK_SIZE表示整个区块）
 } ufs_jornal_op_t;
+// 将[off, off + len)并入修改范围
+ul_hapi void ufs_jornal_op_widen(ufs_jornal_op_t* op, size_t off, size_t len) {
+    const size_t l = ufs_min(ul_static_cast(size_t, op->off), off);
+    const size_t r = ufs_max(ul_static_cast(size_t, op->off) + op->len, off + len);
+    op->off = ul_static_cast(uint16_t, l);
+    op->len = ul_static_cast(uint16_t, r - l);
+}
 
-UFS_HIDDEN int ufs_fix_jornal(ufs_vfs_t* ufs_restrict vfs, ufs_sb_t* ufs_restrict sb);
-UFS_HIDDEN int ufs_do_jornal(ufs_vfs_t* ufs_restrict vfs, const ufs_jornal_op_t* ufs_restrict ops, int num);
+/**
+ * 日志操作索引
+ *
+ * 以块号为键的开放寻址（线性探测）散列表，记录块号在ops中最后一次出现的下标，使按块号查找为O(1)。
+ * 索引不支持删除，ops被截断后需要重建。
+*/
+#define UFS_JORNAL_INDEX_SIZE 256 // 散列表槽数（必须为2的幂且不小于UFS_JORNAL_NUM的两倍）
+typedef struct ufs_jornal_index_t {
+    uint8_t slot[UFS_JORNAL_INDEX_SIZE]; // ops中的下标加1（0表示空槽）
+} ufs_jornal_index_t;
+UFS_HIDDEN void ufs_jornal_index_clear(ufs_jornal_index_t* index);
+// 查找块号在ops中的下标，不存在时返回-1
+UFS_HIDDEN int ufs_jornal_index_find(const ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, uint64_t bnum);
+// 将ops[i]加入索引（覆盖相同块号的旧下标）
+UFS_HIDDEN void ufs_jornal_index_set(ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, int i);
+UFS_HIDDEN void ufs_jornal_index_build(ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, int num);
 
 
 
+/**
+ * 组提交
+ *
+ * 多个线程同时调用ufs_jornal_sync时，只有一个线程（领导者）真正执行刷盘，其余线程（跟随者）等待该次刷盘完成。
+ * 领导者在刷盘前会短暂释放锁并让出时间片，让同时到达的提交加入本批次，直到不再有新的跟随者到达。
+ * 每次刷盘开始时批次号加1，线程进入ufs_jornal_sync时记录当前批次号，
+ * 若等待结束后已持久化的批次号不小于记录值，则说明其提交已被其他线程的刷盘覆盖，直接返回。
+ *
+ * 双缓冲
+ *
+ * 刷盘开始时待提交的操作被整体移入提交中的批次（此后不再修改），随后释放lock再进行写入和刷盘，
+ * 新的写入进入空的待提交批次，读取时依次查找待提交批次、提交中批次和磁盘，因此不会被刷盘阻塞。
+ * 日志区的状态（seq及环形日志区相关的成员）由ring_lock保护，持有ring_lock时可以再获取lock，反之则不行。
+ * 提交失败时提交中的批次保留，下一次刷盘时先重新提交。
+ *
+ * 公开事务
+ *
+ * 待提交的批次即为正在运行的事务：hold期间同步请求和后台检查点不再提交，快速提交也被推迟。
+ * 批次填满时不提交，而是移入堆上的held（按需增长），结束时与待提交的批次合并后
+ * 整体写为多条记录组成的提交，重放时全部生效或全部不生效；也可以整体丢弃。
+*/
+struct ufs_transcation_t;
 typedef struct ufs_jornal_t {
     ufs_vfs_t* vfs;
-    ufs_jornal_op_t ops[UFS_JORNAL_NUM];
+    ufs_jornal_op_t ops[UFS_JORNAL_NUM]; // 待提交的操作（块号互不相同）
     int num;
+    ufs_jornal_index_t index;
+    ufs_jornal_op_t cops[UFS_JORNAL_NUM]; // 提交中的操作（块号互不相同）
+    int cnum;
+    ufs_jornal_index_t cindex;
+    int committing; // 是否有线程正在提交（此时cops不可修改）
+    int hold; // 是否有未结束的公开事务
+    struct ufs_transcation_t* held; // 公开事务中从待提交的批次移出的操作（比待提交的批次旧，没有时为NULL）
+    const ufs_jornal_op_t* lops; // 正在提交的大事务（超过UFS_JORNAL_OP_MAX个操作，块号互不相同）
+    int lnum;
     ulatomic_spinlock_t lock;
+    ulatomic_spinlock_t ring_lock;
+    uint64_t seq; // 最后一次提交的序列号
+
+    uint64_t start; // 环形日志区起始块号
+    uint64_t size; // 环形日志区块数（其后一块为日志超级块）
+    uint64_t tail; // 最早的未检查点提交的位置
+    uint64_t used; // 已使用的块数（包括回绕时跳过的块）
+    int sb_slot; // 下一次写入的日志超级块副本
+    int stale; // 日志区中残留着写入失败的记录，下一次提交前需要先检查点
+    ulatomic32_t data_written; // 上一次提交之后是否有不经过日志直接写入的文件数据（提交之前需要先刷盘）
+    void* window; // 日志区中未检查点的目标块号
+    void* window_nodes;
+    uint64_t window_num;
+
+    ulatomic64_t batch; // 当前正在收集的批次号
+    ulatomic64_t durable; // 已持久化的最新批次号
+    int flushing; // 是否有领导者正在收集或刷盘
+    int waiters; // 正在等待的跟随者数量
+
+    int durability; // 持久化级别（UFS_DURABILITY_*，挂载完成后设置）
+    uint32_t sync_interval; // UFS_DURABILITY_PERIODIC的刷盘间隔（毫秒）
+    ulatomic64_t sync_last; // UFS_DURABILITY_PERIODIC上一次刷盘的时间
+
+    ufs_event_t ckpt_event; // 唤醒后台检查点
+    uint32_t ckpt_interval; // 后台检查点的时间间隔（毫秒）
+    uint32_t ckpt_threshold; // 唤醒后台检查点的日志使用率（百分比）
+    int ckpt_state; // 后台检查点状态
 } ufs_jornal_t;
 
 UFS_HIDDEN int ufs_jornal_init(ufs_jornal_t* ufs_restrict jornal, ufs_vfs_t* ufs_restrict vfs);
 UFS_HIDDEN void ufs_jornal_deinit(ufs_jornal_t* jornal);
+// 修复日志，并根据超级块设置日志区（threads为写回使用的线程数，恢复的统计信息写入stat）
+UFS_HIDDEN int ufs_fix_jornal(ufs_jornal_t* ufs_restrict jornal, const ufs_sb_t* ufs_restrict sb, int threads, ufs_mount_stat_t* ufs_restrict stat);
+// 格式化日志区（清空日志区并写入日志超级块）
+UFS_HIDDEN int ufs_format_jornal(ufs_jornal_t* jornal, uint64_t start, uint64_t size);
+UFS_HIDDEN int ufs_do_jornal(ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num);
 
-UFS_HIDDEN void ufs_jornal_merge(ufs_jornal_t* jornal);
 UFS_HIDDEN int ufs_jornal_read_block(ufs_jornal_t* ufs_restrict jornal, void* ufs_restrict buf, uint64_t bnum);
 UFS_HIDDEN int ufs_jornal_read(ufs_jornal_t* ufs_restrict jornal, void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len);
 UFS_HIDDEN int ufs_jornal_add(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag);
 UFS_HIDDEN int ufs_jornal_add_block(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, int flag);
+// 按持久化级别提交日志并刷盘（UFS_DURABILITY_PERIODIC时未到刷盘间隔则直接返回）
 UFS_HIDDEN int ufs_jornal_sync(ufs_jornal_t* jornal);
+// 立即提交日志并刷盘，不受持久化级别影响
+UFS_HIDDEN int ufs_jornal_flush(ufs_jornal_t* jornal);
+// 按持久化级别刷盘不经过日志直接写入的数据
+UFS_HIDDEN int ufs_jornal_sync_data(ufs_jornal_t* jornal);
+// 记录不经过日志直接写入了数据，下一次提交在写入提交记录之前先刷盘，使数据先于引用它的元数据持久化
+ul_hapi void ufs_jornal_data_written(ufs_jornal_t* jornal) {
+    ulatomic_store_explicit_32(&jornal->data_written, 1, ulatomic_memory_order_release);
+}
+// 设置持久化级别
+UFS_HIDDEN int ufs_jornal_set_durability(ufs_jornal_t* jornal, int durability, uint32_t sync_interval);
+// 加入事务的操作（块号互不相同，成功时转移区块的所有权）
+// 超过UFS_JORNAL_OP_MAX个时立即写为多条记录组成的提交，失败时区块仍归调用者所有，超过日志区大小时返回UFS_EOVERFLOW
 UFS_HIDDEN int ufs_jornal_append(ufs_jornal_t* ufs_restrict jornal, ufs_jornal_op_t* ufs_restrict ops, int num);
+// 开始公开事务（先提交之前的修改），已有事务时返回UFS_EAGAIN
+UFS_HIDDEN int ufs_jornal_hold(ufs_jornal_t* jornal);
+// 结束公开事务（discard非0时丢弃尚未提交的修改），之后由调用者刷盘
+// 超过一个批次的事务在此时整体写入日志，失败时事务保持未结束（可以再次丢弃），超过日志区大小时返回UFS_EOVERFLOW
+UFS_HIDDEN int ufs_jornal_unhold(ufs_jornal_t* jornal, int discard);
+// 将日志区中已提交的事务写回并推进尾部
+UFS_HIDDEN int ufs_jornal_checkpoint(ufs_jornal_t* jornal);
+// 区块将被重新分配，如果日志区中仍有其未检查点的旧内容，先进行检查点
+UFS_HIDDEN int ufs_jornal_reuse(ufs_jornal_t* jornal, uint64_t bnum);
+// 区块是否在日志中（待提交、提交中或日志区中未检查点）
+UFS_HIDDEN int ufs_jornal_tracks(ufs_jornal_t* jornal, uint64_t bnum);
+// 当前正在收集的批次号（在此之前加入日志的修改属于该批次或更早的批次）
+UFS_HIDDEN uint64_t ufs_jornal_batch(ufs_jornal_t* jornal);
+// 批次号为batch的批次是否已经持久化
+UFS_HIDDEN int ufs_jornal_durable(ufs_jornal_t* jornal, uint64_t batch);
+/**
+ * 快速提交
+ *
+ * 不提交待提交的批次，只将一个区块的修改范围作为单独的提交写入日志区并刷盘。
+ * 调用者需保证该修改已经加入待提交的批次（之后的完整提交不会用旧内容覆盖它），并且不依赖其他未持久化的修改。
+ * 有之前提交失败而保留的批次时，改为完整提交。
+*/
+UFS_HIDDEN int ufs_jornal_fast_commit(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len);
+
+/**
+ * 后台检查点
+ *
+ * 在线程池中常驻一个任务，每隔一段时间，或者待提交的日志/日志区的使用率超过阈值时，提交日志并进行检查点。
+ * 这样前台操作只有在日志真正写满时才需要同步等待刷盘。
+*/
+UFS_HIDDEN int ufs_jornal_start_checkpointer(ufs_jornal_t* ufs_restrict jornal, ufs_threadpool_t* ufs_restrict pool, uint32_t interval, uint32_t threshold);
+// 通知后台检查点退出（需要随后销毁线程池以等待其结束）
+UFS_HIDDEN void ufs_jornal_stop_checkpointer(ufs_jornal_t* jornal);
 
 
 
+/**
+ * 事务
+ *
+ * 事务中的操作块号互不相同，同一区块被多次修改时只保留最后一次的内容并合并修改范围。
+ * 操作数不超过UFS_JORNAL_OP_MAX时使用内嵌的数组和索引；超过后迁移到按倍数增长的堆上数组，
+ * 并改用同样在堆上的散列表，提交时整体写为多条记录组成的日志提交，保证大事务的原子性。
+ * 事务的大小只受日志区大小限制，超过时提交返回UFS_EOVERFLOW。
+*/
 typedef struct ufs_transcation_t {
     ufs_jornal_t* jornal;
-    ufs_jornal_op_t ops[UFS_JORNAL_NUM];
+    ufs_jornal_op_t* ops; // 事务中的操作（块号互不相同），指向local或堆上的数组
     int num;
+    int cap; // ops的容量
+    uint32_t* slot; // 堆上数组的散列表（ops中的下标加1，0表示空槽，槽数为cap的两倍），使用local时为NULL
+    ufs_jornal_index_t index; // 使用local时的索引
+    ufs_jornal_op_t local[UFS_JORNAL_OP_MAX];
 } ufs_transcation_t;
 
 UFS_HIDDEN int ufs_transcation_init(ufs_transcation_t* ufs_restrict transcation, ufs_jornal_t* ufs_restrict jornal);
 UFS_HIDDEN void ufs_transcation_deinit(ufs_transcation_t* transcation);
-#define UFS_JORNAL_ADD_MOVE 0 // 转移（自动使用ufs_free销毁）
+#define UFS_JORNAL_ADD_MOVE 0 // 转移（缓冲区必须来自ufs_block_alloc，自动使用ufs_block_free销毁）
 #define UFS_JORNAL_ADD_COPY 1 // 拷贝
 UFS_HIDDEN int ufs_transcation_add(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag);
 UFS_HIDDEN int ufs_transcation_add_block(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, int flag);
@@ -173,6 +377,12 @@ UFS_HIDDEN int ufs_transcation_read(ufs_transcation_t* ufs_restrict transcation,
 UFS_HIDDEN int ufs_transcation_commit(ufs_transcation_t* transcation, int num);
 UFS_HIDDEN int ufs_transcation_commit_all(ufs_transcation_t* transcation);
 UFS_HIDDEN void ufs_transcation_settop(ufs_transcation_t* transcation, int top);
+// 保证还能加入num个不同的区块，之后的ufs_transcation_put不会失败
+UFS_HIDDEN int ufs_transcation_reserve(ufs_transcation_t* transcation, int num);
+// 转移一个操作的区块并保留其修改范围（需要先预留位置）
+UFS_HIDDEN void ufs_transcation_put(ufs_transcation_t* ufs_restrict transcation, const ufs_jornal_op_t* ufs_restrict op);
+// 查找区块在事务中的内容，不存在时返回NULL（不读取日志，可以在持有日志的锁时调用）
+UFS_HIDDEN const void* ufs_transcation_lookup(const ufs_transcation_t* transcation, uint64_t bnum);
 
 
 
@@ -188,25 +398,97 @@ typedef struct _ufs_zlist_item_t {
 } _ufs_zlist_item_t;
 typedef struct _ufs_zlist_t {
     _ufs_zlist_item_t item[UFS_ZLIST_CACHE_LIST_LIMIT];
-    uint64_t block;
+    uint64_t block; // 空闲区块数（包括未使用过的区块）
+    uint64_t lazy; // 下一个未使用过的区块
     int top, stop;
 } _ufs_zlist_t;
+#define UFS_ZLIST_UNDO_MAX 16 // 撤销日志的最大长度
+typedef struct _ufs_zlist_undo_t {
+    uint64_t znum; // 压入或弹出的编号
+    int op; // 操作类型
+    int stop; // 操作前的stop
+} _ufs_zlist_undo_t;
+/**
+ * 空闲区块位图
+ *
+ * 格式化时选择UFS_ZALLOC_BITMAP后，空闲区块由位图（1表示已使用）而不是链表记录，
+ * 位图块位于区块区域的开头，其位置保存在原本链表头部所在的块中。
+ * 内存中保存整个位图及两级摘要（每个位图块和每组位图块中的空闲区块数），查找连续的空闲区块时先跳过已满的组和块，
+ * 块内按64位字（支持SSE2时一次比较4个字）跳过已满的部分，再按位统计连续的空闲区块。
+ * 加锁以来的分配和释放记录在撤销日志中，同步时只将改动过的字写入事务。
+*/
+#define UFS_ZBITMAP_BITS (UFS_BLOCK_SIZE * 8) // 每个位图块管理的区块数
+#define UFS_ZBITMAP_WORDS (UFS_BLOCK_SIZE / 8) // 每个位图块中的字数
+#define UFS_ZBITMAP_GROUP 64 // 二级摘要中每组的位图块数
+typedef struct _ufs_zbitmap_t {
+    uint64_t* map; // 位图（超出bits的位始终为1）
+    uint32_t* bfree; // 一级摘要：每个位图块中的空闲区块数
+    uint64_t* gfree; // 二级摘要：每组位图块中的空闲区块数
+    uint16_t* dlo; // 每个位图块中尚未同步的字的范围[dlo, dhi)
+    uint16_t* dhi;
+    uint64_t* dirty; // 尚未同步的位图块
+    uint64_t dnum;
+    uint64_t* undo; // 加锁以来分配（最高位为1）或释放的位
+    size_t unum, ucap;
+    uint64_t bnum; // 位图起始块号
+    uint64_t base; // 第0位对应的区块号
+    uint64_t bits; // 管理的区块数
+    uint64_t blocks; // 位图块数
+    uint64_t free; // 空闲区块数
+    uint64_t hint; // 下一次分配开始查找的位置
+} _ufs_zbitmap_t;
+// 在区块[start, start + size)上创建位图（开头的部分用于保存位图），描述写入desc块，期间会多次提交事务
+UFS_HIDDEN int ufs_zbitmap_create(_ufs_zbitmap_t** ufs_restrict pbm, ufs_transcation_t* ufs_restrict transcation, uint64_t desc, uint64_t start, uint64_t size);
+// 根据desc块中的描述读入位图
+UFS_HIDDEN int ufs_zbitmap_load(_ufs_zbitmap_t** ufs_restrict pbm, ufs_transcation_t* ufs_restrict transcation, uint64_t desc);
+UFS_HIDDEN void ufs_zbitmap_destroy(_ufs_zbitmap_t* bm);
+// 丢弃内存中的修改，从日志/磁盘重新读入位图
+UFS_HIDDEN int ufs_zbitmap_reload(_ufs_zbitmap_t* ufs_restrict bm, ufs_transcation_t* ufs_restrict transcation);
+// 查找第一段至少n个连续的空闲区块（从第from位开始，到末尾后从头查找），返回其起始位，不存在时返回UFS_ENOSPC
+UFS_HIDDEN int ufs_zbitmap_find(const _ufs_zbitmap_t* ufs_restrict bm, uint64_t from, uint64_t n, uint64_t* ufs_restrict ppos);
+// 从第pos位开始连续的空闲区块数（至多n个）
+UFS_HIDDEN uint64_t ufs_zbitmap_run(const _ufs_zbitmap_t* bm, uint64_t pos, uint64_t n);
+// 标记区块为已使用/空闲（状态不符时返回UFS_EINVAL）
+UFS_HIDDEN int ufs_zbitmap_alloc(_ufs_zbitmap_t* bm, uint64_t pos);
+UFS_HIDDEN int ufs_zbitmap_free(_ufs_zbitmap_t* bm, uint64_t pos);
+// 撤销加锁以来的分配和释放
+UFS_HIDDEN void ufs_zbitmap_rollback(_ufs_zbitmap_t* bm);
+// 将改动过的字写入事务
+UFS_HIDDEN int ufs_zbitmap_sync(_ufs_zbitmap_t* ufs_restrict bm, ufs_transcation_t* ufs_restrict transcation);
+UFS_HIDDEN void ufs_zbitmap_debug(const _ufs_zbitmap_t* bm, FILE* fp);
+
 typedef struct ufs_zlist_t {
-    _ufs_zlist_t now, backup;
+    _ufs_zlist_t now;
+    _ufs_zlist_t backup; // 整体快照，只有在撤销日志无法描述的操作（重新读入或写回缓存）之前才写入
+    _ufs_zlist_undo_t undo[UFS_ZLIST_UNDO_MAX]; // 加锁以来的压入/弹出，回滚时逆序撤销
+    int undo_num;
+    int undo_snap; // backup中是否保存了快照（此后的操作不再记录）
+    _ufs_zbitmap_t* bitmap; // 不为NULL时空闲区块由位图管理（链表的成员中只使用now.block）
+    uint64_t lazy_end; // 未使用过的区块的末尾（0表示不延迟构建）
+    int range; // 栈中的一项是否可以记录一段连续的区块（UFS_SB_EXT_ZRANGE）
     uint64_t bnum;
     ufs_transcation_t* transcation;
     ulatomic_flag_t lock;
 } ufs_zlist_t;
 
-UFS_HIDDEN int ufs_zlist_init(ufs_zlist_t* zlist, uint64_t start, uint64_t block);
+UFS_HIDDEN int ufs_zlist_init(ufs_zlist_t* zlist, uint64_t start, uint64_t block, uint64_t lazy, uint64_t lazy_end);
+UFS_HIDDEN int ufs_zlist_init_bitmap(ufs_zlist_t* zlist, uint64_t start);
 UFS_HIDDEN int ufs_zlist_create_empty(ufs_zlist_t* zlist, uint64_t start);
+// 创建空闲区块为[lazy, lazy_end)的zlist（不写入任何链表节点）
+UFS_HIDDEN int ufs_zlist_create_lazy(ufs_zlist_t* zlist, uint64_t start, uint64_t lazy, uint64_t lazy_end);
+// 创建管理区块[zstart, zstart + zsize)的位图（需要持有锁，期间会多次提交事务）
+UFS_HIDDEN int ufs_zlist_create_bitmap(ufs_zlist_t* zlist, uint64_t start, uint64_t zstart, uint64_t zsize);
 UFS_HIDDEN void ufs_zlist_deinit(ufs_zlist_t* zlist);
-ul_hapi void ufs_zlist_backup(ufs_zlist_t* zlist) { zlist->backup = zlist->now; }
-ul_hapi void ufs_zlist_rollback(ufs_zlist_t* zlist) { zlist->now = zlist->backup; }
+// 丢弃内存中的缓存，从日志/磁盘重新读取（需要持有锁）
+UFS_HIDDEN int ufs_zlist_reload(ufs_zlist_t* zlist, uint64_t block, uint64_t lazy);
+// 撤销加锁以来的所有修改
+UFS_HIDDEN void ufs_zlist_rollback(ufs_zlist_t* zlist);
 ul_hapi void ufs_zlist_lock(ufs_zlist_t* ufs_restrict zlist, ufs_transcation_t* ufs_restrict transcation) {
     ulatomic_spinlock_lock(&zlist->lock);
     zlist->transcation = transcation;
-    ufs_zlist_backup(zlist);
+    zlist->undo_num = 0;
+    zlist->undo_snap = 0;
+    if(zlist->bitmap) zlist->bitmap->unum = 0;
 }
 ul_hapi void ufs_zlist_unlock(ufs_zlist_t* zlist) {
     zlist->transcation = NULL;
@@ -214,10 +496,101 @@ ul_hapi void ufs_zlist_unlock(ufs_zlist_t* zlist) {
 }
 UFS_HIDDEN int ufs_zlist_sync(ufs_zlist_t* zlist);
 UFS_HIDDEN int ufs_zlist_pop(ufs_zlist_t* ufs_restrict zlist, uint64_t* ufs_restrict pznum);
+/**
+ * 弹出一段连续的区块[*pstart, *pstart + *plen)，1 <= *plen <= n
+ *
+ * 位图中优先查找从goal开始（goal为0时从上一次分配的位置开始）的第一段足够长的空闲区块，不存在时取goal之后第一段空闲区块；
+ * 链表中只取栈顶恰好连续的部分（栈顶的一项记录了一段区块时从其开头取出）。
+ * 不调用ufs_jornal_reuse，作为数据块直接写入的调用者需要在解锁之后调用。
+ * 错误：
+ *   UFS_EINVAL：n为0
+ *   UFS_ENOSPC：没有空闲区块
+*/
+UFS_HIDDEN int ufs_zlist_pop_extent(ufs_zlist_t* ufs_restrict zlist, uint64_t goal, uint64_t n,
+    uint64_t* ufs_restrict pstart, uint64_t* ufs_restrict plen);
 UFS_HIDDEN int ufs_zlist_push(ufs_zlist_t* zlist, uint64_t znum);
+/**
+ * 压入一段连续的区块[znum, znum + len)
+ *
+ * 支持UFS_SB_EXT_ZRANGE时栈中的一项记录至多65536个连续的区块，与栈顶相邻的区块（包括单个压入的）直接合并到栈顶的一项中；
+ * 否则逐个压入。
+ * 错误：
+ *   UFS_EINVAL：len为0
+*/
+UFS_HIDDEN int ufs_zlist_push_range(ufs_zlist_t* zlist, uint64_t znum, uint64_t len);
+// 由key散列得到区块区域中的一个位置，作为分配的目标（只有位图能按位置分配，使用链表时返回0）
+UFS_HIDDEN uint64_t ufs_zlist_goal(const ufs_zlist_t* zlist, uint64_t key);
 UFS_HIDDEN void ufs_zlist_debug(const ufs_zlist_t* zlist, FILE* fp);
 
 
+/**
+ * 区块缓存
+ *
+ * 线程按ufs_thread_id散列到UFS_ZCACHE_SLOTS个槽中，每个槽从zlist预留一批区块，
+ * 单个区块的分配和释放只需要加锁所在的槽，只有槽为空或已满时才加锁zlist。
+ * 槽中的区块保存在各自的记录块中，随使用它们的事务一起提交；预留和归还在单独的事务中与zlist一同提交。
+ * 因此在磁盘上每个区块要么在zlist中，要么在某个槽的记录中，要么已被使用，崩溃不会丢失区块。
+ * 记录块的位置保存在ilist头部所在块中未使用的inode位置（UFS_INUM_ZCACHE），只有设置了UFS_SB_EXT_ZCACHE的磁盘才读写该位置。
+ * 挂载时先将记录中遗留的区块和记录块归还zlist，再重新分配记录块；卸载时全部归还。
+*/
+#define UFS_INUM_ZCACHE (UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK + 1)
+#define UFS_ZCACHE_SLOTS 16
+#define UFS_ZCACHE_CAP ((UFS_BLOCK_SIZE - 8) / 8) // 每个槽最多缓存的区块数
+#define UFS_ZCACHE_LOW 8 // 加锁时少于该数量则从zlist预留
+#define UFS_ZCACHE_FILL 32 // 预留或归还后的数量
+#define UFS_ZCACHE_HIGH 96 // 加锁时多于该数量则归还zlist
+#define UFS_ZCACHE_WINDOW 64 // 按目标分配时，槽中位于目标之后多远以内的区块可以直接使用
+#define UFS_ZCACHE_RUN 16 // 按目标从位图分配时一次取出的区块数
+typedef struct _ufs_zcache_slot_t {
+    uint64_t zones[UFS_ZCACHE_CAP]; // 栈顶优先分配
+    uint64_t saved[UFS_ZCACHE_CAP]; // 加锁以来被覆盖的区块，saved[saved_from, lnum)有效
+    uint64_t bnum; // 记录块号
+    int num;
+    int lnum; // 加锁时的num
+    int saved_from;
+    int global; // 是否持有zlist的锁
+    unsigned victims; // 本槽耗尽且zlist也为空时，借用的其他槽
+    ufs_transcation_t* transcation;
+    ulatomic_spinlock_t lock;
+} _ufs_zcache_slot_t;
+typedef struct ufs_zcache_t {
+    _ufs_zcache_slot_t* slots; // NULL表示未启用，直接使用zlist
+    ufs_zlist_t* zlist;
+    ufs_jornal_t* jornal;
+    ulatomic64_t cached; // 所有槽中的区块总数
+} ufs_zcache_t;
+
+// 归还上次遗留的区块并分配记录块（enabled为0或区块不足时不启用缓存，不读写目录）
+UFS_HIDDEN int ufs_zcache_init(ufs_zcache_t* ufs_restrict zcache, ufs_zlist_t* ufs_restrict zlist, ufs_jornal_t* ufs_restrict jornal, int enabled);
+// 将所有区块和记录块归还zlist
+UFS_HIDDEN int ufs_zcache_release(ufs_zcache_t* zcache);
+UFS_HIDDEN void ufs_zcache_deinit(ufs_zcache_t* zcache);
+// 丢弃内存中的修改，从日志/磁盘重新读取记录
+UFS_HIDDEN int ufs_zcache_reload(ufs_zcache_t* zcache);
+// 以下函数的用法与ufs_zlist_*相同，加锁的是当前线程对应的槽（必要时补充或归还一批区块）
+UFS_HIDDEN void ufs_zcache_lock(ufs_zcache_t* ufs_restrict zcache, ufs_transcation_t* ufs_restrict transcation);
+UFS_HIDDEN void ufs_zcache_unlock(ufs_zcache_t* zcache);
+/**
+ * 分配一个区块，尽量选择位于goal或之后的区块（goal为0时不限制位置）
+ *
+ * 先在槽中查找goal之后UFS_ZCACHE_WINDOW以内最近的区块，
+ * 再从zlist中取出一段区块（多余的放入槽中；使用位图时从goal处取出，否则取出栈顶的一段）；
+ * goal为0时取槽中最长一段连续区块的中点。
+*/
+UFS_HIDDEN int ufs_zcache_pop(ufs_zcache_t* ufs_restrict zcache, uint64_t goal, uint64_t* ufs_restrict pznum);
+// 连续的区块总是直接从zlist中分配
+UFS_HIDDEN int ufs_zcache_pop_extent(ufs_zcache_t* ufs_restrict zcache, uint64_t goal, uint64_t n,
+    uint64_t* ufs_restrict pstart, uint64_t* ufs_restrict plen);
+UFS_HIDDEN int ufs_zcache_push(ufs_zcache_t* zcache, uint64_t znum);
+// 连续的多个区块总是直接归还zlist
+UFS_HIDDEN int ufs_zcache_push_range(ufs_zcache_t* zcache, uint64_t znum, uint64_t len);
+UFS_HIDDEN int ufs_zcache_sync(ufs_zcache_t* zcache);
+UFS_HIDDEN void ufs_zcache_rollback(ufs_zcache_t* zcache);
+// 所有槽中的区块数（统计空闲区块时需要计入）
+UFS_HIDDEN uint64_t ufs_zcache_cached(ufs_zcache_t* zcache);
+UFS_HIDDEN void ufs_zcache_debug(const ufs_zcache_t* zcache, FILE* fp);
+
+
 
 #define UFS_ILIST_ENTRY_NUM_MAX (UFS_BLOCK_SIZE / UFS_INODE_PER_BLOCK / 8 - 1)
 #define UFS_ILIST_CACHE_LIST_LIMIT (32)
@@ -231,24 +604,41 @@ typedef struct _ufs_ilist_item_t {
 } _ufs_ilist_item_t;
 typedef struct _ufs_ilist_t {
     _ufs_ilist_item_t item[UFS_ILIST_CACHE_LIST_LIMIT];
-    uint64_t block;
+    uint64_t block; // 空闲inode数（包括未使用过的inode）
+    uint64_t lazy; // 下一个未使用过的inode
     int top, stop;
 } _ufs_ilist_t;
+#define UFS_ILIST_UNDO_MAX 16 // 撤销日志的最大长度
+typedef struct _ufs_ilist_undo_t {
+    uint64_t inum; // 压入或弹出的编号
+    int op; // 操作类型
+    int stop; // 操作前的stop
+} _ufs_ilist_undo_t;
 typedef struct ufs_ilist_t {
-    _ufs_ilist_t now, backup;
+    _ufs_ilist_t now;
+    _ufs_ilist_t backup; // 整体快照，只有在撤销日志无法描述的操作（重新读入或写回缓存）之前才写入
+    _ufs_ilist_undo_t undo[UFS_ILIST_UNDO_MAX]; // 加锁以来的压入/弹出，回滚时逆序撤销
+    int undo_num;
+    int undo_snap; // backup中是否保存了快照（此后的操作不再记录）
+    uint64_t lazy_end; // 未使用过的inode的末尾（0表示不延迟构建）
     uint64_t bnum;
     ufs_transcation_t* transcation;
     ulatomic_flag_t lock;
 } ufs_ilist_t;
-UFS_HIDDEN int ufs_ilist_init(ufs_ilist_t* ilist, uint64_t start, uint64_t block);
+UFS_HIDDEN int ufs_ilist_init(ufs_ilist_t* ilist, uint64_t start, uint64_t block, uint64_t lazy, uint64_t lazy_end);
 UFS_HIDDEN int ufs_ilist_create_empty(ufs_ilist_t* ilist, uint64_t start);
+// 创建空闲inode为[lazy, lazy_end)的ilist（不写入任何链表节点）
+UFS_HIDDEN int ufs_ilist_create_lazy(ufs_ilist_t* ilist, uint64_t start, uint64_t lazy, uint64_t lazy_end);
 UFS_HIDDEN void ufs_ilist_deinit(ufs_ilist_t* ilist);
-ul_hapi void ufs_ilist_backup(ufs_ilist_t* ilist) { ilist->backup = ilist->now; }
-ul_hapi void ufs_ilist_rollback(ufs_ilist_t* ilist) { ilist->now = ilist->backup; }
+// 丢弃内存中的缓存，从日志/磁盘重新读取（需要持有锁）
+UFS_HIDDEN int ufs_ilist_reload(ufs_ilist_t* ilist, uint64_t block, uint64_t lazy);
+// 撤销加锁以来的所有修改
+UFS_HIDDEN void ufs_ilist_rollback(ufs_ilist_t* ilist);
 ul_hapi void ufs_ilist_lock(ufs_ilist_t* ufs_restrict ilist, ufs_transcation_t* ufs_restrict transcation) {
     ulatomic_spinlock_lock(&ilist->lock);
     ilist->transcation = transcation;
-    ufs_ilist_backup(ilist);
+    ilist->undo_num = 0;
+    ilist->undo_snap = 0;
 }
 ul_hapi void ufs_ilist_unlock(ufs_ilist_t* ilist) {
     ilist->transcation = NULL;
@@ -265,20 +655,37 @@ UFS_HIDDEN void ufs_ilist_debug(const ufs_ilist_t* ilist, FILE* fp);
  * 基于块的文件操作
  *
  * 此处的文件操作依然处于相当原始的状态，很多操作在外部是不被允许的，以避免破坏文件系统。
+ *
+ * 延迟分配（ufs->delay_alloc）：普通文件不经过事务的写入落在未分配的块上时，内容先保存在minode中，
+ * 写回时按块号排序，连续的块一次分配连续的区块，只同步一次zlist；写回之前被截断的块不消耗区块。
+ * 写回发生在缓冲区已满、同步、关闭、截断、预分配以及开始公开事务时。
+ * 空闲区块不足以为所有延迟的块预留时退回立即分配；写回失败的块保留在缓冲区中，由之后的写回重试。
 */
+#define UFS_DELAY_MAX 32 // 每个文件最多延迟分配的块数
+#define UFS_DELAY_RESERVE 4 // 每个延迟分配的块预留的区块数（数据块及最多三级间接块）
+#define UFS_DELAY_MARGIN 64 // 延迟分配之外始终保留的区块数
 typedef struct ufs_minode_t {
     ufs_inode_t inode;
     ufs_t* ufs;
     uint64_t inum;
 
+    ufs_inode_t fc_base; // 最近一次持久化的inode（快速提交只写入与它相比变化的大小和时间）
+    uint64_t fc_batch; // 分配或释放区块等快速提交无法记录的修改所在的批次（持久化之前只能完整提交）
+
+    uint64_t delay_block[UFS_DELAY_MAX]; // 延迟分配的块号（升序）
+    char* delay_data[UFS_DELAY_MAX]; // 延迟分配的块内容（来自ufs_block_alloc）
+    uint32_t delay_num;
+
     ulatomic_spinlock_t lock;
-    uint32_t share;
+    uint32_t share; // 打开的次数（由文件集合的锁保护）
 } ufs_minode_t;
 
 UFS_HIDDEN int _write_inode_direct(ufs_jornal_t* jornal, ufs_inode_t* inode, uint64_t inum);
 
 UFS_HIDDEN int ufs_minode_init(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_restrict inode, uint64_t inum);
 UFS_HIDDEN int ufs_minode_deinit(ufs_minode_t* inode);
+// 丢弃内存中的修改，从日志/磁盘重新读取inode（需要持有锁）
+UFS_HIDDEN int ufs_minode_reload(ufs_minode_t* inode);
 typedef struct ufs_inode_create_t {
     int32_t uid;
     int32_t gid;
@@ -295,6 +702,8 @@ UFS_HIDDEN int ufs_minode_pwrite(
 );
 UFS_HIDDEN int ufs_minode_sync_meta(ufs_minode_t* inode);
 UFS_HIDDEN int ufs_minode_sync(ufs_minode_t* inode, int only_data);
+// 为延迟分配的块分配区块并写入（需要持有锁）
+UFS_HIDDEN int ufs_minode_flush(ufs_minode_t* inode);
 UFS_HIDDEN int ufs_minode_fallocate(ufs_minode_t* inode, uint64_t block_start, uint64_t block_end);
 UFS_HIDDEN int ufs_minode_shrink(ufs_minode_t* inode, uint64_t block);
 UFS_HIDDEN int ufs_minode_resize(ufs_minode_t* inode, uint64_t size);
@@ -319,6 +728,42 @@ UFS_HIDDEN int ufs_fileset_creat(
 );
 UFS_HIDDEN int ufs_fileset_close(ufs_fileset_t* fs, uint64_t inum);
 UFS_HIDDEN void ufs_fileset_sync(ufs_fileset_t* fs);
+// 写回所有已打开文件中延迟分配的块
+UFS_HIDDEN int ufs_fileset_flush(ufs_fileset_t* fs);
+// 重新读取所有已打开文件的inode
+UFS_HIDDEN int ufs_fileset_reload(ufs_fileset_t* fs);
+
+
+
+/**
+ * 孤儿inode
+ *
+ * 链接数为0的文件在最后一次关闭时先加入磁盘上的孤儿链表，再释放区块。
+ * 启动后台回收时关闭立即返回，回收线程从链表头开始分批释放（每批最多batch个块，批次之间间隔interval毫秒），
+ * 每一批单独提交，全部释放后在同一个事务中将inode移出链表并归还ilist；否则仍由关闭的线程一次释放。
+ * 链表头保存在ilist头部所在块中未使用的inode位置（UFS_INUM_ORPHAN），链表通过inode的orphan字段串联，
+ * 因此崩溃后挂载时可以从链表中剩余的inode继续回收。没有UFS_SB_EXT_ORPHAN的磁盘不使用孤儿链表。
+*/
+#define UFS_INUM_ORPHAN (UFS_BNUM_ILIST * UFS_INODE_PER_BLOCK + 3)
+#define UFS_ORPHAN_OFFSET ((UFS_INUM_ORPHAN % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE)
+typedef struct ufs_orphan_t {
+    uint64_t head; // 链表头（0表示链表为空）
+    int enabled; // 是否使用孤儿链表
+    int state; // 后台回收状态
+    uint32_t batch; // 每批最多释放的块数
+    uint32_t interval; // 批次之间的间隔（毫秒）
+    ufs_event_t event; // 唤醒后台回收
+    ulatomic_spinlock_t lock;
+} ufs_orphan_t;
+// 读取孤儿链表头（没有UFS_SB_EXT_ORPHAN时不使用孤儿链表）
+UFS_HIDDEN int ufs_orphan_init(ufs_t* ufs);
+// 从日志/磁盘重新读取孤儿链表头
+UFS_HIDDEN int ufs_orphan_reload(ufs_t* ufs);
+// 在调用线程中回收孤儿链表中的所有inode
+UFS_HIDDEN int ufs_orphan_reclaim_all(ufs_t* ufs);
+UFS_HIDDEN int ufs_orphan_start_reclaimer(ufs_t* ufs_restrict ufs, ufs_threadpool_t* ufs_restrict pool, uint32_t batch, uint32_t interval);
+// 请求后台回收在当前一批结束后退出（剩余的inode留在孤儿链表中，下次挂载时继续回收）
+UFS_HIDDEN void ufs_orphan_stop_reclaimer(ufs_t* ufs);
 
 
 
@@ -326,13 +771,33 @@ UFS_HIDDEN void ufs_file_debug(const ufs_file_t* file, FILE* fp);
 
 
 
+#define UFS_TXN_NONE   0 // 不处于公开事务中，日志中没有事务写入的文件数据
+#define UFS_TXN_ACTIVE 1 // 处于公开事务中（文件写入全部经过日志，中止时可以撤销）
+#define UFS_TXN_DONE   2 // 公开事务已结束但检查点尚未完成（日志中可能还有文件数据，读取和覆盖写入需要经过日志）
+// 开始修改操作：其他上下文的公开事务期间等待事务结束（单线程模式下返回UFS_EAGAIN）
+UFS_HIDDEN int ufs_txn_enter(ufs_t* ufs, const ufs_context_t* context);
+// 结束由ufs_txn_enter开始的修改操作
+UFS_HIDDEN void ufs_txn_leave(ufs_t* ufs, const ufs_context_t* context);
 struct ufs_t {
     ufs_sb_t sb;
     ufs_vfs_t* vfs;
     ufs_jornal_t jornal;
     ufs_zlist_t zlist;
+    ufs_zcache_t zcache;
     ufs_ilist_t ilist;
     ufs_fileset_t fileset;
+    ufs_orphan_t orphan;
+    ufs_threadpool_t pool;
+    uint32_t data_jornal; // 不超过该字节数的文件写入经过日志（0表示文件数据总是直接写入）
+    int fast_commit; // 是否启用快速提交
+    int delay_alloc; // 是否启用延迟分配
+    ulatomic64_t delayed; // 所有文件中延迟分配的块数
+    ulatomic32_t txn; // 公开事务的状态（UFS_TXN_*）
+    ulatomic_spinlock_t txn_lock; // 保护txn_owner和txn_ops
+    const ufs_context_t* txn_owner; // 公开事务所属的上下文（NULL表示没有事务）
+    uint32_t txn_ops; // 正在进行的不属于公开事务的修改操作数
+    ufs_event_t txn_event; // 公开事务结束或修改操作全部完成时触发
+    ufs_mount_stat_t mstat; // 挂载统计信息
 };
 
 
@@ -1,9 +1,566 @@
 #include "libufs_internel.h"
+#include "ulrb.h"
 
 static int _istrue(uint8_t v) {
     return ufs_popcount(v) > 1;
 }
 
+/**
+ * 提交记录（位于环形日志区，其后紧跟blocks个日志块）
+ *
+ * 校验和覆盖提交记录中seq之后的内容以及所有日志块，只有魔数和校验和均正确时，才认为记录完整。
+ * 因此日志块和提交记录可以在同一次刷盘中写入，写入不完整的提交会在重放时被发现并丢弃。
+ *
+ * 目标块号的最高位表示增量记录。日志块中先按顺序存放完整区块，
+ * 随后紧凑排列所有增量记录（2字节偏移、2字节长度以及修改的字节），最后一块不足的部分填0。
+ *
+ * 超过单条记录容量的事务拆分为多条连续的记录，除第一条外都带有_JORNAL_COMMIT_CONT，除最后一条外都带有_JORNAL_COMMIT_MORE。
+ * 所有记录写入并刷盘后才写回原位置，重放时只有读到最后一条记录才应用整组记录，否则丢弃整组。
+*/
+#define _JORNAL_MAGIC 0x4A534655u // "UFSJ"
+#define _JORNAL_DELTA_FLAG (UINT64_C(1) << 63) // 增量记录标记
+#define _JORNAL_DELTA_HEAD 4 // 增量记录头的长度
+#define _JORNAL_DELTA_MAX (UFS_BLOCK_SIZE / 2) // 修改范围不超过该长度时使用增量记录（保证日志块数不超过区块数）
+#define _JORNAL_COMMIT_MORE 1u // 同一事务后面还有记录
+#define _JORNAL_COMMIT_CONT 2u // 接续前一条记录的事务
+typedef struct _jornal_commit_t {
+    uint32_t magic; // 魔数
+    uint32_t crc; // CRC32C校验和
+    uint64_t seq; // 序列号
+    uint16_t num; // 区块数
+    uint16_t blocks; // 日志块数（为0时与区块数相同）
+    uint32_t flags; // _JORNAL_COMMIT_*
+    uint64_t bnum[UFS_JORNAL_NUM]; // 区块对应的目标块号
+} _jornal_commit_t;
+#define _jornal_commit_crc_off offsetof(_jornal_commit_t, seq)
+
+static uint32_t _commit_crc(const _jornal_commit_t* commit) {
+    return ufs_crc32c(0, ul_reinterpret_cast(const char*, commit) + _jornal_commit_crc_off, sizeof(*commit) - _jornal_commit_crc_off);
+}
+static void _make_commit(_jornal_commit_t* commit, uint64_t seq, int num, int blocks, uint32_t flags) {
+    memset(commit, 0, sizeof(*commit));
+    commit->magic = ul_trans_u32_le(_JORNAL_MAGIC);
+    commit->seq = ul_trans_u64_le(seq);
+    commit->num = ul_trans_u16_le(ul_static_cast(uint16_t, num));
+    commit->blocks = ul_trans_u16_le(ul_static_cast(uint16_t, blocks));
+    commit->flags = ul_trans_u32_le(flags);
+}
+static int _op_is_delta(const ufs_jornal_op_t* op) {
+    return op->len <= _JORNAL_DELTA_MAX;
+}
+static void _put_u16(char* p, size_t v) {
+    const uint16_t x = ul_trans_u16_le(ul_static_cast(uint16_t, v));
+    memcpy(p, &x, 2);
+}
+static size_t _get_u16(const char* p) {
+    uint16_t x;
+    memcpy(&x, p, 2);
+    return ul_trans_u16_le(x);
+}
+/**
+ * 日志恢复
+ *
+ * 挂载时一次顺序读取整个环形日志区，从尾部开始解析校验通过的提交，只收集其中的区块而不立即写回。
+ * 收集完成后按块号（相同块号按提交顺序）排序，每个区块只写回最终内容：
+ * 以最后一个完整区块为基础依次应用其后的增量记录，没有完整区块时依次写入各增量记录的修改范围。
+ * 块号连续的完整区块合并为一次聚集写入，并可以按块号范围分给多个线程并行写回。
+*/
+typedef struct _replay_op_t {
+    uint64_t bnum;
+    const char* data; // 完整区块或增量记录的内容（指向读入的日志区）
+    size_t order; // 收集的顺序
+    uint16_t off;
+    uint16_t len; // UFS_BLOCK_SIZE表示完整区块
+} _replay_op_t;
+typedef struct _replay_t {
+    _replay_op_t* ops;
+    size_t num;
+    size_t cap;
+} _replay_t;
+static int _replay_push(_replay_t* ufs_restrict replay, uint64_t bnum, const char* ufs_restrict data, size_t off, size_t len) {
+    _replay_op_t* op;
+    if(replay->num == replay->cap) {
+        const size_t cap = replay->cap ? replay->cap * 2 : UFS_JORNAL_NUM;
+        op = ul_reinterpret_cast(_replay_op_t*, ufs_realloc(replay->ops, cap * sizeof(_replay_op_t)));
+        if(ufs_unlikely(op == NULL)) return UFS_ENOMEM;
+        replay->ops = op;
+        replay->cap = cap;
+    }
+    op = replay->ops + replay->num;
+    op->bnum = bnum;
+    op->data = data;
+    op->order = replay->num++;
+    op->off = ul_static_cast(uint16_t, off);
+    op->len = ul_static_cast(uint16_t, len);
+    return 0;
+}
+
+// 解析提交中的区块，replay不为NULL时收集区块；提交格式错误时返回1
+static int _apply_commit(_replay_t* ufs_restrict replay, const _jornal_commit_t* ufs_restrict commit, const char* ufs_restrict buf, int blocks) {
+    int ec, i, j;
+    const int num = ul_trans_u16_le(commit->num);
+    const size_t end = ul_static_cast(size_t, blocks) * UFS_BLOCK_SIZE;
+    size_t p, off, len;
+    uint64_t bnum;
+
+    for(i = 0, j = 0; i < num; ++i)
+        if(!(ul_trans_u64_le(commit->bnum[i]) & _JORNAL_DELTA_FLAG)) ++j;
+    if(j > blocks) return 1;
+    p = ul_static_cast(size_t, j) * UFS_BLOCK_SIZE;
+    for(i = 0, j = 0; i < num; ++i) {
+        bnum = ul_trans_u64_le(commit->bnum[i]);
+        if(bnum & _JORNAL_DELTA_FLAG) {
+            if(p + _JORNAL_DELTA_HEAD > end) return 1;
+            off = _get_u16(buf + p);
+            len = _get_u16(buf + p + 2);
+            p += _JORNAL_DELTA_HEAD;
+            if(off + len > UFS_BLOCK_SIZE || p + len > end) return 1;
+            if(replay) {
+                ec = _replay_push(replay, bnum & ~_JORNAL_DELTA_FLAG, buf + p, off, len);
+                if(ufs_unlikely(ec)) return ec;
+            }
+            p += len;
+        } else {
+            if(replay) {
+                ec = _replay_push(replay, bnum, buf + ul_static_cast(size_t, j) * UFS_BLOCK_SIZE, 0, UFS_BLOCK_SIZE);
+                if(ufs_unlikely(ec)) return ec;
+            }
+            ++j;
+        }
+    }
+    return 0;
+}
+
+static int _replay_compare(const void* lhs, const void* rhs) {
+    const _replay_op_t* l = ul_reinterpret_cast(const _replay_op_t*, lhs);
+    const _replay_op_t* r = ul_reinterpret_cast(const _replay_op_t*, rhs);
+    if(l->bnum != r->bnum) return l->bnum < r->bnum ? -1 : 1;
+    return l->order < r->order ? -1 : (l->order > r->order);
+}
+#define _REPLAY_RUN_MAX 64 // 单次聚集写入的最大区块数
+#define _REPLAY_THREAD_MAX 16 // 写回的最大线程数
+// 写回一段已排序的区块（由若干完整的块号分组组成）
+static int _replay_write(ufs_vfs_t* ufs_restrict vfs, const _replay_op_t* ufs_restrict ops, size_t num) {
+    ufs_iovec_t iov[_REPLAY_RUN_MAX];
+    char* owned[_REPLAY_RUN_MAX]; // 合并了增量记录的区块需要释放
+    int i, run = 0, ec = 0;
+    uint64_t run_bnum = 0;
+    size_t b, e, k, full;
+    char* img;
+
+    for(b = 0; b < num; b = e) {
+        // [b, e)为同一区块，full为其中最后一个完整区块
+        full = num;
+        for(e = b; e < num && ops[e].bnum == ops[b].bnum; ++e)
+            if(ops[e].len == UFS_BLOCK_SIZE) full = e;
+        if(full == num) {
+            for(k = b; k < e; ++k) {
+                ec = ufs_vfs_pwrite_check(vfs, ops[k].data, ops[k].len, ufs_vfs_offset2(ops[k].bnum, ops[k].off));
+                if(ufs_unlikely(ec)) goto do_return;
+            }
+            continue;
+        }
+        img = NULL;
+        if(full + 1 != e) {
+            img = ul_reinterpret_cast(char*, ufs_block_alloc());
+            if(ufs_unlikely(img == NULL)) { ec = UFS_ENOMEM; goto do_return; }
+            memcpy(img, ops[full].data, UFS_BLOCK_SIZE);
+            for(k = full + 1; k < e; ++k) memcpy(img + ops[k].off, ops[k].data, ops[k].len);
+        }
+        if(run == _REPLAY_RUN_MAX || (run && ops[b].bnum != run_bnum + ul_static_cast(uint64_t, run))) {
+            ec = ufs_vfs_pwritev_check(vfs, iov, run, ufs_vfs_offset(run_bnum));
+            for(i = 0; i < run; ++i) ufs_block_free(owned[i]);
+            run = 0;
+            if(ufs_unlikely(ec)) { ufs_block_free(img); goto do_return; }
+        }
+        if(run == 0) run_bnum = ops[b].bnum;
+        iov[run].base = img ? img : ops[full].data;
+        iov[run].len = UFS_BLOCK_SIZE;
+        owned[run++] = img;
+    }
+    if(run) ec = ufs_vfs_pwritev_check(vfs, iov, run, ufs_vfs_offset(run_bnum));
+
+do_return:
+    for(i = 0; i < run; ++i) ufs_block_free(owned[i]);
+    return ec;
+}
+typedef struct _replay_task_t {
+    ufs_vfs_t* vfs;
+    const _replay_op_t* ops;
+    size_t num;
+    int ec;
+} _replay_task_t;
+static void _replay_worker(void* opaque) {
+    _replay_task_t* task = ul_reinterpret_cast(_replay_task_t*, opaque);
+    task->ec = _replay_write(task->vfs, task->ops, task->num);
+}
+// 排序并写回收集的区块，释放收集的区块列表
+static int _replay_finish(ufs_vfs_t* ufs_restrict vfs, _replay_t* ufs_restrict replay, int threads, ufs_mount_stat_t* ufs_restrict stat) {
+    _replay_task_t task[_REPLAY_THREAD_MAX];
+    ufs_threadpool_t pool;
+    int ec = 0, i, n;
+    size_t b, e;
+    const _replay_op_t* ops = replay->ops;
+    const size_t num = replay->num;
+
+    if(num == 0) goto do_return;
+    qsort(replay->ops, num, sizeof(_replay_op_t), &_replay_compare);
+    for(b = 0; b < num; ++b)
+        if(b == 0 || ops[b].bnum != ops[b - 1].bnum) ++stat->replay_blocks;
+
+    threads = ufs_min(threads, _REPLAY_THREAD_MAX);
+    if(threads <= 1 || num < ul_static_cast(size_t, threads) * _REPLAY_RUN_MAX || ufs_threadpool_init(&pool, threads) != 0) {
+        stat->replay_threads = ufs_max(stat->replay_threads, 1);
+        ec = _replay_write(vfs, ops, num);
+        goto do_return;
+    }
+    // 按区块数大致均分，边界对齐到块号分组
+    for(n = 0, b = 0; b < num; ++n, b = e) {
+        e = n + 1 == threads ? num : b + (num - b) / ul_static_cast(size_t, threads - n);
+        if(e <= b) e = b + 1;
+        while(e < num && ops[e].bnum == ops[e - 1].bnum) ++e;
+        task[n].vfs = vfs;
+        task[n].ops = ops + b;
+        task[n].num = e - b;
+        task[n].ec = 0;
+        if(ufs_unlikely(ufs_threadpool_push(&pool, &_replay_worker, task + n) != 0))
+            _replay_worker(task + n);
+    }
+    ufs_threadpool_deinit(&pool); // 等待所有任务完成
+    stat->replay_threads = ufs_max(stat->replay_threads, ul_static_cast(uint32_t, threads));
+    for(i = 0; i < n; ++i)
+        if(ufs_unlikely(task[i].ec)) { ec = task[i].ec; break; }
+
+do_return:
+    ufs_free(replay->ops);
+    replay->ops = NULL;
+    replay->num = replay->cap = 0;
+    return ec;
+}
+
+/**
+ * 日志超级块（位于环形日志区之后）
+ *
+ * 记录尾部位置以及尾部第一个提交的序列号，两个副本交替写入，挂载时使用校验通过且序列号较大的副本。
+ * 检查点之后日志区为空，下一次提交可以从尾部开始，也可以回绕到日志区开头，因此重放时尾部的记录无效则从开头重试。
+*/
+#define _JORNAL_SB_MAGIC 0x53534655u // "UFSS"
+#define _JORNAL_SB_COPY_SIZE (UFS_BLOCK_SIZE / 2)
+typedef struct _jornal_sb_t {
+    uint32_t magic; // 魔数
+    uint32_t crc; // CRC32C校验和
+    uint64_t seq; // 尾部第一个提交的序列号
+    uint64_t tail; // 尾部位置
+} _jornal_sb_t;
+#define _jornal_sb_crc_off offsetof(_jornal_sb_t, seq)
+
+static uint32_t _jornal_sb_crc(const _jornal_sb_t* jsb) {
+    return ufs_crc32c(0, ul_reinterpret_cast(const char*, jsb) + _jornal_sb_crc_off, sizeof(*jsb) - _jornal_sb_crc_off);
+}
+// 提交和检查点使用的刷盘屏障（UFS_DURABILITY_PERIODIC只在真正提交时刷盘，因此仍然完全刷盘）
+static int _jornal_barrier(ufs_jornal_t* jornal) {
+    switch(jornal->durability) {
+    case UFS_DURABILITY_ORDERED:
+        return ufs_vfs_datasync(jornal->vfs);
+    case UFS_DURABILITY_NONE:
+        return 0;
+    default:
+        return ufs_vfs_sync(jornal->vfs);
+    }
+}
+// 写入日志超级块并刷盘
+static int _write_jornal_sb(ufs_jornal_t* jornal) {
+    int ec;
+    _jornal_sb_t jsb;
+    jsb.magic = ul_trans_u32_le(_JORNAL_SB_MAGIC);
+    jsb.seq = ul_trans_u64_le(jornal->seq + 1);
+    jsb.tail = ul_trans_u64_le(jornal->tail);
+    jsb.crc = ul_trans_u32_le(_jornal_sb_crc(&jsb));
+    ec = ufs_vfs_pwrite_check(jornal->vfs, &jsb, sizeof(jsb),
+        ufs_vfs_offset2(jornal->start + jornal->size, ul_static_cast(uint64_t, jornal->sb_slot) * _JORNAL_SB_COPY_SIZE));
+    if(ufs_unlikely(ec)) return ec;
+    jornal->sb_slot ^= 1;
+    return _jornal_barrier(jornal);
+}
+// 读取日志超级块，两个副本均无效时返回1
+static int _read_jornal_sb(ufs_jornal_t* ufs_restrict jornal, uint64_t* ufs_restrict pseq, uint64_t* ufs_restrict ptail) {
+    int ec, i, found = 0;
+    _jornal_sb_t jsb;
+    *pseq = 0;
+    *ptail = 0;
+    for(i = 0; i < 2; ++i) {
+        ec = ufs_vfs_pread_check(jornal->vfs, &jsb, sizeof(jsb),
+            ufs_vfs_offset2(jornal->start + jornal->size, ul_static_cast(uint64_t, i) * _JORNAL_SB_COPY_SIZE));
+        if(ufs_unlikely(ec)) return ec;
+        if(ul_trans_u32_le(jsb.magic) != _JORNAL_SB_MAGIC || ul_trans_u32_le(jsb.crc) != _jornal_sb_crc(&jsb)) continue;
+        if(ul_trans_u64_le(jsb.tail) >= jornal->size) continue;
+        if(found && ul_trans_u64_le(jsb.seq) <= *pseq) continue;
+        *pseq = ul_trans_u64_le(jsb.seq);
+        *ptail = ul_trans_u64_le(jsb.tail);
+        jornal->sb_slot = i ^ 1;
+        found = 1;
+    }
+    return found ? 0 : 1;
+}
+
+/**
+ * 日志区中未检查点的目标块号
+ *
+ * 节点在设置日志区时一次性分配，每个日志块最多对应一个节点，提交时不需要再分配内存。
+*/
+typedef struct _window_node_t {
+    ulrb_node_t base;
+    uint64_t bnum;
+} _window_node_t;
+static int _window_comp(void* opaque, const void* lhs, const void* rhs) {
+    const uint64_t lv = *ul_reinterpret_cast(const uint64_t*, lhs);
+    const uint64_t rv = *ul_reinterpret_cast(const uint64_t*, rhs);
+    (void)opaque;
+    return lv < rv ? -1 : lv > rv;
+}
+static int _window_find(const ufs_jornal_t* jornal, uint64_t bnum) {
+    return ulrb_find(ul_reinterpret_cast(ulrb_node_t*, jornal->window), &bnum, _window_comp, NULL) != NULL;
+}
+static void _window_insert(ufs_jornal_t* jornal, uint64_t bnum) {
+    _window_node_t* node;
+    if(_window_find(jornal, bnum)) return;
+    ufs_assert(jornal->window_num < jornal->size);
+    node = ul_reinterpret_cast(_window_node_t*, jornal->window_nodes) + jornal->window_num++;
+    node->bnum = bnum;
+    ulrb_insert_unsafe(ul_reinterpret_cast(ulrb_node_t**, &jornal->window),
+        ul_reinterpret_cast(ulrb_node_t*, node), _window_comp, NULL);
+}
+static void _window_clear(ufs_jornal_t* jornal) {
+    jornal->window = NULL;
+    jornal->window_num = 0;
+}
+
+static int _jornal_setup(ufs_jornal_t* jornal, uint64_t start, uint64_t size) {
+    void* nodes;
+    if(ufs_unlikely(size < UFS_JORNAL_NUM || size > SIZE_MAX / sizeof(_window_node_t))) return UFS_EINVAL;
+    nodes = ufs_malloc(ul_static_cast(size_t, size) * sizeof(_window_node_t));
+    if(ufs_unlikely(nodes == NULL)) return UFS_ENOMEM;
+    ufs_free(jornal->window_nodes);
+    jornal->window_nodes = nodes;
+    _window_clear(jornal);
+    jornal->start = start;
+    jornal->size = size;
+    jornal->tail = 0;
+    jornal->used = 0;
+    jornal->sb_slot = 0;
+    return 0;
+}
+
+// 计算大小为size、状态为(tail, used)的日志区中提交的写入位置，空间不足时返回0
+static int _ring_place_at(uint64_t size, uint64_t tail, uint64_t used, uint64_t need, uint64_t* ppos) {
+    const uint64_t end = tail + used;
+    if(used == 0) {
+        if(need > size) return 0;
+        *ppos = size - tail >= need ? tail : 0;
+        return 1;
+    }
+    if(end < size) { // 未回绕：空闲区间为[end, size)和[0, tail)
+        if(size - end >= need) { *ppos = end; return 1; }
+        if(tail >= need) { *ppos = 0; return 1; }
+        return 0;
+    }
+    // 已回绕：空闲区间为[end - size, tail)
+    if(tail - (end - size) >= need) { *ppos = end - size; return 1; }
+    return 0;
+}
+static void _ring_advance_at(uint64_t size, uint64_t* ptail, uint64_t* pused, uint64_t pos, uint64_t need) {
+    if(*pused == 0) *ptail = pos;
+    else if(pos == 0 && *ptail + *pused < size)
+        *pused += size - (*ptail + *pused); // 回绕时跳过末尾放不下的块
+    *pused += need;
+}
+static int _ring_place(const ufs_jornal_t* ufs_restrict jornal, uint64_t need, uint64_t* ufs_restrict ppos) {
+    return _ring_place_at(jornal->size, jornal->tail, jornal->used, need, ppos);
+}
+static void _ring_advance(ufs_jornal_t* jornal, uint64_t pos, uint64_t need) {
+    _ring_advance_at(jornal->size, &jornal->tail, &jornal->used, pos, need);
+}
+
+static int ufs_jornal_checkpoint_nolock(ufs_jornal_t* jornal) {
+    int ec;
+    if(jornal->used == 0) return 0;
+    // 提交后写回原位置的区块落盘后，才能推进尾部
+    ec = _jornal_barrier(jornal);
+    if(ufs_unlikely(ec)) return ec;
+    jornal->tail = (jornal->tail + jornal->used) % jornal->size;
+    jornal->used = 0;
+    _window_clear(jornal);
+    return _write_jornal_sb(jornal);
+}
+
+static int _op_compare(const void* lhs, const void* rhs) {
+    const uint64_t l = (*ul_reinterpret_cast(const ufs_jornal_op_t* const*, lhs))->bnum;
+    const uint64_t r = (*ul_reinterpret_cast(const ufs_jornal_op_t* const*, rhs))->bnum;
+    return l < r ? -1 : (l > r);
+}
+static const char _zero_pad[UFS_BLOCK_SIZE - sizeof(_jornal_commit_t)] = { 0 };
+
+// 提交记录之后的日志块数
+static int _record_blocks(const ufs_jornal_op_t* ops, int num) {
+    int i, nfull = 0;
+    size_t dlen = 0;
+    for(i = 0; i < num; ++i) {
+        if(_op_is_delta(ops + i)) dlen += _JORNAL_DELTA_HEAD + ops[i].len;
+        else ++nfull;
+    }
+    return nfull + ul_static_cast(int, (dlen + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE);
+}
+// 在日志区的pos处写入一条提交记录及其日志块（不刷盘）
+static int _write_record(ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num, uint64_t pos, uint32_t flags) {
+    int ec;
+    int i, iovcnt, nfull, blocks;
+    uint32_t crc;
+    size_t dlen;
+    char* delta = NULL;
+    _jornal_commit_t commit;
+    ufs_iovec_t iov[UFS_JORNAL_OP_MAX + 3];
+
+    ufs_assert(num > 0 && num <= UFS_JORNAL_OP_MAX);
+    // 修改范围较小的区块打包为增量记录
+    nfull = 0; dlen = 0;
+    for(i = 0; i < num; ++i) {
+        if(_op_is_delta(ops + i)) dlen += _JORNAL_DELTA_HEAD + ops[i].len;
+        else ++nfull;
+    }
+    dlen = (dlen + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE * UFS_BLOCK_SIZE;
+    blocks = nfull + ul_static_cast(int, dlen / UFS_BLOCK_SIZE);
+    if(dlen) {
+        char* p;
+        delta = ul_reinterpret_cast(char*, ufs_malloc(dlen));
+        if(ufs_unlikely(delta == NULL)) return UFS_ENOMEM;
+        p = delta;
+        for(i = 0; i < num; ++i) {
+            if(!_op_is_delta(ops + i)) continue;
+            _put_u16(p, ops[i].off);
+            _put_u16(p + 2, ops[i].len);
+            memcpy(p + _JORNAL_DELTA_HEAD, ul_reinterpret_cast(const char*, ops[i].buf) + ops[i].off, ops[i].len);
+            p += _JORNAL_DELTA_HEAD + ops[i].len;
+        }
+        memset(p, 0, ul_static_cast(size_t, delta + dlen - p));
+    }
+
+    _make_commit(&commit, jornal->seq + 1, num, blocks, flags);
+    for(i = 0; i < num; ++i)
+        commit.bnum[i] = ul_trans_u64_le(ops[i].bnum | (_op_is_delta(ops + i) ? _JORNAL_DELTA_FLAG : 0));
+    // 提交记录与日志块在日志区中连续，先计算校验和，再一次聚集写入
+    crc = _commit_crc(&commit);
+    iovcnt = 2;
+    for(i = 0; i < num; ++i) {
+        if(_op_is_delta(ops + i)) continue;
+        crc = ufs_crc32c(crc, ops[i].buf, UFS_BLOCK_SIZE);
+        iov[iovcnt].base = ops[i].buf;
+        iov[iovcnt++].len = UFS_BLOCK_SIZE;
+    }
+    if(dlen) {
+        crc = ufs_crc32c(crc, delta, dlen);
+        iov[iovcnt].base = delta;
+        iov[iovcnt++].len = dlen;
+    }
+    commit.crc = ul_trans_u32_le(crc);
+    iov[0].base = &commit; iov[0].len = sizeof(commit);
+    iov[1].base = _zero_pad; iov[1].len = sizeof(_zero_pad);
+    ec = ufs_vfs_pwritev_check(jornal->vfs, iov, iovcnt, ufs_vfs_offset(jornal->start + pos));
+    ufs_free(delta);
+    return ec;
+}
+// 写回原位置（增量记录只写回修改范围），按块号排序后，块号连续的整块合并为一次聚集写入
+static int _write_back(ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num) {
+    int ec = 0;
+    int i, j, iovcnt;
+    ufs_iovec_t iov[UFS_JORNAL_OP_MAX];
+    const ufs_jornal_op_t* local[UFS_JORNAL_OP_MAX];
+    const ufs_jornal_op_t** sorted = local;
+
+    if(num > UFS_JORNAL_OP_MAX) {
+        sorted = ul_reinterpret_cast(const ufs_jornal_op_t**, ufs_malloc(ul_static_cast(size_t, num) * sizeof(sorted[0])));
+        if(ufs_unlikely(sorted == NULL)) return UFS_ENOMEM;
+    }
+    for(i = 0; i < num; ++i) {
+        _window_insert(jornal, ops[i].bnum);
+        sorted[i] = ops + i;
+    }
+    qsort(ul_reinterpret_cast(void*, sorted), ul_static_cast(size_t, num), sizeof(sorted[0]), &_op_compare);
+    for(i = 0; i < num; i = j) {
+        if(_op_is_delta(sorted[i])) {
+            ec = ufs_vfs_pwrite_check(jornal->vfs, ul_reinterpret_cast(const char*, sorted[i]->buf) + sorted[i]->off,
+                sorted[i]->len, ufs_vfs_offset2(sorted[i]->bnum, sorted[i]->off));
+            if(ufs_unlikely(ec)) goto do_return;
+            j = i + 1;
+            continue;
+        }
+        for(j = i, iovcnt = 0; j < num && iovcnt < UFS_JORNAL_OP_MAX && !_op_is_delta(sorted[j])
+                && sorted[j]->bnum == sorted[i]->bnum + ul_static_cast(uint64_t, iovcnt); ++j) {
+            iov[iovcnt].base = sorted[j]->buf;
+            iov[iovcnt++].len = UFS_BLOCK_SIZE;
+        }
+        ec = ufs_vfs_pwritev_check(jornal->vfs, iov, iovcnt, ufs_vfs_offset(sorted[i]->bnum));
+        if(ufs_unlikely(ec)) goto do_return;
+    }
+
+do_return:
+    if(sorted != local) ufs_free(ul_reinterpret_cast(void*, sorted));
+    return ec;
+}
+// 检查拆分为多条记录的事务能否从日志区当前状态依次放入
+static int _group_fits(const ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num) {
+    int i, n;
+    uint64_t pos, need, tail = jornal->tail, used = jornal->used;
+    if(jornal->window_num + ul_static_cast(uint64_t, num) > jornal->size) return 0;
+    for(i = 0; i < num; i += n) {
+        n = ufs_min(num - i, UFS_JORNAL_OP_MAX);
+        need = ul_static_cast(uint64_t, _record_blocks(ops + i, n)) + 1;
+        if(!_ring_place_at(jornal->size, tail, used, need, &pos)) return 0;
+        _ring_advance_at(jornal->size, &tail, &used, pos, need);
+    }
+    return 1;
+}
+
+UFS_HIDDEN int ufs_do_jornal(ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num) {
+    int ec;
+    int i, n;
+    uint64_t pos, need;
+
+    if(ufs_unlikely(num == 0)) return _jornal_barrier(jornal);
+
+    // 1. 在日志区头部写入提交记录和日志块（只需一次刷盘），空间不足时先进行检查点
+    // 增量记录使多个区块共用一个日志块，因此窗口节点也可能先于日志区用完
+    // 拆分的记录必须全部放入日志区，写入期间不能检查点
+    if(jornal->stale || !_group_fits(jornal, ops, num)) {
+        ec = ufs_jornal_checkpoint_nolock(jornal);
+        if(ufs_unlikely(ec)) return ec;
+        jornal->stale = 0;
+        if(!_group_fits(jornal, ops, num)) return UFS_EOVERFLOW;
+    }
+    // 直接写入原位置的数据不经过日志，先刷盘，避免提交记录先于它引用的数据落盘
+    // （之后写入的数据由下一次提交负责）
+    if(ulatomic_exchange_explicit_32(&jornal->data_written, 0, ulatomic_memory_order_acq_rel)) {
+        ec = _jornal_barrier(jornal);
+        if(ufs_unlikely(ec)) { ulatomic_store_explicit_32(&jornal->data_written, 1, ulatomic_memory_order_relaxed); return ec; }
+    }
+    // 写入失败时日志区中可能残留部分记录（序列号也已被占用），越过它们并在下一次提交前检查点，
+    // 避免之后的提交与残留的记录混在一起
+    for(i = 0; i < num; i += n) {
+        n = ufs_min(num - i, UFS_JORNAL_OP_MAX);
+        need = ul_static_cast(uint64_t, _record_blocks(ops + i, n)) + 1;
+        if(ufs_unlikely(!_ring_place(jornal, need, &pos))) { jornal->stale = 1; return UFS_EOVERFLOW; }
+        ec = _write_record(jornal, ops + i, n, pos,
+            (i ? _JORNAL_COMMIT_CONT : 0) | (i + n < num ? _JORNAL_COMMIT_MORE : 0));
+        _ring_advance(jornal, pos, need);
+        ++jornal->seq;
+        if(ufs_unlikely(ec)) { jornal->stale = 1; return ec; }
+    }
+    ec = _jornal_barrier(jornal);
+    if(ufs_unlikely(ec)) { jornal->stale = 1; return ec; }
+
+    // 2. 写回原位置，提交保留在日志区中，直到检查点时才需要落盘
+    return _write_back(jornal, ops, num);
+}
+
 typedef struct _sb_transcation_t {
     uint32_t _jd0;
     uint16_t _jd1;
@@ -40,60 +597,22 @@ static int _remove_flag2(ufs_vfs_t* vfs) {
     if(ufs_unlikely(ec)) return ec;
     return 0;
 }
-
-UFS_HIDDEN int ufs_do_jornal(ufs_vfs_t* ufs_restrict vfs, const ufs_jornal_op_t* ufs_restrict ops, int num) {
-    int ec;
-    int i;
+static int _clear_flag(ufs_vfs_t* vfs) {
     _sb_transcation_t disk;
-
-    // 1. 备份区块
-    disk.jornal_start0 = 0xFF;
-    disk.jornal_start1 = 0xFF;
-    for(i = 0; i < num; ++i) {
-        disk.jornal[i] = ul_trans_u64_le(ops[i].bnum);
-        ec = ufs_vfs_copy(vfs,
-            ufs_vfs_offset(ops[i].bnum), ufs_vfs_offset(UFS_BNUM_JORNAL + i), UFS_BLOCK_SIZE);
-        if(ufs_unlikely(ec)) return ec;
-    }
-    for(; i < UFS_JORNAL_NUM; ++i)
-        disk.jornal[i] = 0;
-    disk.jornal_last0 = 0xFF;
-    disk.jornal_last1 = 0xFF;
-
-    // 2. 将四个标记和日志偏移量写入
-    ec = ufs_vfs_pwrite_check(vfs, _sb_jornal_start(&disk), _sb_transcation_size, ufs_vfs_offset(UFS_BNUM_SB) + UFS_JORNAL_OFFSET);
-    if(ufs_unlikely(ec)) return ec;
-    ec = ufs_vfs_sync(vfs);
-    if(ufs_unlikely(ec)) return ec;
-
-    // 3. 写入区块
-    for(i = 0; i < num; ++i) {
-        ec = ufs_vfs_pwrite_check(vfs, ops[i].buf, UFS_BLOCK_SIZE, ufs_vfs_offset(ops[i].bnum));
-        if(ufs_unlikely(ec)) return ec;
-    }
-    ec = ufs_vfs_sync(vfs);
-    if(ufs_unlikely(ec)) return ec;
-
-    // 4. 擦除标记1
-    ec = _remove_flag1(vfs);
-    if(ufs_unlikely(ec)) return ec;
-
-    // 5. 擦除标记0
-    ec = _remove_flag2(vfs);
-    if(ufs_unlikely(ec)) return ec;
-
-    return 0;
+    memset(&disk, 0, sizeof(disk));
+    return ufs_vfs_pwrite_check(vfs, _sb_jornal_start(&disk), _sb_transcation_size, ufs_vfs_offset(UFS_BNUM_SB) + UFS_JORNAL_OFFSET);
 }
 
-UFS_HIDDEN int ufs_fix_jornal(ufs_vfs_t* ufs_restrict vfs, ufs_sb_t* ufs_restrict sb) {
+// 旧版本的日志先将旧区块备份到日志区，再写入新区块，崩溃时需要撤销
+static int _fix_legacy_jornal(ufs_vfs_t* ufs_restrict vfs, const ufs_sb_t* ufs_restrict sb, int threads, ufs_mount_stat_t* ufs_restrict stat) {
     int ec;
     int i;
-    _sb_transcation_t disk;
-    memset(&disk, 0, sizeof(disk));
+    char* buf;
+    _replay_t replay = { NULL, 0, 0 };
 
     switch(
         (_istrue(sb->jornal_start0) << 3) | (_istrue(sb->jornal_start1) << 2) |
-        (_istrue(sb->jornal_last1) << 1) | (_istrue(sb->jornal_last1) << 0)
+        (_istrue(sb->jornal_last1) << 1) | (_istrue(sb->jornal_last0) << 0)
     ) {
     case 0x0:
         // 初始状态/标记写入未开始
@@ -104,22 +623,23 @@ UFS_HIDDEN int ufs_fix_jornal(ufs_vfs_t* ufs_restrict vfs, ufs_sb_t* ufs_restric
         // 标记写入未完成但偏移量未写入/标记0擦除未完成
     case 0xE: case 0x7: case 0x6:
         // 标记写入未完成但偏移量已写入
-        disk.jornal_start0 = 0;
-        disk.jornal_last0 = 0;
-        disk.jornal_start1 = 0;
-        disk.jornal_last1 = 0;
-        return ufs_vfs_pwrite_check(vfs, _sb_jornal_start(&disk), _sb_transcation_size, ufs_vfs_offset(UFS_BNUM_SB) + UFS_JORNAL_OFFSET);
+        return _clear_flag(vfs);
 
     case 0xF:
         // 写入区块未完成/标记擦除未开始
-        for(i = 0; i < UFS_JORNAL_NUM; ++i)
+        buf = ul_reinterpret_cast(char*, ufs_malloc(UFS_JORNAL_NUM * UFS_BLOCK_SIZE));
+        if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
+        ec = ufs_vfs_pread_check(vfs, buf, UFS_JORNAL_NUM * UFS_BLOCK_SIZE, ufs_vfs_offset(UFS_BNUM_JORNAL));
+        for(i = 0; ec == 0 && i < UFS_JORNAL_NUM; ++i)
             if(sb->jornal[i])
-                ec = ufs_vfs_copy(vfs, ufs_vfs_offset(UFS_BNUM_JORNAL + i), ufs_vfs_offset(ul_trans_u64_le(sb->jornal[i])), UFS_BLOCK_SIZE);
-        disk.jornal_start0 = 0;
-        disk.jornal_last0 = 0;
-        disk.jornal_start1 = 0;
-        disk.jornal_last1 = 0;
-        return ufs_vfs_pwrite_check(vfs, _sb_jornal_start(&disk), _sb_transcation_size, ufs_vfs_offset(UFS_BNUM_SB) + UFS_JORNAL_OFFSET);
+                ec = _replay_push(&replay, ul_trans_u64_le(sb->jornal[i]), buf + ul_static_cast(size_t, i) * UFS_BLOCK_SIZE, 0, UFS_BLOCK_SIZE);
+        if(ufs_likely(ec == 0)) {
+            stat->replay_commits = 1;
+            ec = _replay_finish(vfs, &replay, threads, stat);
+        } else ufs_free(replay.ops);
+        ufs_free(buf);
+        if(ufs_unlikely(ec)) return ec;
+        return _clear_flag(vfs);
 
     case 0xB: case 0xD:
         // 标记1擦除未完成
@@ -138,144 +658,560 @@ UFS_HIDDEN int ufs_fix_jornal(ufs_vfs_t* ufs_restrict vfs, ufs_sb_t* ufs_restric
     return -1;
 }
 
+// 检查读入的日志区中pos处序列号为seq的提交，返回提交记录及其日志块数，提交无效时返回1
+// 接续前一条记录的提交只有在group不为0（正在收集多条记录组成的事务）时才有效
+static int _read_commit(
+    const ufs_jornal_t* ufs_restrict jornal, const char* ufs_restrict ring, uint64_t pos, uint64_t seq, int group,
+    const _jornal_commit_t** ufs_restrict pcommit, int* ufs_restrict pblocks
+) {
+    int num, blocks;
+    uint32_t crc;
+    const _jornal_commit_t* commit = ul_reinterpret_cast(const _jornal_commit_t*, ring + pos * UFS_BLOCK_SIZE);
+    const char* buf = ring + (pos + 1) * UFS_BLOCK_SIZE;
+    if(ul_trans_u32_le(commit->magic) != _JORNAL_MAGIC || ul_trans_u64_le(commit->seq) != seq) return 1;
+    if(!group && (ul_trans_u32_le(commit->flags) & _JORNAL_COMMIT_CONT)) return 1;
+    num = ul_trans_u16_le(commit->num);
+    blocks = ul_trans_u16_le(commit->blocks);
+    if(blocks == 0) blocks = num;
+    if(num == 0 || num > UFS_JORNAL_OP_MAX || blocks > num || ul_static_cast(uint64_t, blocks) >= jornal->size - pos) return 1;
+    crc = ufs_crc32c(_commit_crc(commit), buf, ul_static_cast(size_t, blocks) * UFS_BLOCK_SIZE);
+    if(crc != ul_trans_u32_le(commit->crc)) return 1;
+    *pcommit = commit;
+    *pblocks = blocks;
+    return _apply_commit(NULL, commit, buf, blocks);
+}
+UFS_HIDDEN int ufs_fix_jornal(ufs_jornal_t* ufs_restrict jornal, const ufs_sb_t* ufs_restrict sb, int threads, ufs_mount_stat_t* ufs_restrict stat) {
+    int ec;
+    int blocks, group = 0;
+    uint32_t flags;
+    uint64_t seq, pos, walked, replayed = 0, group_commits = 0, discarded = 0;
+    size_t group_start = 0;
+    const _jornal_commit_t* commit;
+    char* ring = NULL;
+    _replay_t replay = { NULL, 0, 0 };
+    const int64_t begin = ufs_time(0);
+
+    memset(stat, 0, sizeof(*stat));
+    ec = _fix_legacy_jornal(jornal->vfs, sb, threads, stat);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    if(!(sb->ext_offset & UFS_SB_EXT_JORNAL)) ec = _jornal_setup(jornal, UFS_BNUM_JORNAL, UFS_JORNAL_NUM);
+    else ec = _jornal_setup(jornal, ul_trans_u64_le(sb->jornal_bnum), ul_trans_u64_le(sb->jornal_size));
+    if(ufs_unlikely(ec)) goto do_return;
+
+    ec = _read_jornal_sb(jornal, &seq, &pos);
+    if(ec == 1) { ec = 0; goto do_return; } // 日志超级块无效，视为空日志
+    if(ufs_unlikely(ec)) goto do_return;
+    jornal->seq = seq - 1;
+    jornal->tail = pos;
+
+    // 一次顺序读入整个日志区
+    if(ufs_unlikely(jornal->size > SIZE_MAX / UFS_BLOCK_SIZE)) { ec = UFS_ENOMEM; goto do_return; }
+    ring = ul_reinterpret_cast(char*, ufs_malloc(ul_static_cast(size_t, jornal->size) * UFS_BLOCK_SIZE));
+    if(ufs_unlikely(ring == NULL)) { ec = UFS_ENOMEM; goto do_return; }
+    ec = ufs_vfs_pread_check(jornal->vfs, ring, ul_static_cast(size_t, jornal->size) * UFS_BLOCK_SIZE, ufs_vfs_offset(jornal->start));
+    if(ufs_unlikely(ec)) goto do_return;
+
+    // 从尾部开始按序列号依次收集完整的提交（重放是幂等的，检查点中途崩溃也可以再次重放）
+    for(walked = 0; walked < jornal->size; walked += ul_static_cast(uint64_t, blocks) + 1) {
+        if(pos == jornal->size) pos = 0;
+        ec = _read_commit(jornal, ring, pos, seq, group, &commit, &blocks);
+        if(ec == 1 && pos != 0) { // 提交可能回绕到了日志区开头
+            pos = 0;
+            ec = _read_commit(jornal, ring, pos, seq, group, &commit, &blocks);
+        }
+        if(ec == 1) { ec = 0; break; }
+        if(ufs_unlikely(ec)) goto do_return;
+
+        // 多条记录组成的事务没有读到最后一条时，丢弃已经收集的部分
+        flags = ul_trans_u32_le(commit->flags);
+        if(group && !(flags & _JORNAL_COMMIT_CONT)) { replay.num = group_start; discarded += group_commits; group = 0; }
+        if(!group) { group_start = replay.num; group_commits = 0; }
+        group = (flags & _JORNAL_COMMIT_MORE) != 0;
+        ec = _apply_commit(&replay, commit, ring + (pos + 1) * UFS_BLOCK_SIZE, blocks);
+        if(ufs_unlikely(ec)) goto do_return;
+        if(replayed == 0) jornal->tail = pos;
+        jornal->seq = seq++;
+        pos += ul_static_cast(uint64_t, blocks) + 1;
+        ++replayed;
+        ++group_commits;
+    }
+
+    if(group) { replay.num = group_start; discarded += group_commits; }
+    if(replayed) {
+        stat->replay_commits += replayed - discarded; // 丢弃的部分不计入
+        ec = _replay_finish(jornal->vfs, &replay, threads, stat);
+        if(ufs_unlikely(ec)) goto do_return;
+        // 重放的区块落盘后推进尾部，避免下次挂载时再次重放
+        jornal->used = (pos + jornal->size - jornal->tail) % jornal->size;
+        if(jornal->used == 0) jornal->used = jornal->size;
+        ec = ufs_jornal_checkpoint_nolock(jornal);
+    }
+
+do_return:
+    ufs_free(replay.ops);
+    ufs_free(ring);
+    stat->replay_time = ul_static_cast(uint64_t, ufs_max(ufs_time(0) - begin, 0));
+    return ec;
+}
+UFS_HIDDEN int ufs_format_jornal(ufs_jornal_t* jornal, uint64_t start, uint64_t size) {
+    int ec;
+    ec = _jornal_setup(jornal, start, size);
+    if(ufs_unlikely(ec)) return ec;
+    // 清空日志区，避免残留数据被当作提交记录
+    ec = ufs_vfs_pwrite_zeros(jornal->vfs, ul_static_cast(size_t, size + 1) * UFS_BLOCK_SIZE, ufs_vfs_offset(start));
+    if(ufs_unlikely(ec)) return ec;
+    jornal->seq = 0;
+    return _write_jornal_sb(jornal);
+}
+
+// 乘法散列，取高位作为槽号
+static unsigned _index_hash(uint64_t bnum) {
+    return ul_static_cast(unsigned, (bnum * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (UFS_JORNAL_INDEX_SIZE - 1);
+}
+UFS_HIDDEN void ufs_jornal_index_clear(ufs_jornal_index_t* index) {
+    memset(index->slot, 0, sizeof(index->slot));
+}
+UFS_HIDDEN int ufs_jornal_index_find(const ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, uint64_t bnum) {
+    unsigned h = _index_hash(bnum);
+    while(index->slot[h]) {
+        if(ops[index->slot[h] - 1].bnum == bnum) return index->slot[h] - 1;
+        h = (h + 1) & (UFS_JORNAL_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+UFS_HIDDEN void ufs_jornal_index_set(ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, int i) {
+    const uint64_t bnum = ops[i].bnum;
+    unsigned h = _index_hash(bnum);
+    while(index->slot[h] && ops[index->slot[h] - 1].bnum != bnum)
+        h = (h + 1) & (UFS_JORNAL_INDEX_SIZE - 1);
+    index->slot[h] = ul_static_cast(uint8_t, i + 1);
+}
+UFS_HIDDEN void ufs_jornal_index_build(ufs_jornal_index_t* ufs_restrict index, const ufs_jornal_op_t* ufs_restrict ops, int num) {
+    int i;
+    ufs_jornal_index_clear(index);
+    for(i = 0; i < num; ++i)
+        ufs_jornal_index_set(index, ops, i);
+}
+
 UFS_HIDDEN int ufs_jornal_init(ufs_jornal_t* ufs_restrict jornal, ufs_vfs_t* ufs_restrict vfs) {
     jornal->vfs = vfs;
     jornal->num = 0;
+    ufs_jornal_index_clear(&jornal->index);
+    jornal->cnum = 0;
+    ufs_jornal_index_clear(&jornal->cindex);
+    jornal->committing = 0;
+    jornal->hold = 0;
+    jornal->held = NULL;
+    jornal->lops = NULL;
+    jornal->lnum = 0;
+    jornal->stale = 0;
+    ulatomic_store_explicit_32(&jornal->data_written, 0, ulatomic_memory_order_relaxed);
     ulatomic_spinlock_init(&jornal->lock);
+    ulatomic_spinlock_init(&jornal->ring_lock);
+    ulatomic_store_explicit_64(&jornal->batch, 1, ulatomic_memory_order_relaxed);
+    ulatomic_store_explicit_64(&jornal->durable, 0, ulatomic_memory_order_relaxed);
+    jornal->seq = 0;
+    jornal->start = UFS_BNUM_JORNAL;
+    jornal->size = UFS_JORNAL_NUM;
+    jornal->tail = 0;
+    jornal->used = 0;
+    jornal->sb_slot = 0;
+    jornal->window = NULL;
+    jornal->window_nodes = NULL;
+    jornal->window_num = 0;
+    jornal->flushing = 0;
+    jornal->waiters = 0;
+    jornal->durability = UFS_DURABILITY_STRICT;
+    jornal->sync_interval = 0;
+    ulatomic_store_explicit_64(&jornal->sync_last, 0, ulatomic_memory_order_relaxed);
+    jornal->ckpt_event.opaque = NULL;
+    jornal->ckpt_interval = 0;
+    jornal->ckpt_threshold = 0;
+    jornal->ckpt_state = 0;
     return 0;
 }
 UFS_HIDDEN void ufs_jornal_deinit(ufs_jornal_t* jornal) {
     int i;
     for(i = jornal->num - 1; i >= 0; --i)
-        ufs_free(ufs_const_cast(void*, jornal->ops[i].buf));
+        ufs_block_free(ufs_const_cast(void*, jornal->ops[i].buf));
     jornal->num = 0;
+    ufs_jornal_index_clear(&jornal->index);
+    for(i = jornal->cnum - 1; i >= 0; --i)
+        ufs_block_free(ufs_const_cast(void*, jornal->cops[i].buf));
+    jornal->cnum = 0;
+    ufs_jornal_index_clear(&jornal->cindex);
+    if(jornal->held) {
+        ufs_transcation_deinit(jornal->held);
+        ufs_free(jornal->held);
+        jornal->held = NULL;
+    }
+    ufs_free(jornal->window_nodes);
+    jornal->window_nodes = NULL;
+    _window_clear(jornal);
+    ufs_event_deinit(&jornal->ckpt_event);
 }
 
-static void _jornal_merge(ufs_jornal_t* jornal, int x) {
-    int i, j;
-    const int n = jornal->num;
-    for(i = n - 1; i >= x; --i)
-        for(j = i - 1; j >= 0; --j)
-            if(jornal->ops[i].bnum == jornal->ops[j].bnum) {
-                ufs_free(ufs_const_cast(void*, jornal->ops[j].buf));
-                jornal->ops[j].buf = jornal->ops[i].buf;
-                jornal->ops[i].buf = NULL;
-                break;
-            }
-    for(i = x, j = x; i < n; ++i)
-        if(jornal->ops[i].buf != NULL)
-            jornal->ops[j++] = jornal->ops[i];
-    jornal->num = j;
+// 加入一个区块，同一区块在提交前被多次写入时只保留最后一次的内容并合并修改范围（调用者需保证有空余位置）
+static void _jornal_put(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len) {
+    const int i = ufs_jornal_index_find(&jornal->index, jornal->ops, bnum);
+    if(i >= 0) {
+        ufs_block_free(ufs_const_cast(void*, jornal->ops[i].buf));
+        jornal->ops[i].buf = buf;
+        ufs_jornal_op_widen(jornal->ops + i, off, len);
+    } else {
+        ufs_assert(jornal->num < UFS_JORNAL_OP_MAX);
+        jornal->ops[jornal->num].bnum = bnum;
+        jornal->ops[jornal->num].buf = buf;
+        jornal->ops[jornal->num].off = ul_static_cast(uint16_t, off);
+        jornal->ops[jornal->num].len = ul_static_cast(uint16_t, len);
+        ufs_jornal_index_set(&jornal->index, jornal->ops, jornal->num);
+        ++jornal->num;
+    }
+}
+#define _CKPT_NONE 0 // 未启动
+#define _CKPT_RUNNING 1 // 运行中
+#define _CKPT_STOP 2 // 请求退出
+// 待提交的日志或日志区的使用率（used为提交后的快照，不需要检查时传入0）超过阈值时，唤醒后台检查点
+static void _checkpointer_poke(ufs_jornal_t* jornal, uint64_t used) {
+    if(jornal->ckpt_state != _CKPT_RUNNING || jornal->ckpt_threshold == 0) return;
+    if(ul_static_cast(uint64_t, jornal->num) * 100 >= ul_static_cast(uint64_t, jornal->ckpt_threshold) * UFS_JORNAL_OP_MAX
+        || used * 100 >= jornal->ckpt_threshold * jornal->size)
+        ufs_event_notify(&jornal->ckpt_event);
+}
+
+static void ufs_jornal_lock(ufs_jornal_t* jornal) { ulatomic_spinlock_lock(&jornal->lock); }
+static void ufs_jornal_unlock(ufs_jornal_t* jornal) { ulatomic_spinlock_unlock(&jornal->lock); }
+// 刷盘可能持续较长时间，等待者让出时间片而不是空转
+static void ufs_jornal_lock_yield(ufs_jornal_t* jornal) {
+    while(!ulatomic_spinlock_trylock(&jornal->lock))
+        ufs_thread_yield();
+}
+static void ufs_jornal_ring_lock(ufs_jornal_t* jornal) {
+    while(!ulatomic_spinlock_trylock(&jornal->ring_lock))
+        ufs_thread_yield();
 }
-static void ufs_jornal_merge_nolock(ufs_jornal_t* jornal) {
-    _jornal_merge(jornal, 0);
+static void ufs_jornal_ring_unlock(ufs_jornal_t* jornal) { ulatomic_spinlock_unlock(&jornal->ring_lock); }
+
+// 写入提交中的批次（期间释放lock），成功后释放其区块
+static int _commit_frozen(ufs_jornal_t* jornal) {
+    int ec, i;
+    uint64_t used;
+
+    ufs_jornal_unlock(jornal);
+    ufs_jornal_ring_lock(jornal);
+    ec = ufs_do_jornal(jornal, jornal->cops, jornal->cnum);
+    used = jornal->used;
+    ufs_jornal_ring_unlock(jornal);
+    ufs_jornal_lock_yield(jornal);
+    if(ufs_unlikely(ec)) return ec;
+
+    for(i = jornal->cnum - 1; i >= 0; --i)
+        ufs_block_free(ufs_const_cast(void*, jornal->cops[i].buf));
+    jornal->cnum = 0;
+    ufs_jornal_index_clear(&jornal->cindex);
+    _checkpointer_poke(jornal, used);
+    return 0;
 }
+// 调用时持有lock，返回时仍持有lock（期间可能释放）
 static int ufs_jornal_sync_nolock(ufs_jornal_t* jornal) {
+    int ec = 0, retry;
+    ulatomic64_raw_t batch;
+
+    // 同一时刻只有一个线程提交
+    while(jornal->committing) {
+        ufs_jornal_unlock(jornal);
+        ufs_thread_yield();
+        ufs_jornal_lock_yield(jornal);
+    }
+    // 等待期间开始了公开事务：待提交的批次属于事务，由事务提交时统一写入
+    if(ufs_unlikely(jornal->hold)) return 0;
+    jornal->committing = 1;
+
+    // 开始刷盘前推进批次号，此后进入ufs_jornal_sync的线程需要等待下一批次
+    batch = ulatomic_load_explicit_64(&jornal->batch, ulatomic_memory_order_relaxed);
+    ulatomic_store_explicit_64(&jornal->batch, batch + 1, ulatomic_memory_order_release);
+
+    // 先重新提交之前失败的批次
+    retry = jornal->cnum != 0;
+    if(retry) {
+        ec = _commit_frozen(jornal);
+        if(ufs_unlikely(ec)) goto do_return;
+    }
+    if(jornal->num) {
+        // 冻结待提交的批次
+        memcpy(jornal->cops, jornal->ops, ul_static_cast(size_t, jornal->num) * sizeof(ufs_jornal_op_t));
+        jornal->cnum = jornal->num;
+        jornal->cindex = jornal->index;
+        jornal->num = 0;
+        ufs_jornal_index_clear(&jornal->index);
+        ec = _commit_frozen(jornal);
+    } else if(!retry) {
+        // 没有需要写入的日志，只需要一次刷盘保证之前直接写入的数据落盘
+        ufs_jornal_unlock(jornal);
+        ec = _jornal_barrier(jornal);
+        ufs_jornal_lock_yield(jornal);
+    }
+    if(ufs_likely(ec == 0))
+        ulatomic_store_explicit_64(&jornal->durable, batch, ulatomic_memory_order_release);
+
+do_return:
+    jornal->committing = 0;
+    return ec;
+}
+// 依次查找待提交批次、公开事务移出的操作、提交中批次和提交中的大事务，返回区块内容，都不存在时返回NULL
+static const char* _jornal_lookup(const ufs_jornal_t* jornal, uint64_t bnum) {
+    int i = ufs_jornal_index_find(&jornal->index, jornal->ops, bnum);
+    if(i >= 0) return ul_reinterpret_cast(const char*, jornal->ops[i].buf);
+    if(jornal->held) {
+        const void* p = ufs_transcation_lookup(jornal->held, bnum);
+        if(p) return ul_reinterpret_cast(const char*, p);
+    }
+    i = ufs_jornal_index_find(&jornal->cindex, jornal->cops, bnum);
+    if(i >= 0) return ul_reinterpret_cast(const char*, jornal->cops[i].buf);
+    for(i = 0; i < jornal->lnum; ++i)
+        if(jornal->lops[i].bnum == bnum) return ul_reinterpret_cast(const char*, jornal->lops[i].buf);
+    return NULL;
+}
+// 公开事务期间待提交的批次已满：将其与ops一起移入held而不是提交（全部成功或全部失败，成功时转移区块的所有权）
+static int _hold_append(ufs_jornal_t* ufs_restrict jornal, const ufs_jornal_op_t* ufs_restrict ops, int num) {
     int ec, i;
-    ufs_jornal_merge_nolock(jornal);
-    ec = ufs_do_jornal(jornal->vfs, jornal->ops, jornal->num);
+    if(jornal->held == NULL) {
+        jornal->held = ul_reinterpret_cast(ufs_transcation_t*, ufs_malloc(sizeof(ufs_transcation_t)));
+        if(ufs_unlikely(jornal->held == NULL)) return UFS_ENOMEM;
+        ufs_transcation_init(jornal->held, jornal);
+    }
+    ec = ufs_transcation_reserve(jornal->held, jornal->num + num);
     if(ufs_unlikely(ec)) return ec;
-    for(i = jornal->num - 1; i >= 0; --i)
-        ufs_free(ufs_const_cast(void*, jornal->ops[i].buf));
+    for(i = 0; i < jornal->num; ++i)
+        ufs_transcation_put(jornal->held, jornal->ops + i);
     jornal->num = 0;
+    ufs_jornal_index_clear(&jornal->index);
+    for(i = 0; i < num; ++i)
+        ufs_transcation_put(jornal->held, ops + i);
     return 0;
 }
+// 为待提交的批次腾出位置：公开事务期间移入held，否则提交
+static int _make_room(ufs_jornal_t* jornal) {
+    return jornal->hold ? _hold_append(jornal, NULL, 0) : ufs_jornal_sync_nolock(jornal);
+}
 static int ufs_jornal_read_block_nolock(ufs_jornal_t* ufs_restrict jornal, void* ufs_restrict buf, uint64_t bnum) {
-    int i;
-    for(i = jornal->num - 1; i >= 0; --i)
-        if(jornal->ops[i].bnum == bnum) {
-            memcpy(buf, jornal->ops[i].buf, UFS_BLOCK_SIZE);
-            return 0;
-        }
+    const char* p = _jornal_lookup(jornal, bnum);
+    if(p) {
+        memcpy(buf, p, UFS_BLOCK_SIZE);
+        return 0;
+    }
     return ufs_vfs_pread_check(jornal->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
 }
-static int ufs_jornal_add_block_nolock(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, int flag) {
-    if(ufs_unlikely(jornal->num == UFS_JORNAL_NUM)) {
-        int ec = ufs_jornal_sync_nolock(jornal);
+static int ufs_jornal_add_block_nolock(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, int flag, size_t off, size_t len) {
+    void* tmp;
+    // 提交期间会释放锁，其他线程可能再次填满待提交的批次
+    while(ufs_unlikely(jornal->num >= UFS_JORNAL_OP_MAX) && ufs_jornal_index_find(&jornal->index, jornal->ops, bnum) < 0) {
+        int ec = _make_room(jornal);
         if(ufs_unlikely(ec)) {
-            if(flag == UFS_JORNAL_ADD_MOVE) ufs_free(ufs_const_cast(void*, buf));
+            if(flag == UFS_JORNAL_ADD_MOVE) ufs_block_free(ufs_const_cast(void*, buf));
             return ec;
         }
     }
     switch(flag) {
     case UFS_JORNAL_ADD_COPY:
-        jornal->ops[jornal->num].buf = ufs_malloc(UFS_BLOCK_SIZE);
-        if(ufs_unlikely(jornal->ops[jornal->num].buf == NULL)) return UFS_ENOMEM;
-        memcpy(ufs_const_cast(void*, jornal->ops[jornal->num].buf), buf, UFS_BLOCK_SIZE);
+        tmp = ufs_block_alloc();
+        if(ufs_unlikely(tmp == NULL)) return UFS_ENOMEM;
+        memcpy(tmp, buf, UFS_BLOCK_SIZE);
+        _jornal_put(jornal, tmp, bnum, off, len);
         break;
     case UFS_JORNAL_ADD_MOVE:
-        jornal->ops[jornal->num].buf = buf;
+        _jornal_put(jornal, buf, bnum, off, len);
         break;
     default:
         return UFS_EINVAL;
     }
-    jornal->ops[jornal->num].bnum = bnum;
-    ++jornal->num;
+    _checkpointer_poke(jornal, 0);
     return 0;
 }
 static int ufs_jornal_add_nolock(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag) {
-    int ec;
+    int ec, i;
     char* tmp;
-    tmp = ul_reinterpret_cast(char*, ufs_malloc(UFS_BLOCK_SIZE));
+    // 先保证有空余位置再读取旧内容，避免提交期间释放锁时其他线程修改该区块
+    for(;;) {
+        i = ufs_jornal_index_find(&jornal->index, jornal->ops, bnum);
+        if(i >= 0) {
+            // 区块已在待提交的日志中，直接修改其内容
+            memcpy(ufs_const_cast(char*, jornal->ops[i].buf) + off, buf, len);
+            ufs_jornal_op_widen(jornal->ops + i, off, len);
+            ec = 0;
+            goto do_return;
+        }
+        if(ufs_likely(jornal->num < UFS_JORNAL_OP_MAX)) break;
+        ec = _make_room(jornal);
+        if(ufs_unlikely(ec)) goto do_return;
+    }
+    tmp = ul_reinterpret_cast(char*, ufs_block_alloc());
     if(ufs_unlikely(tmp == NULL)) { ec = UFS_ENOMEM; goto do_return; }
     ec = ufs_jornal_read_block_nolock(jornal, tmp, bnum);
-    if(ufs_unlikely(ec)) { ufs_free(tmp); goto do_return; }
+    if(ufs_unlikely(ec)) { ufs_block_free(tmp); goto do_return; }
     memcpy(tmp + off, buf, len);
-    ec = ufs_jornal_add_block_nolock(jornal, tmp, bnum, UFS_JORNAL_ADD_MOVE);
+    _jornal_put(jornal, tmp, bnum, off, len);
+    _checkpointer_poke(jornal, 0);
 do_return:
-    if(flag == UFS_JORNAL_ADD_MOVE) ufs_free(ufs_const_cast(void*, buf));
+    if(flag == UFS_JORNAL_ADD_MOVE) ufs_block_free(ufs_const_cast(void*, buf));
     return ec;
 }
+// 超过一个批次的事务：先提交之前的修改，再将事务整体写为多条记录组成的提交（失败时区块仍归调用者所有）
+static int _append_large(ufs_jornal_t* ufs_restrict jornal, ufs_jornal_op_t* ufs_restrict ops, int num) {
+    int ec, i;
+    uint64_t used;
+
+    while(jornal->committing || jornal->num || jornal->cnum) {
+        if(jornal->committing) {
+            ufs_jornal_unlock(jornal);
+            ufs_thread_yield();
+            ufs_jornal_lock_yield(jornal);
+            continue;
+        }
+        ec = ufs_jornal_sync_nolock(jornal);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    jornal->committing = 1;
+    jornal->lops = ops;
+    jornal->lnum = num;
+
+    ufs_jornal_unlock(jornal);
+    ufs_jornal_ring_lock(jornal);
+    ec = ufs_do_jornal(jornal, ops, num);
+    used = jornal->used;
+    ufs_jornal_ring_unlock(jornal);
+    ufs_jornal_lock_yield(jornal);
+
+    jornal->lops = NULL;
+    jornal->lnum = 0;
+    jornal->committing = 0;
+    if(ufs_unlikely(ec)) return ec;
+    for(i = num - 1; i >= 0; --i)
+        ufs_block_free(ufs_const_cast(void*, ops[i].buf));
+    _checkpointer_poke(jornal, used);
+    return 0;
+}
 static int ufs_jornal_append_nolock(ufs_jornal_t* ufs_restrict jornal, ufs_jornal_op_t* ufs_restrict ops, int num) {
-    if(jornal->num + num > UFS_JORNAL_NUM) {
-        int ec = ufs_jornal_sync_nolock(jornal);
+    int i;
+    if(jornal->hold) {
+        // 公开事务期间不提交，事务结束时随held一起写入
+        if(jornal->num + num > UFS_JORNAL_OP_MAX) return _hold_append(jornal, ops, num);
+    } else if(num > UFS_JORNAL_OP_MAX) return _append_large(jornal, ops, num);
+    while(jornal->num + num > UFS_JORNAL_OP_MAX) {
+        int ec = _make_room(jornal);
         if(ufs_unlikely(ec)) return ec;
     }
-    memcpy(jornal->ops + jornal->num, ops, ul_static_cast(size_t, num) * sizeof(ops[0]));
-    jornal->num += num;
-    _jornal_merge(jornal, jornal->num - num);
+    for(i = 0; i < num; ++i)
+        _jornal_put(jornal, ops[i].buf, ops[i].bnum, ops[i].off, ops[i].len);
+    _checkpointer_poke(jornal, 0);
     return 0;
 }
 
-static void ufs_jornal_lock(ufs_jornal_t* jornal) { ulatomic_spinlock_lock(&jornal->lock); }
-static void ufs_jornal_unlock(ufs_jornal_t* jornal) { ulatomic_spinlock_unlock(&jornal->lock); }
-
-UFS_HIDDEN void ufs_jornal_merge(ufs_jornal_t* jornal) {
-    ufs_jornal_lock(jornal);
-    ufs_jornal_merge_nolock(jornal);
-    ufs_jornal_unlock(jornal);
-}
 UFS_HIDDEN int ufs_jornal_read_block(ufs_jornal_t* ufs_restrict jornal, void* ufs_restrict buf, uint64_t bnum) {
-    int i;
+    const char* p;
     ulatomic_spinlock_lock(&jornal->lock);
-    for(i = jornal->num - 1; i >= 0; --i)
-        if(jornal->ops[i].bnum == bnum) {
-            memcpy(buf, jornal->ops[i].buf, UFS_BLOCK_SIZE);
-            ulatomic_spinlock_unlock(&jornal->lock);
-            return 0;
-        }
+    p = _jornal_lookup(jornal, bnum);
+    if(p) {
+        memcpy(buf, p, UFS_BLOCK_SIZE);
+        ulatomic_spinlock_unlock(&jornal->lock);
+        return 0;
+    }
     ulatomic_spinlock_unlock(&jornal->lock);
     return ufs_vfs_pread_check(jornal->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
 }
 UFS_HIDDEN int ufs_jornal_read(ufs_jornal_t* ufs_restrict jornal, void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len) {
-    int i;
+    const char* p;
     ulatomic_spinlock_lock(&jornal->lock);
-    for(i = jornal->num - 1; i >= 0; --i)
-        if(jornal->ops[i].bnum == bnum) {
-            memcpy(buf, ul_reinterpret_cast(const char*, jornal->ops[i].buf) + off, len);
-            ulatomic_spinlock_unlock(&jornal->lock);
-            return 0;
-        }
+    p = _jornal_lookup(jornal, bnum);
+    if(p) {
+        memcpy(buf, p + off, len);
+        ulatomic_spinlock_unlock(&jornal->lock);
+        return 0;
+    }
     ulatomic_spinlock_unlock(&jornal->lock);
     return ufs_vfs_pread_check(jornal->vfs, buf, len, ufs_vfs_offset2(bnum, off));
 }
-UFS_HIDDEN int ufs_jornal_sync(ufs_jornal_t* jornal) {
-    int ec;
-    ufs_jornal_lock(jornal);
+#define UFS_JORNAL_GATHER_ROUND 16 // 领导者收集提交时最多让出时间片的次数
+UFS_HIDDEN int ufs_jornal_flush(ufs_jornal_t* jornal) {
+    int ec, waiters, round;
+    // 在获取锁之前记录批次号：在此之前提交的日志一定属于该批次或更早的批次
+    const ulatomic64_raw_t batch = ulatomic_load_explicit_64(&jornal->batch, ulatomic_memory_order_acquire);
+
+    ufs_jornal_lock_yield(jornal);
+    // 公开事务期间推迟同步，由事务提交时统一写入
+    if(jornal->hold) {
+        ufs_jornal_unlock(jornal);
+        return 0;
+    }
+    if(jornal->flushing) {
+        // 已有领导者，作为跟随者等待
+        ++jornal->waiters;
+        do {
+            ufs_jornal_unlock(jornal);
+            ufs_thread_yield();
+            ufs_jornal_lock_yield(jornal);
+        } while(jornal->flushing && ulatomic_load_explicit_64(&jornal->durable, ulatomic_memory_order_acquire) < batch);
+        --jornal->waiters;
+    }
+    // 等待期间其他线程已经完成了覆盖该批次的刷盘
+    if(ulatomic_load_explicit_64(&jornal->durable, ulatomic_memory_order_acquire) >= batch) {
+        ufs_jornal_unlock(jornal);
+        return 0;
+    }
+
+    // 成为领导者，有其他线程在等待时才收集同时到达的提交
+    jornal->flushing = 1;
+    round = 0;
+    while(jornal->waiters != 0 && round++ < UFS_JORNAL_GATHER_ROUND) {
+        waiters = jornal->waiters;
+        ufs_jornal_unlock(jornal);
+        ufs_thread_yield();
+        ufs_jornal_lock_yield(jornal);
+        if(jornal->waiters == waiters) break;
+    }
+
     ec = ufs_jornal_sync_nolock(jornal);
+    jornal->flushing = 0;
     ufs_jornal_unlock(jornal);
     return ec;
 }
+// 是否已到UFS_DURABILITY_PERIODIC的刷盘时间（同时到达的线程只有一个返回1）
+static int _periodic_due(ufs_jornal_t* jornal) {
+    const ulatomic64_raw_t now = ul_static_cast(ulatomic64_raw_t, ufs_time(0));
+    ulatomic64_raw_t last = ulatomic_load_explicit_64(&jornal->sync_last, ulatomic_memory_order_relaxed);
+    if(now >= last && now - last < ul_static_cast(ulatomic64_raw_t, jornal->sync_interval)) return 0;
+    return ulatomic_compare_exchange_weak_64(&jornal->sync_last, &last, now);
+}
+UFS_HIDDEN int ufs_jornal_sync(ufs_jornal_t* jornal) {
+    switch(jornal->durability) {
+    case UFS_DURABILITY_PERIODIC:
+        // 修改保留在待提交的日志中，由后台检查点或之后的同步按时间间隔提交
+        return _periodic_due(jornal) ? ufs_jornal_flush(jornal) : 0;
+    default:
+        return ufs_jornal_flush(jornal);
+    }
+}
+UFS_HIDDEN int ufs_jornal_sync_data(ufs_jornal_t* jornal) {
+    switch(jornal->durability) {
+    case UFS_DURABILITY_ORDERED:
+        return ufs_vfs_datasync(jornal->vfs);
+    case UFS_DURABILITY_PERIODIC:
+        return _periodic_due(jornal) ? ufs_jornal_flush(jornal) : 0;
+    case UFS_DURABILITY_NONE:
+        return 0;
+    default:
+        return ufs_vfs_sync(jornal->vfs);
+    }
+}
+#define UFS_JORNAL_SYNC_INTERVAL 1000 // UFS_DURABILITY_PERIODIC的默认刷盘间隔（毫秒）
+UFS_HIDDEN int ufs_jornal_set_durability(ufs_jornal_t* jornal, int durability, uint32_t sync_interval) {
+    if(ufs_unlikely(durability < UFS_DURABILITY_STRICT || durability > UFS_DURABILITY_NONE)) return UFS_EINVAL;
+    jornal->durability = durability;
+    jornal->sync_interval = sync_interval ? sync_interval : UFS_JORNAL_SYNC_INTERVAL;
+    ulatomic_store_explicit_64(&jornal->sync_last, ul_static_cast(ulatomic64_raw_t, ufs_time(0)), ulatomic_memory_order_relaxed);
+    return 0;
+}
 UFS_HIDDEN int ufs_jornal_add(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag) {
     int ec;
     ufs_jornal_lock(jornal);
@@ -286,7 +1222,7 @@ UFS_HIDDEN int ufs_jornal_add(ufs_jornal_t* ufs_restrict jornal, const void* ufs
 UFS_HIDDEN int ufs_jornal_add_block(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, int flag) {
     int ec;
     ufs_jornal_lock(jornal);
-    ec = ufs_jornal_add_block_nolock(jornal, buf, bnum, flag);
+    ec = ufs_jornal_add_block_nolock(jornal, buf, bnum, flag, 0, UFS_BLOCK_SIZE);
     ufs_jornal_unlock(jornal);
     return ec;
 }
@@ -297,3 +1233,188 @@ UFS_HIDDEN int ufs_jornal_append(ufs_jornal_t* ufs_restrict jornal, ufs_jornal_o
     ufs_jornal_unlock(jornal);
     return ec;
 }
+UFS_HIDDEN int ufs_jornal_hold(ufs_jornal_t* jornal) {
+    int ec = 0;
+    ufs_jornal_lock_yield(jornal);
+    if(jornal->hold) { ec = UFS_EAGAIN; goto do_return; }
+    // 先提交之前的修改，中止时只丢弃事务中的修改
+    if(jornal->num || jornal->cnum) {
+        ec = ufs_jornal_sync_nolock(jornal);
+        if(ufs_unlikely(ec)) goto do_return;
+    }
+    jornal->hold = 1;
+do_return:
+    ufs_jornal_unlock(jornal);
+    return ec;
+}
+UFS_HIDDEN int ufs_jornal_unhold(ufs_jornal_t* jornal, int discard) {
+    int ec = 0, i;
+    ufs_transcation_t* held;
+    ufs_jornal_lock_yield(jornal);
+    held = jornal->held;
+    if(discard) {
+        for(i = jornal->num - 1; i >= 0; --i)
+            ufs_block_free(ufs_const_cast(void*, jornal->ops[i].buf));
+        jornal->num = 0;
+        ufs_jornal_index_clear(&jornal->index);
+        jornal->held = NULL;
+        jornal->hold = 0;
+    } else if(held) {
+        // 待提交的批次并入held，整体写为多条记录组成的提交（提交期间由lops提供查找）
+        ec = _hold_append(jornal, NULL, 0);
+        if(ufs_likely(ec == 0)) {
+            jornal->held = NULL;
+            jornal->hold = 0;
+            ec = ufs_jornal_append_nolock(jornal, held->ops, held->num);
+            if(ufs_likely(ec == 0)) held->num = 0; // 区块已经转移或释放
+        }
+        if(ufs_unlikely(ec)) {
+            jornal->held = held;
+            jornal->hold = 1;
+            held = NULL;
+        }
+    } else jornal->hold = 0;
+    ufs_jornal_unlock(jornal);
+    if(held) {
+        ufs_transcation_deinit(held);
+        ufs_free(held);
+    }
+    return ec;
+}
+UFS_HIDDEN int ufs_jornal_checkpoint(ufs_jornal_t* jornal) {
+    int ec;
+    ufs_jornal_ring_lock(jornal);
+    ec = ufs_jornal_checkpoint_nolock(jornal);
+    ufs_jornal_ring_unlock(jornal);
+    return ec;
+}
+UFS_HIDDEN int ufs_jornal_reuse(ufs_jornal_t* jornal, uint64_t bnum) {
+    int ec = 0, pending;
+    // 旧内容还在内存中的批次里时，先将其写入日志区，再由检查点写回（否则会在之后覆盖直接写入的数据）
+    ufs_jornal_lock(jornal);
+    pending = _jornal_lookup(jornal, bnum) != NULL;
+    ufs_jornal_unlock(jornal);
+    if(pending) {
+        ec = ufs_jornal_flush(jornal);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    ufs_jornal_ring_lock(jornal);
+    if(_window_find(jornal, bnum)) ec = ufs_jornal_checkpoint_nolock(jornal);
+    ufs_jornal_ring_unlock(jornal);
+    return ec;
+}
+UFS_HIDDEN int ufs_jornal_tracks(ufs_jornal_t* jornal, uint64_t bnum) {
+    int ret;
+    // 先查找内存中的批次：区块在提交完成后才会从批次中移除，此时已经在日志区中
+    ufs_jornal_lock(jornal);
+    ret = _jornal_lookup(jornal, bnum) != NULL;
+    ufs_jornal_unlock(jornal);
+    if(ret) return 1;
+    ufs_jornal_ring_lock(jornal);
+    ret = _window_find(jornal, bnum);
+    ufs_jornal_ring_unlock(jornal);
+    return ret;
+}
+
+UFS_HIDDEN uint64_t ufs_jornal_batch(ufs_jornal_t* jornal) {
+    return ul_static_cast(uint64_t, ulatomic_load_explicit_64(&jornal->batch, ulatomic_memory_order_acquire));
+}
+UFS_HIDDEN int ufs_jornal_durable(ufs_jornal_t* jornal, uint64_t batch) {
+    return ul_static_cast(uint64_t, ulatomic_load_explicit_64(&jornal->durable, ulatomic_memory_order_acquire)) >= batch;
+}
+UFS_HIDDEN int ufs_jornal_fast_commit(ufs_jornal_t* ufs_restrict jornal, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len) {
+    int ec;
+    uint64_t used;
+    ufs_jornal_op_t op;
+    char* tmp = ul_reinterpret_cast(char*, ufs_block_alloc());
+    if(ufs_unlikely(tmp == NULL)) return UFS_ENOMEM;
+    memcpy(tmp + off, buf, len);
+    op.bnum = bnum;
+    op.buf = tmp;
+    op.off = ul_static_cast(uint16_t, off);
+    op.len = ul_static_cast(uint16_t, len);
+
+    ufs_jornal_lock_yield(jornal);
+    // 公开事务期间推迟，inode已在待提交的日志中，随事务一起提交
+    if(jornal->hold) {
+        ufs_jornal_unlock(jornal);
+        ec = 0;
+        goto do_return;
+    }
+    // 等待正在提交的批次写入完成，保证其中的旧内容排在快速提交之前
+    while(jornal->committing) {
+        ufs_jornal_unlock(jornal);
+        ufs_thread_yield();
+        ufs_jornal_lock_yield(jornal);
+    }
+    if(ufs_unlikely(jornal->cnum)) {
+        // 重新提交时旧内容会排在快速提交之后，只能完整提交
+        ec = ufs_jornal_sync_nolock(jornal);
+        ufs_jornal_unlock(jornal);
+        goto do_return;
+    }
+    jornal->committing = 1;
+    ufs_jornal_unlock(jornal);
+
+    ufs_jornal_ring_lock(jornal);
+    ec = ufs_do_jornal(jornal, &op, 1);
+    used = jornal->used;
+    ufs_jornal_ring_unlock(jornal);
+
+    ufs_jornal_lock_yield(jornal);
+    jornal->committing = 0;
+    if(ufs_likely(ec == 0)) _checkpointer_poke(jornal, used);
+    ufs_jornal_unlock(jornal);
+
+do_return:
+    ufs_block_free(tmp);
+    return ec;
+}
+
+static void _checkpointer(void* opaque) {
+    int ec, num, hold;
+    ufs_jornal_t* jornal = ul_reinterpret_cast(ufs_jornal_t*, opaque);
+    const uint32_t timeout = jornal->ckpt_interval ? jornal->ckpt_interval : UFS_EVENT_INFINITE;
+
+    for(;;) {
+        ufs_event_wait(&jornal->ckpt_event, timeout);
+        ufs_jornal_lock_yield(jornal);
+        if(jornal->ckpt_state == _CKPT_STOP) {
+            jornal->ckpt_state = _CKPT_NONE;
+            ufs_jornal_unlock(jornal);
+            break;
+        }
+        num = jornal->num + jornal->cnum;
+        hold = jornal->hold;
+        ufs_jornal_unlock(jornal);
+
+        // 出错时日志仍保留在内存/日志区中，前台下一次同步会重新尝试并报告错误
+        // UFS_DURABILITY_PERIODIC时即使没有日志也需要刷盘直接写入的数据
+        // 公开事务期间只写回日志区中已经提交的部分
+        ec = !hold && (num || jornal->durability == UFS_DURABILITY_PERIODIC) ? ufs_jornal_flush(jornal) : 0;
+        if(ufs_likely(ec == 0)) ufs_jornal_checkpoint(jornal); // 日志区为空时不做任何事
+    }
+}
+UFS_HIDDEN int ufs_jornal_start_checkpointer(ufs_jornal_t* ufs_restrict jornal, ufs_threadpool_t* ufs_restrict pool, uint32_t interval, uint32_t threshold) {
+    int ec;
+    if(interval == 0 && threshold == 0) return 0;
+    ec = ufs_event_init(&jornal->ckpt_event);
+    if(ufs_unlikely(ec)) return ec;
+    jornal->ckpt_interval = interval;
+    jornal->ckpt_threshold = ufs_min(threshold, 100);
+    jornal->ckpt_state = _CKPT_RUNNING;
+    ec = ufs_threadpool_push(pool, _checkpointer, jornal);
+    if(ufs_unlikely(ec)) {
+        jornal->ckpt_state = _CKPT_NONE;
+        ufs_event_deinit(&jornal->ckpt_event);
+    }
+    return ec;
+}
+UFS_HIDDEN void ufs_jornal_stop_checkpointer(ufs_jornal_t* jornal) {
+    int running;
+    ufs_jornal_lock_yield(jornal);
+    running = jornal->ckpt_state == _CKPT_RUNNING;
+    if(running) jornal->ckpt_state = _CKPT_STOP;
+    ufs_jornal_unlock(jornal);
+    if(running) ufs_event_notify(&jornal->ckpt_event);
+}
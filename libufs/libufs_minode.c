@@ -17,6 +17,7 @@ static void _trans_inode(ufs_inode_t* dest, const ufs_inode_t* src) {
 
     for(int i = 0; i < 16; ++i)
         dest->zones[i] = ul_trans_u64_le(src->zones[i]);
+    dest->orphan = ul_trans_u64_le(src->orphan);
 }
 
 // 从inum中读取inode信息
@@ -33,20 +34,18 @@ do_return:
 }
 // 将inode提交到事务中
 static int _write_inode(ufs_transcation_t* transcation, ufs_inode_t* inode, uint64_t inum) {
-    ufs_inode_t* d = ul_reinterpret_cast(ufs_inode_t*, ufs_malloc(UFS_INODE_DISK_SIZE));
-    if(ufs_unlikely(d == NULL)) return UFS_ENOMEM;
+    uint64_t d[UFS_INODE_DISK_SIZE / 8];
     memset(ul_reinterpret_cast(char*, d) + UFS_INODE_MEMORY_SIZE, 0, UFS_INODE_DISK_SIZE - UFS_INODE_MEMORY_SIZE);
-    _trans_inode(d, inode);
+    _trans_inode(ul_reinterpret_cast(ufs_inode_t*, d), inode);
     return ufs_transcation_add(transcation, d, inum / UFS_INODE_PER_BLOCK,
-        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE, UFS_JORNAL_ADD_MOVE);
+        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE, UFS_JORNAL_ADD_COPY);
 }
 UFS_HIDDEN int _write_inode_direct(ufs_jornal_t* jornal, ufs_inode_t* inode, uint64_t inum) {
-    ufs_inode_t* d = ul_reinterpret_cast(ufs_inode_t*, ufs_malloc(UFS_INODE_DISK_SIZE));
-    if(ufs_unlikely(d == NULL)) return UFS_ENOMEM;
+    uint64_t d[UFS_INODE_DISK_SIZE / 8];
     memset(ul_reinterpret_cast(char*, d) + UFS_INODE_MEMORY_SIZE, 0, UFS_INODE_DISK_SIZE - UFS_INODE_MEMORY_SIZE);
-    _trans_inode(d, inode);
+    _trans_inode(ul_reinterpret_cast(ufs_inode_t*, d), inode);
     return ufs_jornal_add(jornal, d, inum / UFS_INODE_PER_BLOCK,
-        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE, UFS_JORNAL_ADD_MOVE);
+        (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE, UFS_INODE_DISK_SIZE, UFS_JORNAL_ADD_COPY);
 }
 
 
@@ -121,14 +120,26 @@ static int _seek_zone(ufs_minode_t* inode, uint64_t block, uint64_t* pznum) {
 }
 
 
-// 写回zlist和inode，并提交事务
+// 分配目标：紧接在文件中前一个区块（prev）之后，没有时由inode编号决定，使同时写入的文件彼此分开
+static uint64_t _zone_goal(const ufs_minode_t* inode, uint64_t prev) {
+    if(prev != 0) return prev + 1;
+    return ufs_zlist_goal(&inode->ufs->zlist, inode->inum);
+}
+
+// 记录快速提交无法表示的修改（分配或释放区块、经过日志的文件数据），在其持久化之前只能完整提交
+static void _fc_mark(ufs_minode_t* inode) {
+    inode->fc_batch = ufs_jornal_batch(&inode->ufs->jornal);
+}
+
+// 写回区块缓存（及zlist）和inode，并提交事务
 static int __end_zlist(ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation) {
     int ec;
-    ec = ufs_zlist_sync(&inode->ufs->zlist);
+    ec = ufs_zcache_sync(&inode->ufs->zcache);
     if(ufs_unlikely(ec)) return ec;
     ec = _write_inode(transcation, &inode->inode, inode->inum);
     if(ufs_unlikely(ec)) return ec;
     ec = ufs_transcation_commit_all(transcation);
+    _fc_mark(inode);
     return ec;
 }
 
@@ -138,9 +149,9 @@ static int __prealloc_zone1(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     if(inode->inode.zones[zk] != 0) { *pblock = inode->inode.zones[zk]; return 0; }
 
     ufs_transcation_init(&transcation, &ufs->jornal);
-    ufs_zlist_lock(&ufs->zlist, &transcation);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
 
-    ec = ufs_zlist_pop(&ufs->zlist, &inode->inode.zones[zk]);
+    ec = ufs_zcache_pop(&ufs->zcache, _zone_goal(inode, inode->inode.zones[zk - 1]), &inode->inode.zones[zk]);
     if(ufs_unlikely(ec)) goto do_return;
     ec = ufs_transcation_add_zero_block(&transcation, inode->inode.zones[zk]);
     if(ufs_unlikely(ec)) goto fail_to_alloc;
@@ -150,12 +161,12 @@ static int __prealloc_zone1(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     goto do_return;
 
 fail_to_alloc:
-    ufs_zlist_rollback(&ufs->zlist);
+    ufs_zcache_rollback(&ufs->zcache);
     inode->inode.zones[zk] = 0;
 
 do_return:
     *pblock = inode->inode.zones[zk];
-    ufs_zlist_unlock(&ufs->zlist);
+    ufs_zcache_unlock(&ufs->zcache);
     ufs_transcation_deinit(&transcation);
     return ec;
 }
@@ -165,11 +176,11 @@ static int __prealloc_zone2(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     uint64_t oz[2], nz[2] = { 0 };
 
     ufs_transcation_init(&transcation, &ufs->jornal);
-    ufs_zlist_lock(&ufs->zlist, &transcation);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
 
     nz[0] = oz[0] = inode->inode.zones[zk];
     if(oz[0] == 0) {
-        ec = ufs_zlist_pop(&ufs->zlist, nz + 0);
+        ec = ufs_zcache_pop(&ufs->zcache, _zone_goal(inode, inode->inode.zones[zk - 1]), nz + 0);
         if(ufs_unlikely(ec)) goto do_return;
         ++inode->inode.blocks;
         ec = ufs_transcation_add_zero_block(&transcation, nz[0]);
@@ -182,7 +193,7 @@ static int __prealloc_zone2(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     }
 
     if(oz[1] == 0) {
-        ec = ufs_zlist_pop(&ufs->zlist, nz + 1);
+        ec = ufs_zcache_pop(&ufs->zcache, nz[0] + 1, nz + 1);
         if(ufs_unlikely(ec)) goto fail_to_alloc;
         ++inode->inode.blocks;
         nz[1] = ul_trans_u64_le(nz[1]);
@@ -197,14 +208,14 @@ static int __prealloc_zone2(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     goto do_return;
 
 fail_to_alloc:
-    ufs_zlist_rollback(&ufs->zlist);
+    ufs_zcache_rollback(&ufs->zcache);
     inode->inode.blocks -= ul_static_cast(uint64_t, (!oz[0] && nz[0]) + (!oz[1] && nz[1]));
     nz[0] = 0; nz[1] = 0;
 
 do_return:
     inode->inode.zones[zk] = nz[0];
     *pblock = nz[1];
-    ufs_zlist_unlock(&ufs->zlist);
+    ufs_zcache_unlock(&ufs->zcache);
     ufs_transcation_deinit(&transcation);
     return ec;
 }
@@ -214,11 +225,11 @@ static int __prealloc_zone3(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     uint64_t oz[3], nz[3] = { 0 };
 
     ufs_transcation_init(&transcation, &ufs->jornal);
-    ufs_zlist_lock(&ufs->zlist, &transcation);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
 
     nz[0] = oz[0] = inode->inode.zones[zk];
     if(oz[0] == 0) {
-        ec = ufs_zlist_pop(&ufs->zlist, nz + 0);
+        ec = ufs_zcache_pop(&ufs->zcache, _zone_goal(inode, inode->inode.zones[zk - 1]), nz + 0);
         if(ufs_unlikely(ec)) goto do_return;
         ++inode->inode.blocks;
         ec = ufs_transcation_add_zero_block(&transcation, nz[0]);
@@ -231,7 +242,7 @@ static int __prealloc_zone3(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     }
 
     if(oz[1] == 0) {
-        ec = ufs_zlist_pop(&ufs->zlist, nz + 1);
+        ec = ufs_zcache_pop(&ufs->zcache, nz[0] + 1, nz + 1);
         if(ufs_unlikely(ec)) goto fail_to_alloc;
         ++inode->inode.blocks;
         nz[1] = ul_trans_u64_le(nz[1]);
@@ -248,7 +259,7 @@ static int __prealloc_zone3(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     }
 
     if(oz[2] == 0) {
-        ec = ufs_zlist_pop(&ufs->zlist, nz + 2);
+        ec = ufs_zcache_pop(&ufs->zcache, nz[1] + 1, nz + 2);
         if(ufs_unlikely(ec)) goto fail_to_alloc;
         ++inode->inode.blocks;
         nz[2] = ul_trans_u64_le(nz[2]);
@@ -263,14 +274,14 @@ static int __prealloc_zone3(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restric
     goto do_return;
 
 fail_to_alloc:
-    ufs_zlist_rollback(&ufs->zlist);
+    ufs_zcache_rollback(&ufs->zcache);
     inode->inode.blocks -= ul_static_cast(uint64_t, (!oz[0] && nz[0]) + (!oz[1] && nz[1]) + (!oz[2] && nz[2]));
     nz[0] = 0; nz[2] = 0;
 
 do_return:
     inode->inode.zones[zk] = nz[0];
     *pblock = nz[2];
-    ufs_zlist_unlock(&ufs->zlist);
+    ufs_zcache_unlock(&ufs->zcache);
     ufs_transcation_deinit(&transcation);
     return ec;
 }
@@ -299,9 +310,9 @@ static int __alloc_zone_0(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restrict
     if(inode->inode.zones[block]) { *pznum = inode->inode.zones[block]; return 0; }
 
     ufs_transcation_init(&transcation, &ufs->jornal);
-    ufs_zlist_lock(&ufs->zlist, &transcation);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
 
-    ec = ufs_zlist_pop(&ufs->zlist, &inode->inode.zones[block]);
+    ec = ufs_zcache_pop(&ufs->zcache, _zone_goal(inode, block > 0 ? inode->inode.zones[block - 1] : 0), &inode->inode.zones[block]);
     if(ufs_unlikely(ec)) goto do_return;
     ec = __end_zlist(inode, &transcation);
     if(ufs_unlikely(ec)) goto fail_to_alloc;
@@ -310,16 +321,19 @@ static int __alloc_zone_0(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restrict
     goto do_return;
 
 fail_to_alloc:
-    ufs_zlist_rollback(&ufs->zlist);
+    ufs_zcache_rollback(&ufs->zcache);
     inode->inode.zones[block] = 0;
 
 do_return:
-    ufs_zlist_unlock(&ufs->zlist);
+    ufs_zcache_unlock(&ufs->zcache);
     ufs_transcation_deinit(&transcation);
+    // 提交之后、释放锁之后再检查日志：弹出的zlist节点块需要等zlist的修改持久化之后才能直接写入，
+    // 检查点期间其他线程不必等待分配器的锁
+    if(ufs_likely(ec == 0)) ec = ufs_jornal_reuse(&ufs->jornal, *pznum);
     return ec;
 }
 static int __alloc_zone_g(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restrict ufs, uint64_t block, uint64_t* ufs_restrict pznum) {
-    uint64_t tznum = 0, znum;
+    uint64_t tznum = 0, znum, prev;
     int ec;
     ufs_transcation_t transcation;
 
@@ -330,10 +344,17 @@ static int __alloc_zone_g(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restrict
     ec = ufs_jornal_read(&ufs->jornal, &znum, tznum, (block % UFS_ZONE_PER_BLOCK) * 8, 8);
     if(ufs_unlikely(ec)) return ec;
     if(znum != 0) { *pznum = ul_trans_u64_le(znum); return 0; }
+    // 同一张区块表中的前一项，位于表开头时以区块表本身为目标
+    prev = tznum;
+    if(block % UFS_ZONE_PER_BLOCK != 0) {
+        ec = ufs_jornal_read(&ufs->jornal, &prev, tznum, (block % UFS_ZONE_PER_BLOCK - 1) * 8, 8);
+        if(ufs_unlikely(ec)) return ec;
+        prev = ul_trans_u64_le(prev);
+    }
 
     ufs_transcation_init(&transcation, &ufs->jornal);
-    ufs_zlist_lock(&ufs->zlist, &transcation);
-    ec = ufs_zlist_pop(&ufs->zlist, &znum);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
+    ec = ufs_zcache_pop(&ufs->zcache, _zone_goal(inode, prev), &znum);
     if(ufs_unlikely(ec)) goto do_return;
     *pznum = znum;
     znum = ul_trans_u64_le(znum);
@@ -345,17 +366,153 @@ static int __alloc_zone_g(ufs_minode_t* ufs_restrict inode, ufs_t* ufs_restrict
     goto do_return;
 
 fail_to_alloc:
-    ufs_zlist_rollback(&ufs->zlist);
+    ufs_zcache_rollback(&ufs->zcache);
 
 do_return:
-    ufs_zlist_unlock(&ufs->zlist);
+    ufs_zcache_unlock(&ufs->zcache);
     ufs_transcation_deinit(&transcation);
+    if(ufs_likely(ec == 0)) ec = ufs_jornal_reuse(&ufs->jornal, *pznum); // 同__alloc_zone_0
     return ec;
 }
 static int _alloc_zone(ufs_minode_t* ufs_restrict inode, uint64_t block, uint64_t* ufs_restrict pznum) {
     if(block < 12) return __alloc_zone_0(inode, inode->ufs, block, pznum);
     else return __alloc_zone_g(inode, inode->ufs, block, pznum);
 }
+/**
+ * 为[block, block + n)中未分配的块分配区块，将块号写入znums，实际处理的块数写入*pn
+ *
+ * 一次只处理位于同一张区块表（直接块或同一个间接块）中的部分，空洞按段分配连续的区块，
+ * 整个调用只同步一次zlist、提交一次事务（间接块本身仍然由_prealloc_zone单独分配）。
+ * 区块不足时保留已经分配的部分，只有一块也没有分配时才返回UFS_ENOSPC。
+*/
+static int _alloc_zones(ufs_minode_t* ufs_restrict inode, uint64_t block, uint64_t n,
+        uint64_t* ufs_restrict znums, uint64_t* ufs_restrict pn) {
+    int ec;
+    ufs_t* ufs = inode->ufs;
+    ufs_transcation_t transcation;
+    uint64_t tznum = 0, k = 0, i, j, m, start, len, done, nalloc = 0, prev;
+    uint64_t old[12];
+    uint8_t fresh[UFS_ZONE_PER_BLOCK];
+
+    if(block < 12) {
+        n = ufs_min(n, 12 - block);
+        for(i = 0; i < n; ++i) znums[i] = inode->inode.zones[block + i];
+        memcpy(old, inode->inode.zones, sizeof(old));
+        prev = block > 0 ? inode->inode.zones[block - 1] : 0;
+    } else {
+        k = (block - 12) % UFS_ZONE_PER_BLOCK;
+        n = ufs_min(n, UFS_ZONE_PER_BLOCK - k);
+        ec = _prealloc_zone(inode, block, &tznum);
+        if(ufs_unlikely(ec)) return ec;
+        if(ufs_unlikely(tznum == 0)) return UFS_EOVERFLOW; // 超出三级间接块的范围
+        ec = ufs_jornal_read(&ufs->jornal, znums, tznum, k * 8, ul_static_cast(size_t, n) * 8);
+        if(ufs_unlikely(ec)) return ec;
+        for(i = 0; i < n; ++i) znums[i] = ul_trans_u64_le(znums[i]);
+        prev = tznum;
+        if(k != 0) {
+            ec = ufs_jornal_read(&ufs->jornal, &prev, tznum, (k - 1) * 8, 8);
+            if(ufs_unlikely(ec)) return ec;
+            prev = ul_trans_u64_le(prev);
+        }
+    }
+    for(i = 0; i < n && znums[i] != 0; ++i) { }
+    if(i == n) { *pn = n; return 0; }
+    memset(fresh, 0, ul_static_cast(size_t, n));
+
+    ufs_transcation_init(&transcation, &ufs->jornal);
+    ufs_zcache_lock(&ufs->zcache, &transcation);
+    for(done = n; i < n; ) {
+        if(znums[i] != 0) { ++i; continue; }
+        for(m = 1; i + m < n && znums[i + m] == 0; ++m) { }
+        ec = ufs_zcache_pop_extent(&ufs->zcache, _zone_goal(inode, i > 0 ? znums[i - 1] : prev), m, &start, &len);
+        if(ec == UFS_ENOSPC && i > 0) { done = i; ec = 0; break; }
+        if(ufs_unlikely(ec)) goto fail_to_alloc;
+        for(j = 0; j < len; ++j) znums[i + j] = start + j;
+        memset(fresh + i, 1, ul_static_cast(size_t, len));
+        inode->inode.blocks += len;
+        nalloc += len;
+        i += len;
+    }
+
+    if(block < 12) {
+        for(i = 0; i < done; ++i) inode->inode.zones[block + i] = znums[i];
+    } else {
+        for(i = 0; i < done; ++i) znums[i] = ul_trans_u64_le(znums[i]);
+        ec = ufs_transcation_add(&transcation, znums, tznum, k * 8, ul_static_cast(size_t, done) * 8, UFS_JORNAL_ADD_COPY);
+        for(i = 0; i < done; ++i) znums[i] = ul_trans_u64_le(znums[i]);
+        if(ufs_unlikely(ec)) goto fail_to_alloc;
+    }
+    ec = __end_zlist(inode, &transcation);
+    if(ufs_unlikely(ec)) goto fail_to_alloc;
+    *pn = done;
+    goto do_return;
+
+fail_to_alloc:
+    ufs_zcache_rollback(&ufs->zcache);
+    inode->inode.blocks -= nalloc;
+    if(block < 12) memcpy(inode->inode.zones, old, sizeof(old));
+
+do_return:
+    ufs_zcache_unlock(&ufs->zcache);
+    ufs_transcation_deinit(&transcation);
+    // 同__alloc_zone_0
+    for(i = 0; ufs_likely(ec == 0) && i < done; ++i)
+        if(fresh[i]) ec = ufs_jornal_reuse(&ufs->jornal, znums[i]);
+    return ec;
+}
+
+/**
+ * 延迟分配
+ *
+ * 缓冲区中的块都还没有分配区块，因此读取时只有未分配的块需要查找缓冲区；
+ * 立即分配区块的操作（不延迟的写入、预分配）之前先写回缓冲区，保持这一点成立。
+*/
+static int _delay_find(const ufs_minode_t* ufs_restrict inode, uint64_t block, uint32_t* ufs_restrict pi) {
+    uint32_t l = 0, r = inode->delay_num, m;
+    while(l < r) {
+        m = (l + r) / 2;
+        if(inode->delay_block[m] < block) l = m + 1;
+        else r = m;
+    }
+    *pi = l;
+    return l < inode->delay_num && inode->delay_block[l] == block;
+}
+static uint64_t _delay_free(ufs_t* ufs) {
+    uint64_t nfree;
+    ufs_zlist_lock(&ufs->zlist, NULL);
+    nfree = ufs->zlist.now.block;
+    ufs_zlist_unlock(&ufs->zlist);
+    return nfree + ufs_zcache_cached(&ufs->zcache);
+}
+// 为新的延迟块预留区块，空闲区块不足时返回0
+static int _delay_reserve(ufs_t* ufs) {
+    uint64_t delayed;
+    delayed = ul_static_cast(uint64_t, ulatomic_fetch_add_explicit_64(&ufs->delayed, 1, ulatomic_memory_order_relaxed)) + 1;
+    if(ufs_likely(delayed * UFS_DELAY_RESERVE + UFS_DELAY_MARGIN <= _delay_free(ufs))) return 1;
+    ulatomic_fetch_sub_explicit_64(&ufs->delayed, 1, ulatomic_memory_order_relaxed);
+    return 0;
+}
+// 立即分配是否不会占用延迟块预留的区块
+static int _delay_room(ufs_t* ufs) {
+    const uint64_t delayed = ul_static_cast(uint64_t, ulatomic_load_explicit_64(&ufs->delayed, ulatomic_memory_order_relaxed));
+    return delayed * UFS_DELAY_RESERVE < _delay_free(ufs);
+}
+// 从缓冲区中移除[from, to)，释放内容和预留
+static void _delay_remove(ufs_minode_t* inode, uint32_t from, uint32_t to) {
+    uint32_t i;
+    if(from == to) return;
+    for(i = from; i < to; ++i) ufs_block_free(inode->delay_data[i]);
+    memmove(inode->delay_block + from, inode->delay_block + to, (inode->delay_num - to) * sizeof(inode->delay_block[0]));
+    memmove(inode->delay_data + from, inode->delay_data + to, (inode->delay_num - to) * sizeof(inode->delay_data[0]));
+    inode->delay_num -= to - from;
+    ulatomic_fetch_sub_explicit_64(&inode->ufs->delayed, to - from, ulatomic_memory_order_relaxed);
+}
+// 丢弃块号不小于block的延迟块
+static void _delay_drop(ufs_minode_t* inode, uint64_t block) {
+    uint32_t i;
+    _delay_find(inode, block, &i);
+    _delay_remove(inode, i, inode->delay_num);
+}
 
 UFS_HIDDEN int ufs_minode_init(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_restrict inode, uint64_t inum) {
     int ec;
@@ -365,6 +522,19 @@ UFS_HIDDEN int ufs_minode_init(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_restri
     inode->inum = inum;
     ulatomic_spinlock_init(&inode->lock);
     inode->share = 1;
+    inode->delay_num = 0;
+    // 读到的inode可能还在日志中
+    inode->fc_base = inode->inode;
+    _fc_mark(inode);
+    return 0;
+}
+UFS_HIDDEN int ufs_minode_reload(ufs_minode_t* inode) {
+    int ec;
+    ec = _read_inode(inode->ufs, &inode->inode, inode->inum);
+    if(ufs_unlikely(ec)) return ec;
+    _delay_drop(inode, 0);
+    inode->fc_base = inode->inode;
+    _fc_mark(inode);
     return 0;
 }
 UFS_HIDDEN int ufs_minode_create(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_restrict inode, const ufs_inode_create_t* ufs_restrict creat) {
@@ -394,6 +564,7 @@ UFS_HIDDEN int ufs_minode_create(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_rest
     inode->inode.gid = creat->gid;
 
     memset(inode->inode.zones, 0, sizeof(inode->inode.zones));
+    inode->inode.orphan = 0;
     ec = _write_inode(&transcation, &inode->inode, inum);
     if(ufs_unlikely(ec)) goto fail_to_alloc;
 
@@ -403,6 +574,9 @@ UFS_HIDDEN int ufs_minode_create(ufs_t* ufs_restrict ufs, ufs_minode_t* ufs_rest
     inode->inum = inum;
     ulatomic_spinlock_init(&inode->lock);
     inode->share = 1;
+    inode->delay_num = 0;
+    inode->fc_base = inode->inode;
+    _fc_mark(inode);
     goto do_return;
 
 fail_to_alloc:
@@ -412,9 +586,11 @@ do_return:
     ufs_transcation_deinit(&transcation);
     return ec;
 }
+static int _orphan_release(ufs_minode_t* inode);
 UFS_HIDDEN int ufs_minode_deinit(ufs_minode_t* inode) {
-    int ec = 0;
+    int ec = 0, ec2;
     ufs_transcation_t transcation;
+    if(ufs_unlikely(inode->inode.nlink == 0) && inode->ufs->orphan.enabled) return _orphan_release(inode);
     ufs_transcation_init(&transcation, &inode->ufs->jornal);
     if(ufs_unlikely(inode->inode.nlink == 0)) {
         ec = ufs_minode_shrink(inode, 0);
@@ -428,103 +604,76 @@ UFS_HIDDEN int ufs_minode_deinit(ufs_minode_t* inode) {
         ufs_transcation_deinit(&transcation);
         return ec;
     } else {
-        ec = _write_inode(&transcation, &inode->inode, inode->inum);
-        if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+        // 写回失败的数据随minode一起丢弃，已经分配的区块仍然需要写入inode
+        ec = ufs_minode_flush(inode);
+        _delay_drop(inode, 0);
+        ec2 = _write_inode(&transcation, &inode->inode, inode->inum);
+        if(ufs_likely(ec2 == 0)) ec2 = ufs_transcation_commit_all(&transcation);
         ufs_transcation_deinit(&transcation);
-        return ec;
+        return ec ? ec : ec2;
     }
 }
 
 
+/**
+ * 不经过事务的文件数据读写
+ *
+ * data=journal模式（ufs->data_jornal不为0）或公开事务结束后检查点完成之前，文件数据可能仍在日志中，读取需要经过日志；
+ * 直接写入的区块如果在日志中还有旧内容（尚未写回或尚未检查点），旧内容会在之后覆盖新数据，因此也改为经过日志。
+*/
+static int _data_jornaled(ufs_minode_t* inode) {
+    return inode->ufs->data_jornal
+        || ulatomic_load_explicit_32(&inode->ufs->txn, ulatomic_memory_order_acquire) != UFS_TXN_NONE;
+}
 static int _trans_read(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     void* ufs_restrict buf, size_t len, uint64_t bnum, uint64_t off
 ) {
-    return transcation
-        ? ufs_transcation_read(transcation, buf, bnum, off, len)
-        : ufs_vfs_pread_check(inode->ufs->vfs, buf, len, ufs_vfs_offset2(bnum, off));
+    if(transcation) return ufs_transcation_read(transcation, buf, bnum, off, len);
+    if(_data_jornaled(inode)) return ufs_jornal_read(&inode->ufs->jornal, buf, bnum, off, len);
+    return ufs_vfs_pread_check(inode->ufs->vfs, buf, len, ufs_vfs_offset2(bnum, off));
 }
 static int _trans_read_block(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     void* ufs_restrict buf, uint64_t bnum
 ) {
-    return  transcation
-        ? ufs_transcation_read_block(transcation, buf, bnum)
-        : ufs_vfs_pread_check(inode->ufs->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
+    if(transcation) return ufs_transcation_read_block(transcation, buf, bnum);
+    if(_data_jornaled(inode)) return ufs_jornal_read_block(&inode->ufs->jornal, buf, bnum);
+    return ufs_vfs_pread_check(inode->ufs->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
 }
 
 static int _trans_write(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     const void* ufs_restrict buf, size_t len, uint64_t bnum, uint64_t off
 ) {
-    return transcation
-        ? ufs_transcation_add(transcation, buf, bnum, off, len, UFS_JORNAL_ADD_COPY)
-        : ufs_vfs_pwrite_check(inode->ufs->vfs, buf, len, ufs_vfs_offset2(bnum, off));
+    int ec;
+    if(transcation) return ufs_transcation_add(transcation, buf, bnum, off, len, UFS_JORNAL_ADD_COPY);
+    if(_data_jornaled(inode) && ufs_jornal_tracks(&inode->ufs->jornal, bnum)) {
+        ec = ufs_jornal_add(&inode->ufs->jornal, buf, bnum, off, len, UFS_JORNAL_ADD_COPY);
+        _fc_mark(inode);
+        return ec;
+    }
+    ec = ufs_vfs_pwrite_check(inode->ufs->vfs, buf, len, ufs_vfs_offset2(bnum, off));
+    if(ufs_likely(ec == 0)) ufs_jornal_data_written(&inode->ufs->jornal);
+    return ec;
 }
 static int _trans_write_block(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     const void* ufs_restrict buf, uint64_t bnum
-) {
-    return transcation
-        ? ufs_transcation_add_block(transcation, buf, bnum, UFS_JORNAL_ADD_COPY)
-        : ufs_vfs_pwrite_check(inode->ufs->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
-}
-
-
-static int _minode_pread(
-    ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
-    char* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pread
 ) {
     int ec;
-    uint64_t znum;
-    uint64_t block, boff;
-    size_t nread;
-    uint64_t rest_block;
-
-    block = off / UFS_BLOCK_SIZE;
-    boff = off % UFS_BLOCK_SIZE;
-    ec = _seek_zone(inode, block, &znum);
-    if(ufs_unlikely(ec)) return ec;
-    if(ufs_unlikely(znum == 0)) { *pread = 0; return 0; }
-    if(boff + len <= UFS_BLOCK_SIZE) {
-        ec = _trans_read(inode, transcation, buf, len, znum, boff);
-        if(ufs_unlikely(ec)) return ec;
-        *pread = len; return 0;
-    }
-    ec = _trans_read(inode, transcation, buf, UFS_BLOCK_SIZE - boff, znum, boff);
-    if(ufs_unlikely(ec)) return ec;
-    nread = UFS_BLOCK_SIZE - boff;
-    len -= nread;
-    buf += nread;
-
-    rest_block = len / UFS_BLOCK_SIZE;
-    while(rest_block--) {
-        ec = _seek_zone(inode, block++, &znum);
-        if(ufs_unlikely(ec || znum == 0)) { *pread = nread; return 0; }
-        ec = _trans_read_block(inode, transcation, buf, znum);
-        if(ufs_unlikely(ec)) return ec;
-        nread += UFS_BLOCK_SIZE;
-        len -= UFS_BLOCK_SIZE;
-        buf += UFS_BLOCK_SIZE;
-    }
-
-    if(len) {
-        ec = _seek_zone(inode, block, &znum);
-        if(ufs_unlikely(ec || znum == 0)) { *pread = nread; return 0; }
-        ec = _trans_read(inode, transcation, buf, len, znum, 0);
-        nread += len;
+    if(transcation) return ufs_transcation_add_block(transcation, buf, bnum, UFS_JORNAL_ADD_COPY);
+    if(_data_jornaled(inode) && ufs_jornal_tracks(&inode->ufs->jornal, bnum)) {
+        ec = ufs_jornal_add_block(&inode->ufs->jornal, buf, bnum, UFS_JORNAL_ADD_COPY);
+        _fc_mark(inode);
+        return ec;
     }
-    *pread = nread; return 0;
-}
-UFS_HIDDEN int ufs_minode_pread(
-    ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
-    void* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pread
-) {
-    if(off + len > inode->inode.size) len = inode->inode.size - off;
-    inode->inode.atime = ufs_time(0);
-    return _minode_pread(inode, transcation, ul_reinterpret_cast(char*, buf), len, off, pread);
+    ec = ufs_vfs_pwrite_check(inode->ufs->vfs, buf, UFS_BLOCK_SIZE, ufs_vfs_offset(bnum));
+    if(ufs_likely(ec == 0)) ufs_jornal_data_written(&inode->ufs->jornal);
+    return ec;
 }
 
+
 static int _minode_pwrite(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     const char* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pwriten
@@ -533,7 +682,8 @@ static int _minode_pwrite(
     uint64_t znum;
     uint64_t block, boff;
     size_t nwriten;
-    uint64_t rest_block;
+    uint64_t rest_block, i, cnt;
+    uint64_t znums[UFS_ZONE_PER_BLOCK];
 
     block = off / UFS_BLOCK_SIZE;
     boff = off % UFS_BLOCK_SIZE;
@@ -550,30 +700,213 @@ static int _minode_pwrite(
     len -= nwriten;
     buf += nwriten;
 
+    // 整块写入的部分按区块表一次分配
     rest_block = len / UFS_BLOCK_SIZE;
-    while(rest_block--) {
-        ec = _alloc_zone(inode, block++, &znum);
+    while(rest_block) {
+        ec = _alloc_zones(inode, block + 1, rest_block, znums, &cnt);
         if(ufs_unlikely(ec)) { *pwriten = nwriten; return 0; }
-        ec = _trans_write_block(inode, transcation, buf, znum);
-        if(ufs_unlikely(ec)) return ec;
-        nwriten += UFS_BLOCK_SIZE;
-        len -= UFS_BLOCK_SIZE;
-        buf += UFS_BLOCK_SIZE;
+        for(i = 0; i < cnt; ++i) {
+            ec = _trans_write_block(inode, transcation, buf, znums[i]);
+            if(ufs_unlikely(ec)) return ec;
+            nwriten += UFS_BLOCK_SIZE;
+            len -= UFS_BLOCK_SIZE;
+            buf += UFS_BLOCK_SIZE;
+        }
+        block += cnt;
+        rest_block -= cnt;
     }
 
     if(len) {
-        ec = _alloc_zone(inode, block, &znum);
+        ec = _alloc_zone(inode, ++block, &znum);
         if(ufs_unlikely(ec)) { *pwriten = nwriten; return 0; }
         ec = _trans_write(inode, transcation, buf, len, znum, 0);
+        if(ufs_unlikely(ec)) return ec;
         nwriten += len;
     }
     *pwriten = nwriten; return 0;
 }
+
+UFS_HIDDEN int ufs_minode_flush(ufs_minode_t* inode) {
+    int ec = 0;
+    uint32_t i, j;
+    uint64_t k, cnt;
+    uint64_t znums[UFS_ZONE_PER_BLOCK];
+    for(i = 0; i < inode->delay_num; i += ul_static_cast(uint32_t, cnt)) {
+        // 连续的块一次分配（_alloc_zones一次只处理同一张区块表中的部分）
+        for(j = i + 1; j < inode->delay_num && inode->delay_block[j] == inode->delay_block[j - 1] + 1; ++j) { }
+        ec = _alloc_zones(inode, inode->delay_block[i], j - i, znums, &cnt);
+        if(ufs_unlikely(ec)) break;
+        for(k = 0; k < cnt; ++k) {
+            ec = _trans_write_block(inode, NULL, inode->delay_data[i + k], znums[k]);
+            if(ufs_unlikely(ec)) break;
+        }
+        // 已经分配了区块的块不能留在缓冲区中
+        if(ufs_unlikely(ec)) { i += ul_static_cast(uint32_t, cnt); break; }
+    }
+    _delay_remove(inode, 0, i);
+    return ec;
+}
+// 写入块block中从boff开始的len字节（不跨块），未分配的块保存在缓冲区中
+static int _delay_write(
+    ufs_minode_t* ufs_restrict inode, const char* ufs_restrict buf, size_t len, uint64_t block, uint64_t boff
+) {
+    int ec;
+    uint32_t i;
+    uint64_t znum;
+    size_t nwriten;
+    char* data;
+    if(!_delay_find(inode, block, &i)) {
+        ec = _seek_zone(inode, block, &znum);
+        if(ufs_unlikely(ec)) return ec;
+        // 已经分配的块直接覆盖
+        if(znum != 0) return _minode_pwrite(inode, NULL, buf, len, block * UFS_BLOCK_SIZE + boff, &nwriten);
+        if(inode->delay_num == UFS_DELAY_MAX) {
+            ec = ufs_minode_flush(inode);
+            if(ufs_unlikely(ec)) return ec;
+            i = 0;
+        }
+        if(ufs_unlikely(!_delay_reserve(inode->ufs))) {
+            // 空闲区块不足时写回自己的块后立即分配，但不能占用其他文件预留的区块
+            ec = ufs_minode_flush(inode);
+            if(ufs_unlikely(ec)) return ec;
+            if(!_delay_room(inode->ufs)) return UFS_ENOSPC;
+            return _minode_pwrite(inode, NULL, buf, len, block * UFS_BLOCK_SIZE + boff, &nwriten);
+        }
+        data = ul_reinterpret_cast(char*, ufs_block_alloc());
+        if(ufs_unlikely(data == NULL)) {
+            ulatomic_fetch_sub_explicit_64(&inode->ufs->delayed, 1, ulatomic_memory_order_relaxed);
+            return UFS_ENOMEM;
+        }
+        memset(data, 0, UFS_BLOCK_SIZE);
+        memmove(inode->delay_block + i + 1, inode->delay_block + i, (inode->delay_num - i) * sizeof(inode->delay_block[0]));
+        memmove(inode->delay_data + i + 1, inode->delay_data + i, (inode->delay_num - i) * sizeof(inode->delay_data[0]));
+        inode->delay_block[i] = block;
+        inode->delay_data[i] = data;
+        ++inode->delay_num;
+    }
+    memcpy(inode->delay_data[i] + boff, buf, len);
+    return 0;
+}
+static int _minode_pwrite_delay(
+    ufs_minode_t* ufs_restrict inode, const char* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pwriten
+) {
+    int ec = 0;
+    size_t n, nwriten = 0;
+    uint64_t boff;
+    while(nwriten < len) {
+        boff = (off + nwriten) % UFS_BLOCK_SIZE;
+        n = ul_static_cast(size_t, ufs_min(len - nwriten, UFS_BLOCK_SIZE - boff));
+        ec = _delay_write(inode, buf + nwriten, n, (off + nwriten) / UFS_BLOCK_SIZE, boff);
+        if(ufs_unlikely(ec)) break;
+        nwriten += n;
+    }
+    *pwriten = nwriten;
+    return nwriten ? 0 : ec;
+}
+// 是否使用延迟分配写入（其余写入之前需要先写回缓冲区）
+static int _delay_enabled(ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation, size_t len) {
+    // 较大的写入已经知道连续的范围，直接分配
+    return transcation == NULL && inode->ufs->delay_alloc && UFS_S_ISREG(inode->inode.mode)
+        && len <= UFS_DELAY_MAX / 2 * UFS_BLOCK_SIZE
+        && len > inode->ufs->data_jornal
+        && ulatomic_load_explicit_32(&inode->ufs->txn, ulatomic_memory_order_acquire) != UFS_TXN_ACTIVE;
+}
+
+
+// 读取块block中从boff开始的len字节（不跨块），块未分配且不在缓冲区中时*phole为1
+static int _read_part(
+    ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
+    char* ufs_restrict buf, size_t len, uint64_t block, uint64_t boff, int* ufs_restrict phole
+) {
+    int ec;
+    uint64_t znum;
+    uint32_t i;
+    ec = _seek_zone(inode, block, &znum);
+    if(ufs_unlikely(ec)) return ec;
+    *phole = 0;
+    if(znum != 0) {
+        if(len == UFS_BLOCK_SIZE) return _trans_read_block(inode, transcation, buf, znum);
+        return _trans_read(inode, transcation, buf, len, znum, boff);
+    }
+    if(inode->delay_num != 0 && _delay_find(inode, block, &i)) {
+        memcpy(buf, inode->delay_data[i] + boff, len);
+        return 0;
+    }
+    *phole = 1;
+    return 0;
+}
+static int _minode_pread(
+    ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
+    char* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pread
+) {
+    int ec, hole;
+    uint64_t boff;
+    size_t n, nread = 0;
+
+    while(nread < len) {
+        boff = (off + nread) % UFS_BLOCK_SIZE;
+        n = ul_static_cast(size_t, ufs_min(len - nread, UFS_BLOCK_SIZE - boff));
+        ec = _read_part(inode, transcation, buf + nread, n, (off + nread) / UFS_BLOCK_SIZE, boff, &hole);
+        if(ufs_unlikely(ec)) {
+            if(nread == 0) return ec;
+            break;
+        }
+        if(hole) break;
+        nread += n;
+    }
+    *pread = nread; return 0;
+}
+UFS_HIDDEN int ufs_minode_pread(
+    ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
+    void* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pread
+) {
+    if(off + len > inode->inode.size) len = inode->inode.size - off;
+    inode->inode.atime = ufs_time(0);
+    return _minode_pread(inode, transcation, ul_reinterpret_cast(char*, buf), len, off, pread);
+}
+
+// 将文件写入作为一个事务追加到日志中（len不超过UFS_DATA_JORNAL_MAX）
+static int _minode_pwrite_jornal(
+    ufs_minode_t* ufs_restrict inode, const char* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pwriten
+) {
+    int ec;
+    ufs_transcation_t trans;
+    ufs_transcation_init(&trans, &inode->ufs->jornal);
+    ec = _minode_pwrite(inode, &trans, buf, len, off, pwriten);
+    if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&trans);
+    ufs_transcation_deinit(&trans);
+    _fc_mark(inode);
+    return ec;
+}
 UFS_HIDDEN int ufs_minode_pwrite(
     ufs_minode_t* ufs_restrict inode, ufs_transcation_t* ufs_restrict transcation,
     const void* ufs_restrict buf, size_t len, uint64_t off, size_t* ufs_restrict pwriten
 ) {
-    int ec = _minode_pwrite(inode, transcation, ul_reinterpret_cast(const char*, buf), len, off, pwriten);
+    int ec;
+    const char* p = ul_reinterpret_cast(const char*, buf);
+    const int delay = _delay_enabled(inode, transcation, len);
+    if(inode->delay_num != 0 && !delay) {
+        ec = ufs_minode_flush(inode);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    if(transcation == NULL
+        && ulatomic_load_explicit_32(&inode->ufs->txn, ulatomic_memory_order_acquire) == UFS_TXN_ACTIVE
+    ) {
+        // 公开事务：直接写入的区块无法撤销（可能是中止后仍然空闲的区块），因此全部经过日志，较大的写入拆分为多个事务
+        size_t n, nwriten, total = 0;
+        ec = 0;
+        while(total < len) {
+            n = ufs_min(len - total, UFS_DATA_JORNAL_MAX);
+            ec = _minode_pwrite_jornal(inode, p + total, n, off + total, &nwriten);
+            total += nwriten;
+            if(ufs_unlikely(ec) || nwriten != n) break;
+        }
+        *pwriten = total;
+    } else if(transcation == NULL && inode->ufs->data_jornal && len <= inode->ufs->data_jornal) {
+        // data=journal：较小的文件写入作为一个事务追加到日志中，提交时顺序写入日志区，随后按块号排序写回
+        ec = _minode_pwrite_jornal(inode, p, len, off, pwriten);
+    } else if(delay) ec = _minode_pwrite_delay(inode, p, len, off, pwriten);
+    else ec = _minode_pwrite(inode, transcation, p, len, off, pwriten);
     if(ufs_unlikely(ec)) return ec;
     inode->inode.mtime = ufs_time(0);
     inode->inode.size = ufs_max(inode->inode.size, off + len);
@@ -581,50 +914,115 @@ UFS_HIDDEN int ufs_minode_pwrite(
 }
 
 
+/**
+ * 快速提交
+ *
+ * 普通文件最常见的同步只改变了大小和时间（覆盖写入已分配的区块）。
+ * 此时只需要将inode中从size到atime的部分作为增量记录单独提交，不必提交其他文件的修改。
+ * 分配或释放区块、经过日志的文件数据等依赖其他区块的修改，以及链接数、权限等其他字段的变化，仍然需要完整提交。
+*/
+#define _FC_OFF offsetof(ufs_inode_t, size)
+#define _FC_LEN (offsetof(ufs_inode_t, atime) + sizeof(int64_t) - _FC_OFF)
+static int _fc_eligible(ufs_minode_t* inode) {
+    const ufs_inode_t* now = &inode->inode;
+    const ufs_inode_t* base = &inode->fc_base;
+    if(!inode->ufs->fast_commit || !UFS_S_ISREG(now->mode)) return 0;
+    if(now->nlink != base->nlink || now->mode != base->mode || now->uid != base->uid || now->gid != base->gid
+            || now->blocks != base->blocks || memcmp(now->zones, base->zones, sizeof(now->zones)) != 0)
+        return 0;
+    return ufs_jornal_durable(&inode->ufs->jornal, inode->fc_batch);
+}
 UFS_HIDDEN int ufs_minode_sync_meta(ufs_minode_t* inode) {
     ufs_transcation_t transcation;
+    ufs_inode_t d;
     int ec;
+    const uint64_t inum = inode->inum;
     ufs_transcation_init(&transcation, &inode->ufs->jornal);
-    _write_inode(&transcation, &inode->inode, inode->inum);
+    _write_inode(&transcation, &inode->inode, inum);
     ec = ufs_transcation_commit_all(&transcation);
     ufs_transcation_deinit(&transcation);
     if(ufs_unlikely(ec)) return ec;
-    return ufs_vfs_sync(inode->ufs->vfs);
+    if(_fc_eligible(inode)) {
+        _trans_inode(&d, &inode->inode);
+        ec = ufs_jornal_fast_commit(&inode->ufs->jornal, ul_reinterpret_cast(const char*, &d) + _FC_OFF,
+            inum / UFS_INODE_PER_BLOCK, (inum % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE + _FC_OFF, _FC_LEN);
+        if(ufs_likely(ec == 0))
+            memcpy(ul_reinterpret_cast(char*, &inode->fc_base) + _FC_OFF, ul_reinterpret_cast(const char*, &inode->inode) + _FC_OFF, _FC_LEN);
+        return ec;
+    }
+    ec = ufs_jornal_sync(&inode->ufs->jornal);
+    if(ufs_likely(ec == 0)) inode->fc_base = inode->inode;
+    return ec;
 }
 UFS_HIDDEN int ufs_minode_sync(ufs_minode_t* inode, int only_data) {
-    return only_data ? ufs_vfs_sync(inode->ufs->vfs) : ufs_minode_sync_meta(inode);
+    int ec = ufs_minode_flush(inode);
+    if(ufs_unlikely(ec)) return ec;
+    if(!only_data) return ufs_minode_sync_meta(inode);
+    // 数据可能还在待提交的日志中，只刷新磁盘缓存不能使其持久化
+    if(_data_jornaled(inode)) return ufs_jornal_sync(&inode->ufs->jornal);
+    return ufs_jornal_sync_data(&inode->ufs->jornal);
 }
 
 
 UFS_HIDDEN int ufs_minode_fallocate(ufs_minode_t* inode, uint64_t block_start, uint64_t block_end) {
     int ec = 0;
-    uint64_t znum;
-    for(; block_start < block_end; ++block_start) {
-        ec = _alloc_zone(inode, block_start, &znum);
+    uint64_t cnt;
+    uint64_t znums[UFS_ZONE_PER_BLOCK];
+    ec = ufs_minode_flush(inode);
+    if(ufs_unlikely(ec)) return ec;
+    for(; block_start < block_end; block_start += cnt) {
+        ec = _alloc_zones(inode, block_start, block_end - block_start, znums, &cnt);
         if(ufs_unlikely(ec)) break;
     }
     return ec;
 }
 
 
+// 释放的区块先合并为连续的一段，遇到不相邻的区块时再整段归还（zlist中只占用一项）
+typedef struct _zrun_t {
+    uint64_t start;
+    uint64_t len;
+} _zrun_t;
+static int _zrun_end(ufs_zcache_t* ufs_restrict zcache, _zrun_t* ufs_restrict run) {
+    int ec = 0;
+    if(run->len != 0) ec = ufs_zcache_push_range(zcache, run->start, run->len);
+    run->len = 0;
+    return ec;
+}
+static int _zrun_push(ufs_zcache_t* ufs_restrict zcache, _zrun_t* ufs_restrict run, uint64_t znum) {
+    int ec;
+    if(run->len != 0) {
+        if(znum + 1 == run->start) { run->start = znum; ++run->len; return 0; }
+        if(run->start + run->len == znum) { ++run->len; return 0; }
+        ec = _zrun_end(zcache, run);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    run->start = znum;
+    run->len = 1;
+    return 0;
+}
+
 // 保留buf的前block个zone，其余全部删除，并将删除的数量、删除后的视图同步到磁盘上
 static int __minode_shrink_xr(ufs_minode_t* ufs_restrict inode, uint64_t znum, uint64_t block, uint64_t* ufs_restrict buf) {
     int ec;
     ufs_transcation_t transcation;
     uint64_t i;
     uint64_t oblocks;
+    _zrun_t run = { 0, 0 };
 
     ufs_transcation_init(&transcation, &inode->ufs->jornal);
-    ufs_zlist_lock(&inode->ufs->zlist, &transcation);
+    ufs_zcache_lock(&inode->ufs->zcache, &transcation);
 
     oblocks = inode->inode.blocks;
     for(i = UFS_ZONE_PER_BLOCK; i > block; --i)
         if(buf[i - 1]) {
-            ec = ufs_zlist_push(&inode->ufs->zlist, ul_trans_u64_le(buf[i - 1]));
+            ec = _zrun_push(&inode->ufs->zcache, &run, ul_trans_u64_le(buf[i - 1]));
             if(ufs_unlikely(ec)) goto fail_to_shrink;
             --inode->inode.blocks;
             buf[i - 1] = 0;
         }
+    ec = _zrun_end(&inode->ufs->zcache, &run);
+    if(ufs_unlikely(ec)) goto fail_to_shrink;
     ec = ufs_transcation_add_block(&transcation, buf, znum, UFS_JORNAL_ADD_MOVE);
     buf = NULL;
     if(ufs_unlikely(ec)) goto fail_to_shrink;
@@ -633,12 +1031,12 @@ static int __minode_shrink_xr(ufs_minode_t* ufs_restrict inode, uint64_t znum, u
     goto do_return;
 
 fail_to_shrink:
-    ufs_zlist_rollback(&inode->ufs->zlist);
+    ufs_zcache_rollback(&inode->ufs->zcache);
     inode->inode.blocks = oblocks;
 
 do_return:
-    ufs_free(buf);
-    ufs_zlist_unlock(&inode->ufs->zlist);
+    ufs_block_free(buf);
+    ufs_zcache_unlock(&inode->ufs->zcache);
     ufs_transcation_deinit(&transcation);
     return ec;
 }
@@ -647,10 +1045,10 @@ static int __minode_shrink_x1(ufs_minode_t* inode, uint64_t znum, uint64_t block
     uint64_t* buf;
 
     ufs_assert(znum != 0);
-    buf = ul_reinterpret_cast(uint64_t*, ufs_malloc(UFS_BLOCK_SIZE));
+    buf = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
     if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
     ec = ufs_jornal_read_block(&inode->ufs->jornal, buf, znum);
-    if(ufs_unlikely(ec)) { ufs_free(buf); return UFS_ENOMEM; }
+    if(ufs_unlikely(ec)) { ufs_block_free(buf); return UFS_ENOMEM; }
     return __minode_shrink_xr(inode, znum, block, buf);
 }
 static int __minode_shrink_x2(ufs_minode_t* inode, uint64_t znum, uint64_t block) {
@@ -659,21 +1057,21 @@ static int __minode_shrink_x2(ufs_minode_t* inode, uint64_t znum, uint64_t block
     uint64_t* buf;
 
     ufs_assert(znum != 0);
-    buf = ul_reinterpret_cast(uint64_t*, ufs_malloc(UFS_BLOCK_SIZE));
+    buf = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
     if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
     bq = block / UFS_ZONE_PER_BLOCK;
     br = block % UFS_ZONE_PER_BLOCK;
     ++bq;
 
     ec = ufs_jornal_read_block(&inode->ufs->jornal, buf, znum);
-    if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+    if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
     for(i = UFS_ZONE_PER_BLOCK; i > bq; --i)
         if(buf[i - 1]) {
             ec = __minode_shrink_x1(inode, ul_trans_u64_le(buf[i - 1]), 0);
-            if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+            if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
         }
     if(buf[bq - 1]) ec = __minode_shrink_x1(inode, ul_trans_u64_le(buf[bq - 1]), br);
-    if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+    if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
     return __minode_shrink_xr(inode, znum, bq - !br, buf);
 }
 static int __minode_shrink_x3(ufs_minode_t* inode, uint64_t znum, uint64_t block) {
@@ -682,21 +1080,21 @@ static int __minode_shrink_x3(ufs_minode_t* inode, uint64_t znum, uint64_t block
     uint64_t* buf;
 
     ufs_assert(znum != 0);
-    buf = ul_reinterpret_cast(uint64_t*, ufs_malloc(UFS_BLOCK_SIZE));
+    buf = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
     if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
     bq = block / (UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK);
     br = block % (UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK);
     ++bq;
 
     ec = ufs_jornal_read_block(&inode->ufs->jornal, buf, znum);
-    if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+    if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
     for(i = UFS_ZONE_PER_BLOCK; i > bq; --i)
         if(buf[i - 1]) {
             ec = __minode_shrink_x2(inode, ul_trans_u64_le(buf[i - 1]), 0);
-            if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+            if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
         }
     if(buf[bq - 1]) ec = __minode_shrink_x2(inode, ul_trans_u64_le(buf[bq - 1]), br);
-    if(ufs_unlikely(ec)) { ufs_free(buf); return ec; }
+    if(ufs_unlikely(ec)) { ufs_block_free(buf); return ec; }
     return __minode_shrink_xr(inode, znum, bq - !br, buf);
 }
 static int __minode_shrink0(ufs_minode_t* inode, uint64_t block) {
@@ -704,19 +1102,22 @@ static int __minode_shrink0(ufs_minode_t* inode, uint64_t block) {
     ufs_transcation_t transcation;
     uint64_t oz[12], i;
     uint64_t oblocks;
+    _zrun_t run = { 0, 0 };
 
     memcpy(oz, inode->inode.zones, sizeof(oz));
     oblocks = inode->inode.blocks;
     ufs_transcation_init(&transcation, &inode->ufs->jornal);
-    ufs_zlist_lock(&inode->ufs->zlist, &transcation);
+    ufs_zcache_lock(&inode->ufs->zcache, &transcation);
 
     for(i = block; i < 12; ++i)
         if(oz[i] != 0) {
-            ec = ufs_zlist_push(&inode->ufs->zlist, oz[i]);
+            ec = _zrun_push(&inode->ufs->zcache, &run, oz[i]);
             if(ufs_unlikely(ec)) goto fail_to_shrink;
             inode->inode.zones[i] = 0;
             --inode->inode.blocks;
         }
+    ec = _zrun_end(&inode->ufs->zcache, &run);
+    if(ufs_unlikely(ec)) goto fail_to_shrink;
     ec = __end_zlist(inode, &transcation);
     if(ufs_unlikely(ec)) goto fail_to_shrink;
     goto do_return;
@@ -724,10 +1125,10 @@ static int __minode_shrink0(ufs_minode_t* inode, uint64_t block) {
 fail_to_shrink:
     memcpy(inode->inode.zones, oz, sizeof(oz));
     inode->inode.blocks = oblocks;
-    ufs_zlist_rollback(&inode->ufs->zlist);
+    ufs_zcache_rollback(&inode->ufs->zcache);
 
 do_return:
-    ufs_zlist_unlock(&inode->ufs->zlist);
+    ufs_zcache_unlock(&inode->ufs->zcache);
     ufs_transcation_deinit(&transcation);
     return ec;
 }
@@ -745,10 +1146,10 @@ static int __minode_shrink1(ufs_minode_t* inode, uint64_t block, int zk) {
         uint64_t oblocks;
         oblocks = inode->inode.blocks;
         ufs_transcation_init(&transcation, &inode->ufs->jornal);
-        ufs_zlist_lock(&inode->ufs->zlist, &transcation);
+        ufs_zcache_lock(&inode->ufs->zcache, &transcation);
         --inode->inode.blocks;
         inode->inode.zones[zk] = 0;
-        ec = ufs_zlist_push(&inode->ufs->zlist, oz);
+        ec = ufs_zcache_push(&inode->ufs->zcache, oz);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
         ec = __end_zlist(inode, &transcation);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
@@ -759,7 +1160,7 @@ static int __minode_shrink1(ufs_minode_t* inode, uint64_t block, int zk) {
         inode->inode.zones[zk] = oz;
 
     do_return:
-        ufs_zlist_unlock(&inode->ufs->zlist);
+        ufs_zcache_unlock(&inode->ufs->zcache);
         ufs_transcation_deinit(&transcation);
         return ec;
     }
@@ -779,10 +1180,10 @@ static int __minode_shrink2(ufs_minode_t* inode, uint64_t block, int zk) {
         uint64_t oblocks;
         oblocks = inode->inode.blocks;
         ufs_transcation_init(&transcation, &inode->ufs->jornal);
-        ufs_zlist_lock(&inode->ufs->zlist, &transcation);
+        ufs_zcache_lock(&inode->ufs->zcache, &transcation);
         --inode->inode.blocks;
         inode->inode.zones[zk] = 0;
-        ec = ufs_zlist_push(&inode->ufs->zlist, oz);
+        ec = ufs_zcache_push(&inode->ufs->zcache, oz);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
         ec = __end_zlist(inode, &transcation);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
@@ -793,7 +1194,7 @@ static int __minode_shrink2(ufs_minode_t* inode, uint64_t block, int zk) {
         inode->inode.zones[zk] = oz;
 
     do_return:
-        ufs_zlist_unlock(&inode->ufs->zlist);
+        ufs_zcache_unlock(&inode->ufs->zcache);
         ufs_transcation_deinit(&transcation);
         return ec;
     }
@@ -813,10 +1214,10 @@ static int __minode_shrink3(ufs_minode_t* inode, uint64_t block, int zk) {
         uint64_t oblocks;
         oblocks = inode->inode.blocks;
         ufs_transcation_init(&transcation, &inode->ufs->jornal);
-        ufs_zlist_lock(&inode->ufs->zlist, &transcation);
+        ufs_zcache_lock(&inode->ufs->zcache, &transcation);
         --inode->inode.blocks;
         inode->inode.zones[zk] = 0;
-        ec = ufs_zlist_push(&inode->ufs->zlist, oz);
+        ec = ufs_zcache_push(&inode->ufs->zcache, oz);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
         ec = __end_zlist(inode, &transcation);
         if(ufs_unlikely(ec)) goto fail_to_shrink;
@@ -827,7 +1228,7 @@ static int __minode_shrink3(ufs_minode_t* inode, uint64_t block, int zk) {
         inode->inode.zones[zk] = oz;
 
     do_return:
-        ufs_zlist_unlock(&inode->ufs->zlist);
+        ufs_zcache_unlock(&inode->ufs->zcache);
         ufs_transcation_deinit(&transcation);
         return ec;
     }
@@ -837,34 +1238,28 @@ UFS_HIDDEN int ufs_minode_shrink(ufs_minode_t* inode, uint64_t block) {
     int ec;
     uint64_t B = 12 + UFS_ZONE_PER_BLOCK * 2 + UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK;
 
+    _delay_drop(inode, block);
     if(block > B + UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK) return 0;
 
-    if(block > B) {
-        ec = __minode_shrink3(inode, block - B, 15);
-        if(ufs_unlikely(ec)) return ec;
-        block = B;
-    }
+    // 保留的部分不超过某一级时，这一级整个删除（包括间接块本身）
+    ec = __minode_shrink3(inode, block > B ? block - B : 0, 15);
+    if(ufs_unlikely(ec)) return ec;
+    block = ufs_min(block, B);
     B -= UFS_ZONE_PER_BLOCK * UFS_ZONE_PER_BLOCK;
 
-    if(block > B) {
-        ec = __minode_shrink2(inode, block - B, 14);
-        if(ufs_unlikely(ec)) return ec;
-        block = B;
-    }
+    ec = __minode_shrink2(inode, block > B ? block - B : 0, 14);
+    if(ufs_unlikely(ec)) return ec;
+    block = ufs_min(block, B);
     B -= UFS_ZONE_PER_BLOCK;
 
-    if(block > B) {
-        ec = __minode_shrink1(inode, block - B, 13);
-        if(ufs_unlikely(ec)) return ec;
-        block = B;
-    }
+    ec = __minode_shrink1(inode, block > B ? block - B : 0, 13);
+    if(ufs_unlikely(ec)) return ec;
+    block = ufs_min(block, B);
     B -= UFS_ZONE_PER_BLOCK;
 
-    if(block > B) {
-        ec = __minode_shrink1(inode, block - B, 12);
-        if(ufs_unlikely(ec)) return ec;
-        block = B;
-    }
+    ec = __minode_shrink1(inode, block > B ? block - B : 0, 12);
+    if(ufs_unlikely(ec)) return ec;
+    block = ufs_min(block, B);
 
     ec = __minode_shrink0(inode, block);
     return ec;
@@ -877,6 +1272,11 @@ UFS_HIDDEN int ufs_minode_resize(ufs_minode_t* inode, uint64_t size) {
 
     if(size < inode->inode.size) {
         uint64_t sz = (inode->inode.size - size) / 2 + size;
+        uint32_t i;
+        // 截断后的部分不再写回
+        _delay_drop(inode, (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE);
+        if(size % UFS_BLOCK_SIZE != 0 && _delay_find(inode, size / UFS_BLOCK_SIZE, &i))
+            memset(inode->delay_data[i] + size % UFS_BLOCK_SIZE, 0, UFS_BLOCK_SIZE - size % UFS_BLOCK_SIZE);
         ec = ufs_minode_shrink(inode, (sz + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE);
         if(ufs_unlikely(ec)) return ec;
     }
@@ -888,6 +1288,207 @@ UFS_HIDDEN int ufs_minode_resize(ufs_minode_t* inode, uint64_t size) {
 }
 
 
+
+#define _RECLAIM_NONE 0 // 未启动
+#define _RECLAIM_RUNNING 1 // 运行中
+#define _RECLAIM_STOP 2 // 请求退出
+static int _write_orphan_head(ufs_transcation_t* transcation, uint64_t head) {
+    head = ul_trans_u64_le(head);
+    return ufs_transcation_add(transcation, &head, UFS_BNUM_ILIST, UFS_ORPHAN_OFFSET, 8, UFS_JORNAL_ADD_COPY);
+}
+UFS_HIDDEN int ufs_orphan_init(ufs_t* ufs) {
+    ufs_orphan_t* orphan = &ufs->orphan;
+    orphan->head = 0;
+    orphan->enabled = (ufs->sb.ext_offset & UFS_SB_EXT_ORPHAN) != 0;
+    orphan->state = _RECLAIM_NONE;
+    orphan->batch = 0;
+    orphan->interval = 0;
+    orphan->event.opaque = NULL;
+    ulatomic_spinlock_init(&orphan->lock);
+    return ufs_orphan_reload(ufs);
+}
+UFS_HIDDEN int ufs_orphan_reload(ufs_t* ufs) {
+    int ec;
+    uint64_t head;
+    if(!ufs->orphan.enabled) return 0;
+    ec = ufs_jornal_read(&ufs->jornal, &head, UFS_BNUM_ILIST, UFS_ORPHAN_OFFSET, 8);
+    if(ufs_unlikely(ec)) return ec;
+    ulatomic_spinlock_lock(&ufs->orphan.lock);
+    ufs->orphan.head = ul_trans_u64_le(head);
+    ulatomic_spinlock_unlock(&ufs->orphan.lock);
+    return 0;
+}
+
+// 将inode加入孤儿链表头部，*pasync返回是否由后台回收
+static int _orphan_add(ufs_minode_t* ufs_restrict inode, int* ufs_restrict pasync) {
+    int ec;
+    ufs_transcation_t transcation;
+    ufs_orphan_t* orphan = &inode->ufs->orphan;
+
+    ufs_transcation_init(&transcation, &inode->ufs->jornal);
+    ulatomic_spinlock_lock(&orphan->lock);
+    inode->inode.orphan = orphan->head;
+    ec = _write_inode(&transcation, &inode->inode, inode->inum);
+    if(ufs_likely(ec == 0)) ec = _write_orphan_head(&transcation, inode->inum);
+    if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+    if(ufs_likely(ec == 0)) orphan->head = inode->inum;
+    *pasync = orphan->state == _RECLAIM_RUNNING;
+    ulatomic_spinlock_unlock(&orphan->lock);
+    ufs_transcation_deinit(&transcation);
+    if(ufs_likely(ec == 0) && *pasync) ufs_event_notify(&orphan->event);
+    return ec;
+}
+// 将已经释放全部区块的inode移出孤儿链表并归还ilist
+static int _orphan_remove(ufs_minode_t* inode) {
+    int ec;
+    uint64_t prev;
+    ufs_inode_t pnode;
+    ufs_t* ufs = inode->ufs;
+    const uint64_t next = inode->inode.orphan;
+    ufs_transcation_t transcation;
+
+    ufs_transcation_init(&transcation, &ufs->jornal);
+    ulatomic_spinlock_lock(&ufs->orphan.lock);
+    if(ufs->orphan.head == inode->inum) {
+        ec = _write_orphan_head(&transcation, next);
+    } else { // 回收期间加入的孤儿位于它之前
+        for(prev = ufs->orphan.head; ; prev = pnode.orphan) {
+            if(ufs_unlikely(prev == 0)) { ec = UFS_EINVAL; goto do_return; }
+            ec = _read_inode(ufs, &pnode, prev);
+            if(ufs_unlikely(ec)) goto do_return;
+            if(pnode.orphan == inode->inum) break;
+        }
+        pnode.orphan = next;
+        ec = _write_inode(&transcation, &pnode, prev);
+    }
+    if(ufs_unlikely(ec)) goto do_return;
+    inode->inode.orphan = 0;
+    ec = _write_inode(&transcation, &inode->inode, inode->inum);
+    if(ufs_unlikely(ec)) goto do_return;
+
+    ufs_ilist_lock(&ufs->ilist, &transcation);
+    ec = ufs_ilist_push(&ufs->ilist, inode->inum);
+    if(ufs_likely(ec == 0)) ec = ufs_ilist_sync(&ufs->ilist);
+    if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+    if(ufs_unlikely(ec)) ufs_ilist_rollback(&ufs->ilist);
+    ufs_ilist_unlock(&ufs->ilist);
+    if(ufs_unlikely(ec)) inode->inode.orphan = next;
+    else if(ufs->orphan.head == inode->inum) ufs->orphan.head = next;
+
+do_return:
+    ulatomic_spinlock_unlock(&ufs->orphan.lock);
+    ufs_transcation_deinit(&transcation);
+    return ec;
+}
+// 从文件末尾释放孤儿inode最多batch个块（0表示全部释放），全部释放后将其移出孤儿链表
+static int _orphan_reclaim(ufs_t* ufs, uint64_t inum, uint64_t batch) {
+    int ec;
+    uint64_t end;
+    ufs_minode_t* inode;
+
+    inode = ul_reinterpret_cast(ufs_minode_t*, ufs_malloc(sizeof(ufs_minode_t)));
+    if(ufs_unlikely(inode == NULL)) return UFS_ENOMEM;
+    ec = ufs_minode_init(ufs, inode, inum);
+    if(ufs_unlikely(ec)) goto do_return;
+    if(inode->inode.blocks != 0) {
+        end = (inode->inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+        end = batch != 0 && end > batch ? end - batch : 0;
+        // 超出文件大小的块（预分配）在第一批中一同释放
+        ec = ufs_minode_shrink(inode, end);
+        if(ufs_unlikely(ec)) goto do_return;
+        if(end != 0) { // 缩小文件大小，下一批不再遍历已经释放的部分
+            inode->inode.size = end * UFS_BLOCK_SIZE;
+            ec = _write_inode_direct(&ufs->jornal, &inode->inode, inum);
+            goto do_return;
+        }
+    }
+    ec = _orphan_remove(inode);
+
+do_return:
+    ufs_free(inode);
+    return ec;
+}
+// 链接数为0的文件最后一次关闭：加入孤儿链表，没有后台回收时立即全部释放
+static int _orphan_release(ufs_minode_t* inode) {
+    int ec, async;
+    _delay_drop(inode, 0);
+    ec = _orphan_add(inode, &async);
+    if(ufs_unlikely(ec) || async) return ec;
+    return _orphan_reclaim(inode->ufs, inode->inum, 0);
+}
+UFS_HIDDEN int ufs_orphan_reclaim_all(ufs_t* ufs) {
+    int ec;
+    uint64_t inum;
+    for(;;) {
+        ulatomic_spinlock_lock(&ufs->orphan.lock);
+        inum = ufs->orphan.state == _RECLAIM_RUNNING ? 0 : ufs->orphan.head;
+        ulatomic_spinlock_unlock(&ufs->orphan.lock);
+        if(inum == 0) return 0;
+        ec = _orphan_reclaim(ufs, inum, 0);
+        if(ufs_unlikely(ec)) return ec;
+    }
+}
+
+// 后台回收使用的上下文，只用于区分公开事务的所属
+static const ufs_context_t _reclaimer_context = { NULL, 0, 0, 0 };
+static void _reclaimer(void* opaque) {
+    int ec;
+    uint32_t timeout = 0;
+    uint64_t inum;
+    ufs_t* ufs = ul_reinterpret_cast(ufs_t*, opaque);
+    ufs_orphan_t* orphan = &ufs->orphan;
+
+    for(;;) {
+        ufs_event_wait(&orphan->event, timeout);
+        ulatomic_spinlock_lock(&orphan->lock);
+        if(orphan->state == _RECLAIM_STOP) {
+            orphan->state = _RECLAIM_NONE;
+            ulatomic_spinlock_unlock(&orphan->lock);
+            break;
+        }
+        ulatomic_spinlock_unlock(&orphan->lock);
+
+        // 每一批作为其他上下文的修改操作：等待公开事务结束，开始公开事务时也会等待这一批完成，
+        // 避免一批的提交被并入事务后又被中止撤销一部分（中止会重新读取孤儿链表，因此进入后才读取链表头）
+        ec = ufs_txn_enter(ufs, &_reclaimer_context);
+        if(ufs_unlikely(ec)) { timeout = UFS_EVENT_INFINITE; continue; }
+        ulatomic_spinlock_lock(&orphan->lock);
+        inum = orphan->head;
+        ulatomic_spinlock_unlock(&orphan->lock);
+        if(inum != 0) ec = _orphan_reclaim(ufs, inum, orphan->batch);
+        ufs_txn_leave(ufs, &_reclaimer_context);
+        // 还有待回收的inode时按间隔继续，否则等待新的孤儿
+        // 出错时inode仍留在孤儿链表中，新的孤儿加入或下次挂载时重试
+        timeout = inum != 0 && ec == 0 ? orphan->interval : UFS_EVENT_INFINITE;
+    }
+}
+UFS_HIDDEN int ufs_orphan_start_reclaimer(ufs_t* ufs_restrict ufs, ufs_threadpool_t* ufs_restrict pool, uint32_t batch, uint32_t interval) {
+    int ec;
+    ufs_orphan_t* orphan = &ufs->orphan;
+    if(batch == 0 || !orphan->enabled) return 0;
+    ec = ufs_event_init(&orphan->event);
+    if(ufs_unlikely(ec)) return ec;
+    orphan->batch = batch;
+    orphan->interval = interval;
+    orphan->state = _RECLAIM_RUNNING;
+    ec = ufs_threadpool_push(pool, _reclaimer, ufs);
+    if(ufs_unlikely(ec)) {
+        orphan->state = _RECLAIM_NONE;
+        ufs_event_deinit(&orphan->event);
+    }
+    return ec;
+}
+UFS_HIDDEN void ufs_orphan_stop_reclaimer(ufs_t* ufs) {
+    int running;
+    ufs_orphan_t* orphan = &ufs->orphan;
+    ulatomic_spinlock_lock(&orphan->lock);
+    running = orphan->state == _RECLAIM_RUNNING;
+    if(running) orphan->state = _RECLAIM_STOP;
+    ulatomic_spinlock_unlock(&orphan->lock);
+    if(running) ufs_event_notify(&orphan->event);
+}
+
+
 UFS_HIDDEN void _ufs_inode_debug(const ufs_inode_t* inode, FILE* fp, int space) {
     for(int t = space; t-- > 0; fputc('\t', fp)) { }
     fprintf(fp, "\tlink: %" PRIu32 "\n", inode->nlink);
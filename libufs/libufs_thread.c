@@ -1,44 +1,280 @@
 #include "libufs_thread.h"
 
-/*
-#ifdef _WIN32
-    #include <process.h>
+#ifndef LIBUFS_NO_THREAD_SAFE
+    #ifdef _WIN32
+        #include <windows.h>
+    #else
+        #include <sched.h>
+        #include <pthread.h>
+        #include <string.h>
+    #endif
 #endif
 
-typedef struct _list_t {
+UFS_HIDDEN void ufs_thread_yield(void) {
+#if defined(LIBUFS_NO_THREAD_SAFE)
+    (void)0;
+#elif defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+UFS_HIDDEN unsigned ufs_thread_id(void) {
+#if defined(LIBUFS_NO_THREAD_SAFE)
+    return 0;
+#elif defined(_WIN32)
+    return ul_static_cast(unsigned, GetCurrentThreadId());
+#else
+    // pthread_t的类型不透明，按字节混合
+    pthread_t self = pthread_self();
+    unsigned char b[sizeof(pthread_t)];
+    unsigned h = 2166136261u;
+    size_t i;
+    memcpy(b, &self, sizeof(self));
+    for(i = 0; i < sizeof(b); ++i) h = (h ^ b[i]) * 16777619u;
+    return h;
+#endif
+}
 
-} _list_t;
+#if !defined(LIBUFS_NO_THREAD_SAFE)
+    #ifdef _WIN32
+        typedef SRWLOCK _mutex_t;
+        typedef CONDITION_VARIABLE _cond_t;
+        typedef HANDLE _thread_t;
+        #define _mutex_init(mtx) (InitializeSRWLock(mtx), 0)
+        #define _mutex_deinit(mtx) ((void)(mtx))
+        #define _mutex_lock(mtx) AcquireSRWLockExclusive(mtx)
+        #define _mutex_unlock(mtx) ReleaseSRWLockExclusive(mtx)
+        #define _cond_init(cond) (InitializeConditionVariable(cond), 0)
+        #define _cond_deinit(cond) ((void)(cond))
+        #define _cond_wait(cond, mtx) SleepConditionVariableSRW((cond), (mtx), INFINITE, 0)
+        #define _cond_signal(cond) WakeConditionVariable(cond)
+        #define _cond_broadcast(cond) WakeAllConditionVariable(cond)
+    #else
+        #include <pthread.h>
+        #include <time.h>
+        #include <errno.h>
+        typedef pthread_mutex_t _mutex_t;
+        typedef pthread_cond_t _cond_t;
+        typedef pthread_t _thread_t;
+        #define _mutex_init(mtx) pthread_mutex_init((mtx), NULL)
+        #define _mutex_deinit(mtx) pthread_mutex_destroy(mtx)
+        #define _mutex_lock(mtx) pthread_mutex_lock(mtx)
+        #define _mutex_unlock(mtx) pthread_mutex_unlock(mtx)
+        #define _cond_init(cond) pthread_cond_init((cond), NULL)
+        #define _cond_deinit(cond) pthread_cond_destroy(cond)
+        #define _cond_wait(cond, mtx) pthread_cond_wait((cond), (mtx))
+        #define _cond_signal(cond) pthread_cond_signal(cond)
+        #define _cond_broadcast(cond) pthread_cond_broadcast(cond)
+    #endif
+#endif
 
-typedef struct _threadpool_t {
-#ifdef _WIN32
-    UINT_PTR thread;
+#if defined(LIBUFS_NO_THREAD_SAFE)
+    UFS_HIDDEN int ufs_event_init(ufs_event_t* ev) { ev->opaque = NULL; return 0; }
+    UFS_HIDDEN void ufs_event_deinit(ufs_event_t* ev) { (void)ev; }
+    UFS_HIDDEN void ufs_event_notify(ufs_event_t* ev) { (void)ev; }
+    UFS_HIDDEN int ufs_event_wait(ufs_event_t* ev, uint32_t timeout) { (void)ev; (void)timeout; return 0; }
 #else
-    pthread_t thread;
-#endif
-    int destory;
-    ulatomic_spinlock_t* lck;
-} _threadpool_t;
+    typedef struct _event_t {
+        _mutex_t mtx;
+        _cond_t cond;
+        int signaled;
+    } _event_t;
 
-#ifdef _WIN32
-    static void _subthread(void* _pool) {
-        _threadpool_t* pool = ul_reinterpret_cast(_threadpool_t*, _pool);
+    UFS_HIDDEN int ufs_event_init(ufs_event_t* ev) {
+        _event_t* e = ul_reinterpret_cast(_event_t*, ufs_malloc(sizeof(_event_t)));
+        if(ufs_unlikely(e == NULL)) return UFS_ENOMEM;
+        if(ufs_unlikely(_mutex_init(&e->mtx))) { ufs_free(e); return UFS_ENOMEM; }
+        if(ufs_unlikely(_cond_init(&e->cond))) { _mutex_deinit(&e->mtx); ufs_free(e); return UFS_ENOMEM; }
+        e->signaled = 0;
+        ev->opaque = e;
+        return 0;
+    }
+    UFS_HIDDEN void ufs_event_deinit(ufs_event_t* ev) {
+        _event_t* e = ul_reinterpret_cast(_event_t*, ev->opaque);
+        if(e == NULL) return;
+        _cond_deinit(&e->cond);
+        _mutex_deinit(&e->mtx);
+        ufs_free(e);
+        ev->opaque = NULL;
+    }
+    UFS_HIDDEN void ufs_event_notify(ufs_event_t* ev) {
+        _event_t* e = ul_reinterpret_cast(_event_t*, ev->opaque);
+        _mutex_lock(&e->mtx);
+        e->signaled = 1;
+        _cond_signal(&e->cond);
+        _mutex_unlock(&e->mtx);
+    }
+    UFS_HIDDEN int ufs_event_wait(ufs_event_t* ev, uint32_t timeout) {
+        int ret;
+        _event_t* e = ul_reinterpret_cast(_event_t*, ev->opaque);
+    #ifdef _WIN32
+        _mutex_lock(&e->mtx);
+        if(timeout == UFS_EVENT_INFINITE) {
+            while(!e->signaled) _cond_wait(&e->cond, &e->mtx);
+        } else {
+            const ULONGLONG deadline = GetTickCount64() + timeout;
+            ULONGLONG now;
+            while(!e->signaled && (now = GetTickCount64()) < deadline)
+                SleepConditionVariableSRW(&e->cond, &e->mtx, ul_static_cast(DWORD, deadline - now), 0);
+        }
+    #else
+        struct timespec ts;
+        if(timeout != UFS_EVENT_INFINITE) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += ul_static_cast(time_t, timeout / 1000);
+            ts.tv_nsec += ul_static_cast(long, timeout % 1000) * 1000000l;
+            if(ts.tv_nsec >= 1000000000l) { ++ts.tv_sec; ts.tv_nsec -= 1000000000l; }
+        }
+        _mutex_lock(&e->mtx);
+        if(timeout == UFS_EVENT_INFINITE) {
+            while(!e->signaled) _cond_wait(&e->cond, &e->mtx);
+        } else {
+            while(!e->signaled)
+                if(pthread_cond_timedwait(&e->cond, &e->mtx, &ts) == ETIMEDOUT) break;
+        }
+    #endif
+        ret = e->signaled;
+        e->signaled = 0;
+        _mutex_unlock(&e->mtx);
+        return ret;
+    }
+#endif
 
+#if defined(LIBUFS_NO_THREAD_SAFE)
+    UFS_HIDDEN int ufs_threadpool_init(ufs_threadpool_t* pool, int num) {
+        (void)num;
+        pool->opaque = NULL;
+        ulatomic_spinlock_init(&pool->lck);
+        return UFS_EINVAL;
+    }
+    UFS_HIDDEN int ufs_threadpool_push(ufs_threadpool_t* pool, ufs_threadpool_func_t func, void* opaque) {
+        (void)pool; (void)func; (void)opaque;
+        return UFS_EINVAL;
     }
+    UFS_HIDDEN void ufs_threadpool_deinit(ufs_threadpool_t* pool) { (void)pool; }
 #else
+    typedef struct _task_t {
+        struct _task_t* next;
+        ufs_threadpool_func_t func;
+        void* opaque;
+    } _task_t;
+    typedef struct _threadpool_t {
+        _mutex_t mtx;
+        _cond_t cond;
+        _task_t* head;
+        _task_t** tail;
+        int destroy;
+        int num;
+        _thread_t thread[1];
+    } _threadpool_t;
 
-#endif
+    static void _worker(_threadpool_t* pool) {
+        _task_t* task;
+        _mutex_lock(&pool->mtx);
+        for(;;) {
+            while(pool->head == NULL && !pool->destroy) _cond_wait(&pool->cond, &pool->mtx);
+            task = pool->head;
+            if(task == NULL) break; // 队列已清空并且线程池正在销毁
+            pool->head = task->next;
+            if(pool->head == NULL) pool->tail = &pool->head;
+            _mutex_unlock(&pool->mtx);
+            task->func(task->opaque);
+            ufs_free(task);
+            _mutex_lock(&pool->mtx);
+        }
+        _mutex_unlock(&pool->mtx);
+    }
+    #ifdef _WIN32
+        static DWORD WINAPI _worker_entry(LPVOID pool) {
+            _worker(ul_reinterpret_cast(_threadpool_t*, pool));
+            return 0;
+        }
+    #else
+        static void* _worker_entry(void* pool) {
+            _worker(ul_reinterpret_cast(_threadpool_t*, pool));
+            return NULL;
+        }
+    #endif
 
-UFS_HIDDEN int ufs_threadpool_init(ufs_threadpool_t* pool) {
+    static void _threadpool_join(_threadpool_t* pool) {
+        int i;
+        _mutex_lock(&pool->mtx);
+        pool->destroy = 1;
+        _cond_broadcast(&pool->cond);
+        _mutex_unlock(&pool->mtx);
+        for(i = 0; i < pool->num; ++i) {
+        #ifdef _WIN32
+            WaitForSingleObject(pool->thread[i], INFINITE);
+            CloseHandle(pool->thread[i]);
+        #else
+            pthread_join(pool->thread[i], NULL);
+        #endif
+        }
+        _cond_deinit(&pool->cond);
+        _mutex_deinit(&pool->mtx);
+        ufs_free(pool);
+    }
 
-    ulatomic_spinlock_lock(&pool->lck);
-    if(!pool->opaque) {
-        // _beginthread()
+    UFS_HIDDEN int ufs_threadpool_init(ufs_threadpool_t* _pool, int num) {
+        _threadpool_t* pool;
+        _pool->opaque = NULL;
+        ulatomic_spinlock_init(&_pool->lck);
+        if(ufs_unlikely(num <= 0)) return UFS_EINVAL;
+
+        pool = ul_reinterpret_cast(_threadpool_t*,
+            ufs_malloc(sizeof(_threadpool_t) + sizeof(_thread_t) * ul_static_cast(size_t, num - 1)));
+        if(ufs_unlikely(pool == NULL)) return UFS_ENOMEM;
+        if(ufs_unlikely(_mutex_init(&pool->mtx))) { ufs_free(pool); return UFS_ENOMEM; }
+        if(ufs_unlikely(_cond_init(&pool->cond))) { _mutex_deinit(&pool->mtx); ufs_free(pool); return UFS_ENOMEM; }
+        pool->head = NULL;
+        pool->tail = &pool->head;
+        pool->destroy = 0;
+        for(pool->num = 0; pool->num < num; ++pool->num) {
+        #ifdef _WIN32
+            pool->thread[pool->num] = CreateThread(NULL, 0, _worker_entry, pool, 0, NULL);
+            if(ufs_unlikely(pool->thread[pool->num] == NULL)) break;
+        #else
+            if(ufs_unlikely(pthread_create(pool->thread + pool->num, NULL, _worker_entry, pool))) break;
+        #endif
+        }
+        if(ufs_unlikely(pool->num != num)) {
+            _threadpool_join(pool);
+            return UFS_EAGAIN;
+        }
+        _pool->opaque = pool;
+        return 0;
     }
-    ulatomic_spinlock_unlock(&pool->lck);
-}
+    UFS_HIDDEN int ufs_threadpool_push(ufs_threadpool_t* _pool, ufs_threadpool_func_t func, void* opaque) {
+        int ec = 0;
+        _threadpool_t* pool;
+        _task_t* task = ul_reinterpret_cast(_task_t*, ufs_malloc(sizeof(_task_t)));
+        if(ufs_unlikely(task == NULL)) return UFS_ENOMEM;
+        task->next = NULL;
+        task->func = func;
+        task->opaque = opaque;
 
+        ulatomic_spinlock_lock(&_pool->lck);
+        pool = ul_reinterpret_cast(_threadpool_t*, _pool->opaque);
+        if(ufs_unlikely(pool == NULL)) { ec = UFS_EINVAL; goto do_return; }
+        _mutex_lock(&pool->mtx);
+        *pool->tail = task;
+        pool->tail = &task->next;
+        _cond_signal(&pool->cond);
+        _mutex_unlock(&pool->mtx);
+        task = NULL;
 
-typedef void (*ufs_threadpool_func_t)(void* opaque);
-UFS_HIDDEN int ufs_threadpool_push(ufs_threadpool_t* pool, ufs_threadpool_func_t func);
-UFS_HIDDEN int ufs_threadpool_deinit(ufs_threadpool_t* pool);
-*/
+    do_return:
+        ulatomic_spinlock_unlock(&_pool->lck);
+        ufs_free(task);
+        return ec;
+    }
+    UFS_HIDDEN void ufs_threadpool_deinit(ufs_threadpool_t* _pool) {
+        _threadpool_t* pool;
+        ulatomic_spinlock_lock(&_pool->lck);
+        pool = ul_reinterpret_cast(_threadpool_t*, _pool->opaque);
+        _pool->opaque = NULL;
+        ulatomic_spinlock_unlock(&_pool->lck);
+        if(pool) _threadpool_join(pool);
+    }
+#endif
@@ -91,16 +91,40 @@
 #define ufs_errabort(filename, funcname, msg) do { \
     fputs(filename funcname "(" UFS_STRINGIFY(__LINE__) "):" msg , stderr); exit(1); } while(0)
 
-/*
+// 让出当前线程的时间片（单线程模式下为空操作）
+UFS_HIDDEN void ufs_thread_yield(void);
+// 当前线程的标识（只用于散列，不同线程可能相同；单线程模式下为0）
+UFS_HIDDEN unsigned ufs_thread_id(void);
+
+/**
+ * 事件
+ *
+ * 自动复位：一次等待成功后事件恢复为未触发状态，多次触发在被等待前只会唤醒一次。
+*/
+typedef struct ufs_event_t {
+    void* opaque;
+} ufs_event_t;
+#define UFS_EVENT_INFINITE 0xFFFFFFFFu // 无限等待
+UFS_HIDDEN int ufs_event_init(ufs_event_t* ev);
+UFS_HIDDEN void ufs_event_deinit(ufs_event_t* ev);
+UFS_HIDDEN void ufs_event_notify(ufs_event_t* ev);
+// 等待事件触发或超时（毫秒），返回事件是否被触发
+UFS_HIDDEN int ufs_event_wait(ufs_event_t* ev, uint32_t timeout);
+
+/**
+ * 线程池
+ *
+ * 任务按提交顺序由工作线程执行，ufs_threadpool_deinit会等待队列中所有任务执行完毕后再回收线程。
+ * 单线程模式下线程池不可用，ufs_threadpool_init返回UFS_EINVAL。
+*/
 typedef struct ufs_threadpool_t {
     void* opaque;
     ulatomic_spinlock_t lck;
 } ufs_threadpool_t;
 #define UFS_THREADPOOL_INIT { NULL, ULATOMIC_SPINLOCK_INIT }
-UFS_HIDDEN int ufs_threadpool_init(ufs_threadpool_t* pool);
+UFS_HIDDEN int ufs_threadpool_init(ufs_threadpool_t* pool, int num);
 typedef void (*ufs_threadpool_func_t)(void* opaque);
-UFS_HIDDEN int ufs_threadpool_push(ufs_threadpool_t* pool, ufs_threadpool_func_t func);
-UFS_HIDDEN int ufs_threadpool_deinit(ufs_threadpool_t* pool);
-*/
+UFS_HIDDEN int ufs_threadpool_push(ufs_threadpool_t* pool, ufs_threadpool_func_t func, void* opaque);
+UFS_HIDDEN void ufs_threadpool_deinit(ufs_threadpool_t* pool);
 
 #endif /* LIBUFS_THREAD_H */
@@ -2,49 +2,132 @@
 
 UFS_HIDDEN int ufs_transcation_init(ufs_transcation_t* ufs_restrict transcation, ufs_jornal_t* ufs_restrict jornal) {
     transcation->jornal = jornal;
+    transcation->ops = transcation->local;
     transcation->num = 0;
+    transcation->cap = UFS_JORNAL_OP_MAX;
+    transcation->slot = NULL;
+    ufs_jornal_index_clear(&transcation->index);
     return 0;
 }
 UFS_HIDDEN void ufs_transcation_deinit(ufs_transcation_t* transcation) {
     ufs_transcation_settop(transcation, 0);
+    if(transcation->ops != transcation->local) {
+        ufs_free(transcation->ops);
+        ufs_free(transcation->slot);
+        transcation->ops = transcation->local;
+        transcation->cap = UFS_JORNAL_OP_MAX;
+        transcation->slot = NULL;
+    }
 }
 
-UFS_HIDDEN int ufs_transcation_add(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag) {
-    int ec;
-    char* tmp;
-    tmp = ul_reinterpret_cast(char*, ufs_malloc(UFS_BLOCK_SIZE));
-    if(ufs_unlikely(tmp == NULL)) { ec = UFS_ENOMEM; goto do_return; }
-    ec = ufs_transcation_read_block(transcation, tmp, bnum);
-    if(ufs_unlikely(ec)) { ufs_free(tmp); goto do_return; }
-    memcpy(tmp + off, buf, len);
-    ec = ufs_transcation_add_block(transcation, tmp, bnum, UFS_JORNAL_ADD_MOVE);
-do_return:
-    if(flag == UFS_JORNAL_ADD_MOVE) ufs_free(ufs_const_cast(void*, buf));
-    return ec;
+static size_t _slot_hash(uint64_t bnum, size_t mask) {
+    return ul_static_cast(size_t, (bnum * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & mask;
 }
-UFS_HIDDEN int ufs_transcation_add_block(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, int flag) {
-    if(ufs_unlikely(transcation->num == UFS_JORNAL_NUM)) {
-        if(flag == UFS_JORNAL_ADD_MOVE) ufs_free(ufs_const_cast(void*, buf));
-        return UFS_EOVERFLOW;
+static void _slot_set(ufs_transcation_t* transcation, int i) {
+    const size_t mask = ul_static_cast(size_t, transcation->cap) * 2 - 1;
+    size_t h = _slot_hash(transcation->ops[i].bnum, mask);
+    while(transcation->slot[h]) h = (h + 1) & mask;
+    transcation->slot[h] = ul_static_cast(uint32_t, i) + 1;
+}
+// 查找块号在ops中的下标，不存在时返回-1
+static int _find(const ufs_transcation_t* transcation, uint64_t bnum) {
+    size_t mask, h;
+    if(transcation->slot == NULL) return ufs_jornal_index_find(&transcation->index, transcation->ops, bnum);
+    mask = ul_static_cast(size_t, transcation->cap) * 2 - 1;
+    for(h = _slot_hash(bnum, mask); transcation->slot[h]; h = (h + 1) & mask)
+        if(transcation->ops[transcation->slot[h] - 1].bnum == bnum) return ul_static_cast(int, transcation->slot[h] - 1);
+    return -1;
+}
+// ops被截断或移动后重建索引
+static void _rebuild(ufs_transcation_t* transcation) {
+    int i;
+    if(transcation->slot == NULL) {
+        ufs_jornal_index_build(&transcation->index, transcation->ops, transcation->num);
+        return;
+    }
+    memset(transcation->slot, 0, ul_static_cast(size_t, transcation->cap) * 2 * sizeof(uint32_t));
+    for(i = 0; i < transcation->num; ++i)
+        _slot_set(transcation, i);
+}
+// 容量翻倍（cap为2的幂次的倍数，散列表槽数保持为2的幂）
+static int _grow(ufs_transcation_t* transcation) {
+    ufs_jornal_op_t* ops;
+    uint32_t* slot;
+    int cap;
+    if(ufs_unlikely(transcation->cap > INT_MAX / 4)) return UFS_ENOMEM;
+    cap = transcation->slot ? transcation->cap * 2 : UFS_JORNAL_INDEX_SIZE;
+    slot = ul_reinterpret_cast(uint32_t*, ufs_malloc(ul_static_cast(size_t, cap) * 2 * sizeof(uint32_t)));
+    if(ufs_unlikely(slot == NULL)) return UFS_ENOMEM;
+    if(transcation->ops == transcation->local) {
+        ops = ul_reinterpret_cast(ufs_jornal_op_t*, ufs_malloc(ul_static_cast(size_t, cap) * sizeof(ufs_jornal_op_t)));
+        if(ufs_likely(ops)) memcpy(ops, transcation->local, ul_static_cast(size_t, transcation->num) * sizeof(ufs_jornal_op_t));
+    } else {
+        ops = ul_reinterpret_cast(ufs_jornal_op_t*, ufs_realloc(transcation->ops, ul_static_cast(size_t, cap) * sizeof(ufs_jornal_op_t)));
     }
+    if(ufs_unlikely(ops == NULL)) { ufs_free(slot); return UFS_ENOMEM; }
+    ufs_free(transcation->slot);
+    transcation->ops = ops;
+    transcation->cap = cap;
+    transcation->slot = slot;
+    _rebuild(transcation);
+    return 0;
+}
+
+// 加入区块并记录修改范围，同一区块被多次加入时只保留最后一次的内容
+static int _add_block(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, int flag, size_t off, size_t len) {
+    int ec, i;
+    void* tmp;
     switch(flag) {
     case UFS_JORNAL_ADD_COPY:
-        transcation->ops[transcation->num].buf = ufs_malloc(UFS_BLOCK_SIZE);
-        if(ufs_unlikely(transcation->ops[transcation->num].buf == NULL)) return UFS_ENOMEM;
-        memcpy(ufs_const_cast(void*, transcation->ops[transcation->num].buf), buf, UFS_BLOCK_SIZE);
+        tmp = ufs_block_alloc();
+        if(ufs_unlikely(tmp == NULL)) return UFS_ENOMEM;
+        memcpy(tmp, buf, UFS_BLOCK_SIZE);
+        buf = tmp;
         break;
     case UFS_JORNAL_ADD_MOVE:
-        transcation->ops[transcation->num].buf = buf;
         break;
     default:
         return UFS_EINVAL;
     }
-    transcation->ops[transcation->num].bnum = bnum;
-    ++transcation->num;
+    i = _find(transcation, bnum);
+    if(i >= 0) {
+        ufs_block_free(ufs_const_cast(void*, transcation->ops[i].buf));
+        transcation->ops[i].buf = buf;
+        ufs_jornal_op_widen(transcation->ops + i, off, len);
+        return 0;
+    }
+    if(ufs_unlikely(transcation->num == transcation->cap)) {
+        ec = _grow(transcation);
+        if(ufs_unlikely(ec)) { ufs_block_free(ufs_const_cast(void*, buf)); return ec; }
+    }
+    i = transcation->num++;
+    transcation->ops[i].bnum = bnum;
+    transcation->ops[i].buf = buf;
+    transcation->ops[i].off = ul_static_cast(uint16_t, off);
+    transcation->ops[i].len = ul_static_cast(uint16_t, len);
+    if(transcation->slot) _slot_set(transcation, i);
+    else ufs_jornal_index_set(&transcation->index, transcation->ops, i);
     return 0;
 }
+
+UFS_HIDDEN int ufs_transcation_add(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len, int flag) {
+    int ec;
+    char* tmp;
+    tmp = ul_reinterpret_cast(char*, ufs_block_alloc());
+    if(ufs_unlikely(tmp == NULL)) { ec = UFS_ENOMEM; goto do_return; }
+    ec = ufs_transcation_read_block(transcation, tmp, bnum);
+    if(ufs_unlikely(ec)) { ufs_block_free(tmp); goto do_return; }
+    memcpy(tmp + off, buf, len);
+    ec = _add_block(transcation, tmp, bnum, UFS_JORNAL_ADD_MOVE, off, len);
+do_return:
+    if(flag == UFS_JORNAL_ADD_MOVE) ufs_block_free(ufs_const_cast(void*, buf));
+    return ec;
+}
+UFS_HIDDEN int ufs_transcation_add_block(ufs_transcation_t* ufs_restrict transcation, const void* ufs_restrict buf, uint64_t bnum, int flag) {
+    return _add_block(transcation, buf, bnum, flag, 0, UFS_BLOCK_SIZE);
+}
 UFS_HIDDEN int ufs_transcation_add_zero_block(ufs_transcation_t* transcation, uint64_t bnum) {
-    char* tmp = ul_reinterpret_cast(char*, ufs_malloc(UFS_BLOCK_SIZE));
+    char* tmp = ul_reinterpret_cast(char*, ufs_block_alloc());
     if(ufs_unlikely(tmp == NULL)) return UFS_ENOMEM;
     memset(tmp, 0, UFS_BLOCK_SIZE);
     return ufs_transcation_add_block(transcation, tmp, bnum, UFS_JORNAL_ADD_MOVE);
@@ -52,29 +135,27 @@ UFS_HIDDEN int ufs_transcation_add_zero_block(ufs_transcation_t* transcation, ui
 UFS_HIDDEN int ufs_transcation_add_zero(ufs_transcation_t* transcation, uint64_t bnum, size_t off, size_t len) {
     int ec;
     char* tmp;
-    tmp = ul_reinterpret_cast(char*, ufs_malloc(UFS_BLOCK_SIZE));
+    tmp = ul_reinterpret_cast(char*, ufs_block_alloc());
     if(ufs_unlikely(tmp == NULL)) return UFS_ENOMEM;
     ec = ufs_transcation_read_block(transcation, tmp, bnum);
-    if(ufs_unlikely(ec)) { ufs_free(tmp); return ec; }
+    if(ufs_unlikely(ec)) { ufs_block_free(tmp); return ec; }
     memset(tmp + off, 0, len);
-    return ufs_transcation_add_block(transcation, tmp, bnum, UFS_JORNAL_ADD_MOVE);
+    return _add_block(transcation, tmp, bnum, UFS_JORNAL_ADD_MOVE, off, len);
 }
 UFS_HIDDEN int ufs_transcation_read_block(ufs_transcation_t* ufs_restrict transcation, void* ufs_restrict buf, uint64_t bnum) {
-    int i;
-    for(i = transcation->num - 1; i >= 0; --i)
-        if(transcation->ops[i].bnum == bnum) {
-            memcpy(buf, transcation->ops[i].buf, UFS_BLOCK_SIZE);
-            return 0;
-        }
+    const int i = _find(transcation, bnum);
+    if(i >= 0) {
+        memcpy(buf, transcation->ops[i].buf, UFS_BLOCK_SIZE);
+        return 0;
+    }
     return ufs_jornal_read_block(transcation->jornal, buf, bnum);
 }
 UFS_HIDDEN int ufs_transcation_read(ufs_transcation_t* ufs_restrict transcation, void* ufs_restrict buf, uint64_t bnum, size_t off, size_t len) {
-    int i;
-    for(i = transcation->num - 1; i >= 0; --i)
-        if(transcation->ops[i].bnum == bnum) {
-            memcpy(buf, ul_reinterpret_cast(const char*, transcation->ops[i].buf) + off, len);
-            return 0;
-        }
+    const int i = _find(transcation, bnum);
+    if(i >= 0) {
+        memcpy(buf, ul_reinterpret_cast(const char*, transcation->ops[i].buf) + off, len);
+        return 0;
+    }
     return ufs_jornal_read(transcation->jornal, buf, bnum, off, len);
 }
 UFS_HIDDEN int ufs_transcation_commit(ufs_transcation_t* transcation, int num) {
@@ -82,6 +163,8 @@ UFS_HIDDEN int ufs_transcation_commit(ufs_transcation_t* transcation, int num) {
     ec = ufs_jornal_append(transcation->jornal, transcation->ops, num);
     if(ufs_unlikely(ec)) return ec;
     transcation->num -= num;
+    memmove(transcation->ops, transcation->ops + num, ul_static_cast(size_t, transcation->num) * sizeof(transcation->ops[0]));
+    _rebuild(transcation);
     return 0;
 }
 UFS_HIDDEN int ufs_transcation_commit_all(ufs_transcation_t* transcation) {
@@ -91,6 +174,23 @@ UFS_HIDDEN void ufs_transcation_settop(ufs_transcation_t* transcation, int top)
     int i;
     ufs_assert(top <= transcation->num);
     for(i = top; i < transcation->num; ++i)
-        ufs_free(ufs_const_cast(void*, transcation->ops[i].buf));
+        ufs_block_free(ufs_const_cast(void*, transcation->ops[i].buf));
     transcation->num = top;
+    _rebuild(transcation);
+}
+UFS_HIDDEN int ufs_transcation_reserve(ufs_transcation_t* transcation, int num) {
+    int ec;
+    while(transcation->cap - transcation->num < num) {
+        ec = _grow(transcation);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    return 0;
+}
+UFS_HIDDEN void ufs_transcation_put(ufs_transcation_t* ufs_restrict transcation, const ufs_jornal_op_t* ufs_restrict op) {
+    ufs_assert(transcation->num < transcation->cap || _find(transcation, op->bnum) >= 0);
+    _add_block(transcation, op->buf, op->bnum, UFS_JORNAL_ADD_MOVE, op->off, op->len);
+}
+UFS_HIDDEN const void* ufs_transcation_lookup(const ufs_transcation_t* transcation, uint64_t bnum) {
+    const int i = _find(transcation, bnum);
+    return i >= 0 ? transcation->ops[i].buf : NULL;
 }
@@ -36,6 +36,37 @@ UFS_HIDDEN int ufs_vfs_pwrite_check(ufs_vfs_t* ufs_restrict vfs, const void* ufs
     }
     return 0;
 }
+UFS_HIDDEN int ufs_vfs_pwritev_check(ufs_vfs_t* ufs_restrict vfs, ufs_iovec_t* ufs_restrict iov, int iovcnt, int64_t off) {
+    size_t writen;
+    int ec = 0;
+
+    if(vfs->pwritev == NULL) {
+        for(; iovcnt > 0; ++iov, --iovcnt) {
+            ec = ufs_vfs_pwrite_check(vfs, iov->base, iov->len, off);
+            if(ufs_unlikely(ec)) return ec;
+            off += ul_static_cast(int64_t, iov->len);
+        }
+        return 0;
+    }
+    while(iovcnt > 0) {
+        if(iov->len == 0) { ++iov; --iovcnt; continue; }
+        ec = vfs->pwritev(vfs, iov, iovcnt, off, &writen);
+        if(ec == 0) {
+            if(writen == 0) return ENOSPC;
+            off += ul_static_cast(int64_t, writen);
+            // 跳过已经写入的段
+            while(iovcnt > 0 && writen >= iov->len) {
+                writen -= iov->len;
+                ++iov; --iovcnt;
+            }
+            if(writen) {
+                iov->base = ul_reinterpret_cast(const char*, iov->base) + writen;
+                iov->len -= writen;
+            }
+        } else if(ec != EAGAIN && ec != EWOULDBLOCK) return ec;
+    }
+    return 0;
+}
 UFS_HIDDEN int ufs_vfs_copy(ufs_vfs_t* vfs, int64_t off_in, int64_t off_out, size_t len) {
     char* cache = NULL;
     size_t cache_len = len;
@@ -89,10 +120,18 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off) {
         ec = ufs_vfs_pwrite_check(vfs, zeros, sizeof(zeros), off);
         if(ufs_unlikely(ec)) return ec;
         off += ul_static_cast(int64_t, sizeof(zeros));
+        len -= sizeof(zeros);
     }
     return ufs_vfs_pwrite_check(vfs, zeros, len, off);
 }
 
+#if !defined(_WIN32) && !defined(ULFD_NO_PWRITE) \
+    && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+    #include <sys/uio.h>
+    #define _FD_FILE_PWRITEV
+    #define _FD_FILE_IOV_MAX 64 // 单次调用的最大段数
+#endif
+
 #if 1
     typedef struct _fd_file_t {
         ufs_vfs_t b;
@@ -143,6 +182,30 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off) {
     static int _fd_file_sync(ufs_vfs_t* vfs) {
         return ulfd_ffullsync(ul_reinterpret_cast(_fd_file_t*, vfs)->vfs);
     }
+    static int _fd_file_datasync(ufs_vfs_t* vfs) {
+        return ulfd_fdatasync(ul_reinterpret_cast(_fd_file_t*, vfs)->vfs);
+    }
+#ifdef _FD_FILE_PWRITEV
+    static int _fd_file_pwritev(ufs_vfs_t* vfs, const ufs_iovec_t* iov, int iovcnt, int64_t off, size_t* pwriten) {
+        _fd_file_t* _fd = ul_reinterpret_cast(_fd_file_t*, vfs);
+        struct iovec v[_FD_FILE_IOV_MAX];
+        ssize_t ret;
+        int i;
+
+        if(ufs_unlikely(off < 0)) return EINVAL;
+        if(iovcnt > _FD_FILE_IOV_MAX) iovcnt = _FD_FILE_IOV_MAX;
+        for(i = 0; i < iovcnt; ++i) {
+            v[i].iov_base = ul_const_cast(void*, iov[i].base);
+            v[i].iov_len = iov[i].len;
+        }
+        do {
+            ret = pwritev(_fd->vfs, v, iovcnt, ul_static_cast(off_t, off));
+        } while(ret < 0 && errno == EINTR);
+        if(ret < 0) return errno;
+        *pwriten = ul_static_cast(size_t, ret);
+        return 0;
+    }
+#endif
 
     UFS_API int ufs_vfs_open_file(ufs_vfs_t** pfd, const char* path) {
         _fd_file_t* vfs;
@@ -165,6 +228,12 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off) {
         vfs->b.pread = &_fd_file_pread;
         vfs->b.pwrite = &_fd_file_pwrite;
         vfs->b.sync = &_fd_file_sync;
+        vfs->b.datasync = &_fd_file_datasync;
+    #ifdef _FD_FILE_PWRITEV
+        vfs->b.pwritev = &_fd_file_pwritev;
+    #else
+        vfs->b.pwritev = NULL;
+    #endif
 
         *pfd = ul_reinterpret_cast(ufs_vfs_t*, vfs);
     #if defined(ULFD_NO_PREAD) || defined(ULFD_NO_PWRITE)
@@ -203,29 +272,55 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off) {
         }
         read = vfs->len - ul_static_cast(size_t, off);
         if(read > len) read = len;
-        memcpy(buf, vfs->memory, read);
+        memcpy(buf, vfs->memory + off, read);
         *pread = read;
 
     do_return:
         ulatomic_spinlock_unlock(&vfs->lock);
         return ec;
     }
+    // 保证内存长度不小于end（扩展的部分填0）
+    static int _fd_memory_reserve(_fd_memory_t* vfs, size_t end) {
+        char* new_memory;
+        if(end <= vfs->len) return 0;
+        new_memory = ul_reinterpret_cast(char*, ul_realloc(vfs->memory, end));
+        if(ufs_unlikely(new_memory == NULL)) return ENOSPC;
+        memset(new_memory + vfs->len, 0, end - vfs->len);
+        vfs->memory = new_memory;
+        vfs->len = end;
+        return 0;
+    }
     static int _fd_memory_pwrite(ufs_vfs_t* _fd, const void* buf, size_t len, int64_t off, size_t* pwriten) {
         _fd_memory_t* vfs = ul_reinterpret_cast(_fd_memory_t*, _fd);
         int ec = 0;
-        char* new_memory;
 
         ulatomic_spinlock_lock(&vfs->lock);
         if(off < 0) { ec = EINVAL; goto do_return; }
-        if(ul_static_cast(size_t, off) + len > vfs->len) {
-            new_memory = ul_realloc(vfs->memory, ul_static_cast(size_t, off) + len);
-            if(ufs_unlikely(new_memory == NULL)) { ec = ENOSPC; goto do_return; }
-            vfs->memory = new_memory;
-            vfs->len = ul_static_cast(size_t, off) + len;
-        }
+        ec = _fd_memory_reserve(vfs, ul_static_cast(size_t, off) + len);
+        if(ufs_unlikely(ec)) goto do_return;
         memcpy(vfs->memory + off, buf, len);
         *pwriten = len;
 
+    do_return:
+        ulatomic_spinlock_unlock(&vfs->lock);
+        return ec;
+    }
+    static int _fd_memory_pwritev(ufs_vfs_t* _fd, const ufs_iovec_t* iov, int iovcnt, int64_t off, size_t* pwriten) {
+        _fd_memory_t* vfs = ul_reinterpret_cast(_fd_memory_t*, _fd);
+        int ec = 0, i;
+        size_t len = 0;
+
+        for(i = 0; i < iovcnt; ++i) len += iov[i].len;
+        ulatomic_spinlock_lock(&vfs->lock);
+        if(off < 0) { ec = EINVAL; goto do_return; }
+        ec = _fd_memory_reserve(vfs, ul_static_cast(size_t, off) + len);
+        if(ufs_unlikely(ec)) goto do_return;
+        for(i = 0, len = 0; i < iovcnt; ++i) {
+            memcpy(vfs->memory + off + len, iov[i].base, iov[i].len);
+            len += iov[i].len;
+        }
+        *pwriten = len;
+
     do_return:
         ulatomic_spinlock_unlock(&vfs->lock);
         return ec;
@@ -256,6 +351,8 @@ UFS_HIDDEN int ufs_vfs_pwrite_zeros(ufs_vfs_t* vfs, size_t len, int64_t off) {
         vfs->b.pread = _fd_memory_pread;
         vfs->b.pwrite = _fd_memory_pwrite;
         vfs->b.sync = _fd_memory_sync;
+        vfs->b.pwritev = _fd_memory_pwritev;
+        vfs->b.datasync = NULL;
 
         *pfd = ul_reinterpret_cast(ufs_vfs_t*, vfs);
         return 0;
@@ -0,0 +1,346 @@
+#include "libufs_internel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define UFS_ZBITMAP_SSE2
+#endif
+
+#define _ZBITMAP_MAGIC UINT64_C(0x50414D5449425A55) // "UZBITMAP"
+#define _ZBITMAP_ALLOC (UINT64_C(1) << 63) // 撤销日志中表示分配
+typedef struct _zbitmap_desc_t {
+    uint64_t magic;
+    uint64_t bnum; // 位图起始块号
+    uint64_t base; // 第0位对应的区块号
+    uint64_t bits; // 管理的区块数
+} _zbitmap_desc_t;
+
+static void _zbitmap_free_mem(_ufs_zbitmap_t* bm) {
+    ufs_free(bm->map);
+    ufs_free(bm->bfree);
+    ufs_free(bm->gfree);
+    ufs_free(bm->dlo);
+    ufs_free(bm->dhi);
+    ufs_free(bm->dirty);
+    ufs_free(bm->undo);
+    ufs_free(bm);
+}
+static _ufs_zbitmap_t* _zbitmap_alloc_mem(uint64_t bnum, uint64_t base, uint64_t bits) {
+    _ufs_zbitmap_t* bm;
+    const uint64_t blocks = (bits + UFS_ZBITMAP_BITS - 1) / UFS_ZBITMAP_BITS;
+    const uint64_t groups = (blocks + UFS_ZBITMAP_GROUP - 1) / UFS_ZBITMAP_GROUP;
+
+    if(ufs_unlikely(blocks == 0 || blocks > SIZE_MAX / UFS_BLOCK_SIZE)) return NULL;
+    bm = ul_reinterpret_cast(_ufs_zbitmap_t*, ufs_malloc(sizeof(_ufs_zbitmap_t)));
+    if(ufs_unlikely(bm == NULL)) return NULL;
+    bm->map = ul_reinterpret_cast(uint64_t*, ufs_malloc(ul_static_cast(size_t, blocks) * UFS_BLOCK_SIZE));
+    bm->bfree = ul_reinterpret_cast(uint32_t*, ufs_malloc(ul_static_cast(size_t, blocks) * sizeof(uint32_t)));
+    bm->gfree = ul_reinterpret_cast(uint64_t*, ufs_malloc(ul_static_cast(size_t, groups) * sizeof(uint64_t)));
+    bm->dlo = ul_reinterpret_cast(uint16_t*, ufs_malloc(ul_static_cast(size_t, blocks) * sizeof(uint16_t)));
+    bm->dhi = ul_reinterpret_cast(uint16_t*, ufs_malloc(ul_static_cast(size_t, blocks) * sizeof(uint16_t)));
+    bm->dirty = ul_reinterpret_cast(uint64_t*, ufs_malloc(ul_static_cast(size_t, blocks) * sizeof(uint64_t)));
+    bm->undo = NULL;
+    bm->unum = bm->ucap = 0;
+    if(ufs_unlikely(!bm->map || !bm->bfree || !bm->gfree || !bm->dlo || !bm->dhi || !bm->dirty)) {
+        _zbitmap_free_mem(bm);
+        return NULL;
+    }
+    bm->bnum = bnum;
+    bm->base = base;
+    bm->bits = bits;
+    bm->blocks = blocks;
+    bm->dnum = 0;
+    bm->hint = 0;
+    return bm;
+}
+// 根据位图重新计算摘要，并清空未同步的记录
+static void _zbitmap_summary(_ufs_zbitmap_t* bm) {
+    uint64_t i, j, n;
+    const uint64_t words = bm->blocks * UFS_ZBITMAP_WORDS;
+
+    // 超出范围的位视为已使用，查找时不需要再检查边界
+    for(i = bm->bits; i < words * 64; ++i)
+        bm->map[i / 64] |= UINT64_C(1) << (i % 64);
+    memset(bm->gfree, 0, ul_static_cast(size_t, (bm->blocks + UFS_ZBITMAP_GROUP - 1) / UFS_ZBITMAP_GROUP) * sizeof(uint64_t));
+    bm->free = 0;
+    for(i = 0; i < bm->blocks; ++i) {
+        n = 0;
+        for(j = i * UFS_ZBITMAP_WORDS; j < (i + 1) * UFS_ZBITMAP_WORDS; ++j)
+            n += ul_static_cast(uint64_t, 64 - ufs_popcount(ul_static_cast(unsigned, bm->map[j]))
+                - ufs_popcount(ul_static_cast(unsigned, bm->map[j] >> 32)));
+        bm->bfree[i] = ul_static_cast(uint32_t, n);
+        bm->gfree[i / UFS_ZBITMAP_GROUP] += n;
+        bm->free += n;
+        bm->dlo[i] = bm->dhi[i] = 0;
+    }
+    bm->dnum = 0;
+    bm->unum = 0;
+}
+static int _zbitmap_read(_ufs_zbitmap_t* ufs_restrict bm, ufs_transcation_t* ufs_restrict transcation) {
+    int ec;
+    uint64_t i;
+    for(i = 0; i < bm->blocks; ++i) {
+        ec = ufs_transcation_read_block(transcation, bm->map + i * UFS_ZBITMAP_WORDS, bm->bnum + i);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    for(i = 0; i < bm->blocks * UFS_ZBITMAP_WORDS; ++i)
+        bm->map[i] = ul_trans_u64_le(bm->map[i]);
+    _zbitmap_summary(bm);
+    return 0;
+}
+
+UFS_HIDDEN int ufs_zbitmap_create(_ufs_zbitmap_t** ufs_restrict pbm, ufs_transcation_t* ufs_restrict transcation, uint64_t desc, uint64_t start, uint64_t size) {
+    int ec;
+    uint64_t i, j, blocks;
+    _ufs_zbitmap_t* bm;
+    _zbitmap_desc_t* d;
+    uint64_t* tmp;
+
+    // 每个位图块连同其管理的区块占用UFS_ZBITMAP_BITS + 1块
+    blocks = (size + UFS_ZBITMAP_BITS) / (UFS_ZBITMAP_BITS + 1);
+    if(ufs_unlikely(size <= blocks)) return UFS_ENOSPC;
+    bm = _zbitmap_alloc_mem(start, start + blocks, size - blocks);
+    if(ufs_unlikely(bm == NULL)) return UFS_ENOMEM;
+    memset(bm->map, 0, ul_static_cast(size_t, bm->blocks) * UFS_BLOCK_SIZE);
+    _zbitmap_summary(bm);
+
+    d = ul_reinterpret_cast(_zbitmap_desc_t*, ufs_block_alloc());
+    if(ufs_unlikely(d == NULL)) { ec = UFS_ENOMEM; goto fail_return; }
+    memset(d, 0, UFS_BLOCK_SIZE);
+    d->magic = ul_trans_u64_le(_ZBITMAP_MAGIC);
+    d->bnum = ul_trans_u64_le(bm->bnum);
+    d->base = ul_trans_u64_le(bm->base);
+    d->bits = ul_trans_u64_le(bm->bits);
+    ec = ufs_transcation_add_block(transcation, d, desc, UFS_JORNAL_ADD_MOVE);
+    if(ufs_unlikely(ec)) goto fail_return;
+
+    for(i = 0; i < bm->blocks; ++i) {
+        tmp = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
+        if(ufs_unlikely(tmp == NULL)) { ec = UFS_ENOMEM; goto fail_return; }
+        for(j = 0; j < UFS_ZBITMAP_WORDS; ++j)
+            tmp[j] = ul_trans_u64_le(bm->map[i * UFS_ZBITMAP_WORDS + j]);
+        ec = ufs_transcation_add_block(transcation, tmp, bm->bnum + i, UFS_JORNAL_ADD_MOVE);
+        if(ufs_unlikely(ec)) goto fail_return;
+        if(transcation->num >= UFS_JORNAL_OP_MAX - 1) {
+            ec = ufs_transcation_commit_all(transcation);
+            if(ufs_unlikely(ec)) goto fail_return;
+        }
+    }
+    *pbm = bm;
+    return 0;
+
+fail_return:
+    _zbitmap_free_mem(bm);
+    return ec;
+}
+UFS_HIDDEN int ufs_zbitmap_load(_ufs_zbitmap_t** ufs_restrict pbm, ufs_transcation_t* ufs_restrict transcation, uint64_t desc) {
+    int ec;
+    _ufs_zbitmap_t* bm;
+    _zbitmap_desc_t d;
+
+    ec = ufs_transcation_read(transcation, &d, desc, 0, sizeof(d));
+    if(ufs_unlikely(ec)) return ec;
+    d.magic = ul_trans_u64_le(d.magic);
+    d.bnum = ul_trans_u64_le(d.bnum);
+    d.base = ul_trans_u64_le(d.base);
+    d.bits = ul_trans_u64_le(d.bits);
+    if(ufs_unlikely(d.magic != _ZBITMAP_MAGIC || d.bits == 0 || d.bnum == 0 || d.base < d.bnum)) return UFS_EINVAL;
+
+    bm = _zbitmap_alloc_mem(d.bnum, d.base, d.bits);
+    if(ufs_unlikely(bm == NULL)) return UFS_ENOMEM;
+    ec = _zbitmap_read(bm, transcation);
+    if(ufs_unlikely(ec)) { _zbitmap_free_mem(bm); return ec; }
+    *pbm = bm;
+    return 0;
+}
+UFS_HIDDEN void ufs_zbitmap_destroy(_ufs_zbitmap_t* bm) {
+    if(bm) _zbitmap_free_mem(bm);
+}
+UFS_HIDDEN int ufs_zbitmap_reload(_ufs_zbitmap_t* ufs_restrict bm, ufs_transcation_t* ufs_restrict transcation) {
+    bm->hint = 0;
+    return _zbitmap_read(bm, transcation);
+}
+
+// 跳过全部已使用的字，返回[w, end)中第一个含有空闲位的字，不存在时返回end
+static uint64_t _skip_words(const uint64_t* map, uint64_t w, uint64_t end) {
+#ifdef UFS_ZBITMAP_SSE2
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i a, b;
+    for(; w + 4 <= end; w += 4) {
+        a = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, map + w));
+        b = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, map + w + 2));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(a, b), ones)) != 0xFFFF) break;
+    }
+#endif
+    while(w < end && map[w] == ~UINT64_C(0)) ++w;
+    return w;
+}
+// 借助摘要跳过已满的组和块，返回第w个字之后第一个含有空闲位的字，不存在时返回总字数
+static uint64_t _skip_full(const _ufs_zbitmap_t* bm, uint64_t w) {
+    uint64_t blk, end;
+    const uint64_t words = bm->blocks * UFS_ZBITMAP_WORDS;
+    while(w < words) {
+        blk = w / UFS_ZBITMAP_WORDS;
+        if(bm->gfree[blk / UFS_ZBITMAP_GROUP] == 0) {
+            w = (blk / UFS_ZBITMAP_GROUP + 1) * UFS_ZBITMAP_GROUP * UFS_ZBITMAP_WORDS;
+            continue;
+        }
+        end = (blk + 1) * UFS_ZBITMAP_WORDS;
+        if(bm->bfree[blk] != 0) {
+            w = _skip_words(bm->map, w, end);
+            if(w < end) return w;
+        }
+        w = end;
+    }
+    return words;
+}
+// 查找起始位于[from, limit)中的第一段至少n个连续的空闲区块
+static int _find_run(const _ufs_zbitmap_t* ufs_restrict bm, uint64_t from, uint64_t limit, uint64_t n, uint64_t* ufs_restrict ppos) {
+    int b, f;
+    uint64_t x, y, run = 0, start = 0;
+    uint64_t w = from / 64;
+    const uint64_t words = bm->blocks * UFS_ZBITMAP_WORDS;
+
+    x = bm->map[w] | ((UINT64_C(1) << (from % 64)) - 1);
+    for(;;) {
+        if(run == 0) { // 没有正在统计的连续段时可以跳过已满的部分
+            if(w * 64 >= limit) return UFS_ENOSPC;
+            if(x == ~UINT64_C(0)) {
+                w = _skip_full(bm, w + 1);
+                if(w >= words) return UFS_ENOSPC;
+                x = bm->map[w];
+                continue;
+            }
+        }
+        if(x == 0) {
+            if(run == 0) start = w * 64;
+            run += 64;
+        } else if(x == ~UINT64_C(0)) {
+            run = 0;
+        } else {
+            for(b = 0; b < 64; b += f) {
+                y = x >> b;
+                if(y & 1) { // 已使用（y的高位补0，取反后必然非0）
+                    f = ufs_ctz64(~y);
+                    run = 0;
+                } else {
+                    f = y ? ufs_ctz64(y) : 64 - b;
+                    if(run == 0) {
+                        start = w * 64 + ul_static_cast(uint64_t, b);
+                        if(start >= limit) return UFS_ENOSPC;
+                    }
+                    run += ul_static_cast(uint64_t, f);
+                    if(run >= n) break;
+                }
+            }
+        }
+        if(run >= n) { *ppos = start; return 0; }
+        if(++w >= words) return UFS_ENOSPC;
+        x = bm->map[w];
+    }
+}
+UFS_HIDDEN int ufs_zbitmap_find(const _ufs_zbitmap_t* ufs_restrict bm, uint64_t from, uint64_t n, uint64_t* ufs_restrict ppos) {
+    if(ufs_unlikely(n == 0 || n > bm->free)) return n == 0 ? UFS_EINVAL : UFS_ENOSPC;
+    if(from >= bm->bits) from = 0;
+    if(_find_run(bm, from, bm->bits, n, ppos) == 0) return 0;
+    if(from != 0 && _find_run(bm, 0, from, n, ppos) == 0) return 0;
+    return UFS_ENOSPC;
+}
+UFS_HIDDEN uint64_t ufs_zbitmap_run(const _ufs_zbitmap_t* bm, uint64_t pos, uint64_t n) {
+    uint64_t x, len = 0;
+    int b;
+    while(len < n && pos < bm->bits) {
+        b = ul_static_cast(int, pos % 64);
+        x = bm->map[pos / 64] >> b;
+        if(x & 1) break;
+        b = x ? ufs_ctz64(x) : 64 - b; // 本字中从pos开始的空闲位数
+        len += ul_static_cast(uint64_t, b);
+        pos += ul_static_cast(uint64_t, b);
+        if(pos % 64 != 0) break;
+    }
+    return ufs_min(len, n);
+}
+
+// 修改一位并更新摘要和未同步的范围
+static void _zbitmap_set(_ufs_zbitmap_t* bm, uint64_t pos, int used) {
+    const uint64_t w = pos / 64, blk = pos / UFS_ZBITMAP_BITS;
+    const uint16_t i = ul_static_cast(uint16_t, w % UFS_ZBITMAP_WORDS);
+    if(used) {
+        bm->map[w] |= UINT64_C(1) << (pos % 64);
+        --bm->bfree[blk]; --bm->gfree[blk / UFS_ZBITMAP_GROUP]; --bm->free;
+    } else {
+        bm->map[w] &= ~(UINT64_C(1) << (pos % 64));
+        ++bm->bfree[blk]; ++bm->gfree[blk / UFS_ZBITMAP_GROUP]; ++bm->free;
+    }
+    if(bm->dlo[blk] >= bm->dhi[blk]) {
+        bm->dirty[bm->dnum++] = blk;
+        bm->dlo[blk] = i;
+        bm->dhi[blk] = ul_static_cast(uint16_t, i + 1);
+    } else {
+        if(i < bm->dlo[blk]) bm->dlo[blk] = i;
+        if(i >= bm->dhi[blk]) bm->dhi[blk] = ul_static_cast(uint16_t, i + 1);
+    }
+}
+static int _zbitmap_log(_ufs_zbitmap_t* bm, uint64_t entry) {
+    if(bm->unum == bm->ucap) {
+        const size_t cap = bm->ucap ? bm->ucap * 2 : 64;
+        uint64_t* undo = ul_reinterpret_cast(uint64_t*, ufs_realloc(bm->undo, cap * sizeof(uint64_t)));
+        if(ufs_unlikely(undo == NULL)) return UFS_ENOMEM;
+        bm->undo = undo;
+        bm->ucap = cap;
+    }
+    bm->undo[bm->unum++] = entry;
+    return 0;
+}
+static int _zbitmap_test(const _ufs_zbitmap_t* bm, uint64_t pos) {
+    return ul_static_cast(int, (bm->map[pos / 64] >> (pos % 64)) & 1);
+}
+UFS_HIDDEN int ufs_zbitmap_alloc(_ufs_zbitmap_t* bm, uint64_t pos) {
+    int ec;
+    if(ufs_unlikely(pos >= bm->bits || _zbitmap_test(bm, pos))) return UFS_EINVAL;
+    ec = _zbitmap_log(bm, pos | _ZBITMAP_ALLOC);
+    if(ufs_unlikely(ec)) return ec;
+    _zbitmap_set(bm, pos, 1);
+    return 0;
+}
+UFS_HIDDEN int ufs_zbitmap_free(_ufs_zbitmap_t* bm, uint64_t pos) {
+    int ec;
+    if(ufs_unlikely(pos >= bm->bits || !_zbitmap_test(bm, pos))) return UFS_EINVAL;
+    ec = _zbitmap_log(bm, pos);
+    if(ufs_unlikely(ec)) return ec;
+    _zbitmap_set(bm, pos, 0);
+    return 0;
+}
+UFS_HIDDEN void ufs_zbitmap_rollback(_ufs_zbitmap_t* bm) {
+    uint64_t e;
+    while(bm->unum > 0) {
+        e = bm->undo[--bm->unum];
+        _zbitmap_set(bm, e & ~_ZBITMAP_ALLOC, !(e & _ZBITMAP_ALLOC));
+    }
+}
+UFS_HIDDEN int ufs_zbitmap_sync(_ufs_zbitmap_t* ufs_restrict bm, ufs_transcation_t* ufs_restrict transcation) {
+    int ec;
+    uint64_t i, blk;
+    uint16_t j;
+    uint64_t tmp[UFS_ZBITMAP_WORDS];
+
+    for(i = 0; i < bm->dnum; ++i) {
+        blk = bm->dirty[i];
+        for(j = bm->dlo[blk]; j < bm->dhi[blk]; ++j)
+            tmp[j] = ul_trans_u64_le(bm->map[blk * UFS_ZBITMAP_WORDS + j]);
+        ec = ufs_transcation_add(transcation, tmp + bm->dlo[blk], bm->bnum + blk,
+            ul_static_cast(size_t, bm->dlo[blk]) * 8, ul_static_cast(size_t, bm->dhi[blk] - bm->dlo[blk]) * 8, UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    for(i = 0; i < bm->dnum; ++i)
+        bm->dlo[bm->dirty[i]] = bm->dhi[bm->dirty[i]] = 0;
+    bm->dnum = 0;
+    return 0;
+}
+
+UFS_HIDDEN void ufs_zbitmap_debug(const _ufs_zbitmap_t* bm, FILE* fp) {
+    fprintf(fp, "\tbitmap bnum: %" PRIu64 " (%" PRIu64 " blocks)\n", bm->bnum, bm->blocks);
+    fprintf(fp, "\tbitmap range: [%" PRIu64 ", %" PRIu64 ")\n", bm->base, bm->base + bm->bits);
+    fprintf(fp, "\tbitmap free: %" PRIu64 "\n", bm->free);
+    fprintf(fp, "\tbitmap dirty blocks: %" PRIu64 "\n", bm->dnum);
+    fprintf(fp, "\tbitmap undo length: %" PRIu64 "\n", ul_static_cast(uint64_t, bm->unum));
+}
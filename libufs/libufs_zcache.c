@@ -0,0 +1,437 @@
+#include "libufs_internel.h"
+#include "libufs_thread.h"
+
+#define _DIR_MAGIC UINT64_C(0x4548434143455a55) // "UZECACHE"
+#define _DIR_OFFSET ((UFS_INUM_ZCACHE % UFS_INODE_PER_BLOCK) * UFS_INODE_DISK_SIZE)
+typedef struct _zcache_dir_t {
+    uint64_t magic;
+    uint64_t num;
+    uint64_t bnum[UFS_ZCACHE_SLOTS];
+} _zcache_dir_t; // 位于不使用的inode位置，不超过UFS_INODE_DISK_SIZE
+
+static _ufs_zcache_slot_t* _slot(const ufs_zcache_t* zcache) {
+    return zcache->slots + ufs_thread_id() % UFS_ZCACHE_SLOTS;
+}
+
+// 记录块：数量，随后是区块号（全部为小端序）
+static int _write_slot(const _ufs_zcache_slot_t* ufs_restrict slot, ufs_transcation_t* ufs_restrict transcation) {
+    int i;
+    uint64_t* buf = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
+    if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
+    buf[0] = ul_trans_u64_le(ul_static_cast(uint64_t, slot->num));
+    for(i = 0; i < slot->num; ++i) buf[i + 1] = ul_trans_u64_le(slot->zones[i]);
+    for(; i < UFS_ZCACHE_CAP; ++i) buf[i + 1] = 0;
+    return ufs_transcation_add_block(transcation, buf, slot->bnum, UFS_JORNAL_ADD_MOVE);
+}
+static int _read_slot(_ufs_zcache_slot_t* ufs_restrict slot, ufs_jornal_t* ufs_restrict jornal) {
+    int ec, i;
+    uint64_t num;
+    uint64_t* buf = ul_reinterpret_cast(uint64_t*, ufs_block_alloc());
+    if(ufs_unlikely(buf == NULL)) return UFS_ENOMEM;
+    ec = ufs_jornal_read_block(jornal, buf, slot->bnum);
+    if(ufs_unlikely(ec)) goto do_return;
+    num = ul_trans_u64_le(buf[0]);
+    if(ufs_unlikely(num > UFS_ZCACHE_CAP)) { ec = UFS_EINVAL; goto do_return; }
+    slot->num = ul_static_cast(int, num);
+    for(i = 0; i < slot->num; ++i) slot->zones[i] = ul_trans_u64_le(buf[i + 1]);
+do_return:
+    ufs_block_free(buf);
+    return ec;
+}
+static int _write_dir(ufs_zcache_t* ufs_restrict zcache, ufs_transcation_t* ufs_restrict transcation, int valid) {
+    int i;
+    _zcache_dir_t dir;
+    memset(&dir, 0, sizeof(dir));
+    if(valid) {
+        dir.magic = ul_trans_u64_le(_DIR_MAGIC);
+        dir.num = ul_trans_u64_le(ul_static_cast(uint64_t, UFS_ZCACHE_SLOTS));
+        for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) dir.bnum[i] = ul_trans_u64_le(zcache->slots[i].bnum);
+    }
+    return ufs_transcation_add(transcation, &dir, UFS_BNUM_ILIST, _DIR_OFFSET, sizeof(dir), UFS_JORNAL_ADD_COPY);
+}
+
+static void _begin_slot(_ufs_zcache_slot_t* ufs_restrict slot, ufs_transcation_t* ufs_restrict transcation) {
+    slot->transcation = transcation;
+    slot->lnum = slot->saved_from = slot->num;
+    slot->global = 0;
+    slot->victims = 0;
+}
+static void _rollback_slot(_ufs_zcache_slot_t* slot) {
+    memcpy(slot->zones + slot->saved_from, slot->saved + slot->saved_from,
+        ul_static_cast(size_t, slot->lnum - slot->saved_from) * sizeof(slot->zones[0]));
+    slot->num = slot->saved_from = slot->lnum;
+}
+static void _account(ufs_zcache_t* ufs_restrict zcache, const _ufs_zcache_slot_t* ufs_restrict slot, int from) {
+    if(slot->num != from)
+        ulatomic_fetch_add_explicit_64(&zcache->cached, slot->num - from, ulatomic_memory_order_relaxed);
+}
+
+// 在单独的事务中将槽中的区块数调整到UFS_ZCACHE_FILL（区块不足时尽量补充）
+static int _balance(ufs_zcache_t* ufs_restrict zcache, _ufs_zcache_slot_t* ufs_restrict slot) {
+    int ec = 0, n = slot->num;
+    uint64_t start, len;
+    ufs_transcation_t transcation;
+
+    ufs_transcation_init(&transcation, zcache->jornal);
+    ufs_zlist_lock(zcache->zlist, &transcation);
+    while(slot->num < UFS_ZCACHE_FILL) { // 倒序压入，使得弹出的区块递增
+        ec = ufs_zlist_pop_extent(zcache->zlist, 0, ul_static_cast(uint64_t, UFS_ZCACHE_FILL - slot->num), &start, &len);
+        if(ufs_unlikely(ec)) break;
+        while(len > 0) slot->zones[slot->num++] = start + --len;
+    }
+    if(ec == UFS_ENOSPC) ec = 0;
+    while(ufs_likely(ec == 0) && slot->num > UFS_ZCACHE_FILL)
+        ec = ufs_zlist_push(zcache->zlist, slot->zones[--slot->num]);
+    if(ufs_unlikely(ec) || slot->num == n) goto fail_return;
+
+    ec = _write_slot(slot, &transcation);
+    if(ufs_unlikely(ec)) goto fail_return;
+    ec = ufs_zlist_sync(zcache->zlist);
+    if(ufs_unlikely(ec)) goto fail_return;
+    ec = ufs_transcation_commit_all(&transcation);
+    if(ufs_unlikely(ec)) goto fail_return;
+    _account(zcache, slot, n);
+    goto do_return;
+
+fail_return:
+    ufs_zlist_rollback(zcache->zlist);
+    slot->num = n;
+do_return:
+    ufs_zlist_unlock(zcache->zlist);
+    ufs_transcation_deinit(&transcation);
+    return ec;
+}
+
+UFS_HIDDEN int ufs_zcache_init(ufs_zcache_t* ufs_restrict zcache, ufs_zlist_t* ufs_restrict zlist, ufs_jornal_t* ufs_restrict jornal, int enabled) {
+    int ec, i;
+    _zcache_dir_t dir;
+    ufs_transcation_t transcation;
+    _ufs_zcache_slot_t* slots;
+
+    zcache->zlist = zlist;
+    zcache->jornal = jornal;
+    zcache->slots = NULL;
+    ulatomic_store_explicit_64(&zcache->cached, 0, ulatomic_memory_order_relaxed);
+    // 没有UFS_SB_EXT_ZCACHE的磁盘上该位置不属于区块缓存
+    if(!enabled) return 0;
+
+    slots = ul_reinterpret_cast(_ufs_zcache_slot_t*, ufs_malloc(sizeof(_ufs_zcache_slot_t) * UFS_ZCACHE_SLOTS));
+    if(ufs_unlikely(slots == NULL)) return UFS_ENOMEM;
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        ulatomic_spinlock_init(&slots[i].lock);
+        slots[i].num = 0;
+        _begin_slot(slots + i, NULL);
+    }
+
+    ec = ufs_jornal_read(jornal, &dir, UFS_BNUM_ILIST, _DIR_OFFSET, sizeof(dir));
+    if(ufs_unlikely(ec)) goto fail_return;
+    if(ul_trans_u64_le(dir.magic) == _DIR_MAGIC && ul_trans_u64_le(dir.num) == UFS_ZCACHE_SLOTS) {
+        // 上次没有正常卸载，直接接管遗留的槽
+        for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+            slots[i].bnum = ul_trans_u64_le(dir.bnum[i]);
+            ec = _read_slot(slots + i, jornal);
+            if(ufs_unlikely(ec)) goto fail_return;
+            _begin_slot(slots + i, NULL);
+        }
+        zcache->slots = slots;
+        for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) _account(zcache, slots + i, 0);
+        return 0;
+    }
+
+    // 分配记录块，区块不足时不启用缓存
+    ufs_transcation_init(&transcation, jornal);
+    ufs_zlist_lock(zlist, &transcation);
+    zcache->slots = slots;
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        ec = ufs_zlist_pop(zlist, &slots[i].bnum);
+        if(ufs_unlikely(ec)) break;
+        ec = ufs_transcation_add_zero_block(&transcation, slots[i].bnum);
+        if(ufs_unlikely(ec)) break;
+    }
+    if(ufs_likely(ec == 0)) ec = _write_dir(zcache, &transcation, 1);
+    if(ufs_likely(ec == 0)) ec = ufs_zlist_sync(zlist);
+    if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+    if(ufs_unlikely(ec)) {
+        ufs_zlist_rollback(zlist);
+        zcache->slots = NULL;
+    }
+    ufs_zlist_unlock(zlist);
+    ufs_transcation_deinit(&transcation);
+    if(ufs_likely(ec == 0)) return 0;
+    if(ec == UFS_ENOSPC) ec = 0;
+
+fail_return:
+    ufs_free(slots);
+    return ec;
+}
+UFS_HIDDEN int ufs_zcache_release(ufs_zcache_t* zcache) {
+    int ec = 0, i, n;
+    _ufs_zcache_slot_t* slot;
+    ufs_transcation_t transcation;
+
+    if(zcache->slots == NULL) return 0;
+    ufs_transcation_init(&transcation, zcache->jornal);
+
+    // 每个槽单独归还，事务不会过大
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        slot = zcache->slots + i;
+        ulatomic_spinlock_lock(&slot->lock);
+        ufs_zlist_lock(zcache->zlist, &transcation);
+        n = slot->num;
+        while(ufs_likely(ec == 0) && slot->num > 0)
+            ec = ufs_zlist_push(zcache->zlist, slot->zones[--slot->num]);
+        if(ufs_likely(ec == 0) && n != 0) ec = _write_slot(slot, &transcation);
+        if(ufs_likely(ec == 0) && n != 0) ec = ufs_zlist_sync(zcache->zlist);
+        if(ufs_likely(ec == 0) && n != 0) ec = ufs_transcation_commit_all(&transcation);
+        if(ufs_unlikely(ec)) {
+            ufs_zlist_rollback(zcache->zlist);
+            slot->num = n;
+        }
+        _account(zcache, slot, n);
+        ufs_zlist_unlock(zcache->zlist);
+        ulatomic_spinlock_unlock(&slot->lock);
+        if(ufs_unlikely(ec)) goto do_return;
+    }
+
+    // 最后归还记录块，并清除目录
+    ufs_zlist_lock(zcache->zlist, &transcation);
+    for(i = 0; i < UFS_ZCACHE_SLOTS && ufs_likely(ec == 0); ++i)
+        ec = ufs_zlist_push(zcache->zlist, zcache->slots[i].bnum);
+    if(ufs_likely(ec == 0)) ec = _write_dir(zcache, &transcation, 0);
+    if(ufs_likely(ec == 0)) ec = ufs_zlist_sync(zcache->zlist);
+    if(ufs_likely(ec == 0)) ec = ufs_transcation_commit_all(&transcation);
+    if(ufs_unlikely(ec)) ufs_zlist_rollback(zcache->zlist);
+    ufs_zlist_unlock(zcache->zlist);
+    if(ufs_likely(ec == 0)) {
+        ufs_free(zcache->slots);
+        zcache->slots = NULL;
+    }
+
+do_return:
+    ufs_transcation_deinit(&transcation);
+    return ec;
+}
+UFS_HIDDEN void ufs_zcache_deinit(ufs_zcache_t* zcache) {
+    ufs_free(zcache->slots);
+    zcache->slots = NULL;
+}
+UFS_HIDDEN int ufs_zcache_reload(ufs_zcache_t* zcache) {
+    int ec, i, n;
+    _ufs_zcache_slot_t* slot;
+
+    if(zcache->slots == NULL) return 0;
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        slot = zcache->slots + i;
+        ulatomic_spinlock_lock(&slot->lock);
+        n = slot->num;
+        ec = _read_slot(slot, zcache->jornal);
+        _account(zcache, slot, n);
+        ulatomic_spinlock_unlock(&slot->lock);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    return 0;
+}
+
+UFS_HIDDEN void ufs_zcache_lock(ufs_zcache_t* ufs_restrict zcache, ufs_transcation_t* ufs_restrict transcation) {
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) { ufs_zlist_lock(zcache->zlist, transcation); return; }
+    slot = _slot(zcache);
+    ulatomic_spinlock_lock(&slot->lock);
+    // 失败时保持原样，之后的分配和释放会退回到zlist
+    if(slot->num < UFS_ZCACHE_LOW || slot->num > UFS_ZCACHE_HIGH) (void)_balance(zcache, slot);
+    _begin_slot(slot, transcation);
+}
+UFS_HIDDEN void ufs_zcache_unlock(ufs_zcache_t* zcache) {
+    int i;
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) { ufs_zlist_unlock(zcache->zlist); return; }
+    slot = _slot(zcache);
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        if(!(slot->victims & (1u << i))) continue;
+        _account(zcache, zcache->slots + i, zcache->slots[i].lnum);
+        zcache->slots[i].transcation = NULL;
+        ulatomic_spinlock_unlock(&zcache->slots[i].lock);
+    }
+    _account(zcache, slot, slot->lnum);
+    if(slot->global) ufs_zlist_unlock(zcache->zlist);
+    slot->transcation = NULL;
+    ulatomic_spinlock_unlock(&slot->lock);
+}
+
+static void _lock_global(ufs_zcache_t* ufs_restrict zcache, _ufs_zcache_slot_t* ufs_restrict slot) {
+    if(slot->global) return;
+    ufs_zlist_lock(zcache->zlist, slot->transcation);
+    slot->global = 1;
+}
+// zlist也已耗尽时，从其他槽借用区块（只尝试加锁，避免死锁）
+static int _steal(ufs_zcache_t* ufs_restrict zcache, _ufs_zcache_slot_t* ufs_restrict slot, uint64_t* ufs_restrict pznum) {
+    int i;
+    _ufs_zcache_slot_t* victim;
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        victim = zcache->slots + i;
+        if(victim == slot) continue;
+        if(!(slot->victims & (1u << i))) {
+            if(!ulatomic_spinlock_trylock(&victim->lock)) continue;
+            if(victim->num == 0) { ulatomic_spinlock_unlock(&victim->lock); continue; }
+            _begin_slot(victim, slot->transcation);
+            slot->victims |= 1u << i;
+        }
+        if(victim->num == 0) continue;
+        *pznum = victim->zones[--victim->num];
+        return 0;
+    }
+    return UFS_ENOSPC;
+}
+// 修改槽中第i项之前保存加锁时的内容，以便回滚
+static void _save(_ufs_zcache_slot_t* slot, int i) {
+    int j;
+    for(j = i; j < slot->saved_from; ++j) slot->saved[j] = slot->zones[j];
+    if(i < slot->saved_from) slot->saved_from = i;
+}
+static int _take(_ufs_zcache_slot_t* ufs_restrict slot, int i, uint64_t* ufs_restrict pznum) {
+    *pznum = slot->zones[i];
+    if(i != --slot->num) {
+        _save(slot, i);
+        slot->zones[i] = slot->zones[slot->num];
+    }
+    return 0;
+}
+// 槽中位于[goal, goal + UFS_ZCACHE_WINDOW)且最接近goal的区块，不存在时返回-1
+static int _nearest(const _ufs_zcache_slot_t* slot, uint64_t goal) {
+    int i, ret = -1;
+    uint64_t d = UFS_ZCACHE_WINDOW;
+    for(i = slot->num - 1; i >= 0; --i)
+        if(slot->zones[i] >= goal && slot->zones[i] - goal < d) {
+            d = slot->zones[i] - goal;
+            ret = i;
+            if(d == 0) break;
+        }
+    return ret;
+}
+static int _zone_compare(const void* lhs, const void* rhs) {
+    const uint64_t lv = *ul_reinterpret_cast(const uint64_t*, lhs);
+    const uint64_t rv = *ul_reinterpret_cast(const uint64_t*, rhs);
+    return lv < rv ? -1 : lv > rv;
+}
+// 槽中最长一段连续区块的中点（槽不能为空）
+// 没有目标时（链表分配器中文件的第一块）从这里开始，交替写入的文件各自留有向后增长的空间，不会占用其他文件的下一块
+static int _spread(const _ufs_zcache_slot_t* slot) {
+    uint64_t sorted[UFS_ZCACHE_CAP];
+    int i, start = 0, best = 0, len = 0;
+    memcpy(sorted, slot->zones, ul_static_cast(size_t, slot->num) * sizeof(sorted[0]));
+    qsort(sorted, ul_static_cast(size_t, slot->num), sizeof(sorted[0]), &_zone_compare);
+    for(i = 1; i <= slot->num; ++i) {
+        if(i < slot->num && sorted[i] == sorted[i - 1] + 1) continue;
+        if(i - start > len) { len = i - start; best = start; }
+        start = i;
+    }
+    for(i = slot->num - 1; i > 0 && slot->zones[i] != sorted[best + len / 2]; --i) { }
+    return i;
+}
+// 从zlist中取出goal处（链表为栈顶）的一段区块，第一块返回，其余放入槽中供之后的分配使用
+static int _pop_goal(ufs_zcache_t* ufs_restrict zcache, _ufs_zcache_slot_t* ufs_restrict slot, uint64_t goal, uint64_t* ufs_restrict pznum) {
+    int ec;
+    uint64_t len;
+    _lock_global(zcache, slot);
+    ec = ufs_zlist_pop_extent(zcache->zlist, goal,
+        ufs_min(ul_static_cast(uint64_t, UFS_ZCACHE_CAP - slot->num), UFS_ZCACHE_RUN - 1) + 1, pznum, &len);
+    if(ufs_unlikely(ec)) return ec;
+    while(--len > 0) { // 倒序压入，使得弹出的区块递增
+        _save(slot, slot->num);
+        slot->zones[slot->num++] = *pznum + len;
+    }
+    return 0;
+}
+UFS_HIDDEN int ufs_zcache_pop(ufs_zcache_t* ufs_restrict zcache, uint64_t goal, uint64_t* ufs_restrict pznum) {
+    int ec, i;
+    uint64_t len;
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) return ufs_zlist_pop_extent(zcache->zlist, goal, 1, pznum, &len);
+    slot = _slot(zcache);
+    if(goal != 0) {
+        i = _nearest(slot, goal);
+        if(i >= 0) return _take(slot, i, pznum);
+        // 位图从goal处取出一段；链表不能按位置查找，取出栈顶的一段，至少不会与其他文件交错
+        ec = _pop_goal(zcache, slot, goal, pznum);
+        if(ec != UFS_ENOSPC) return ec;
+    }
+    if(ufs_likely(slot->num > 0)) return _take(slot, goal == 0 ? _spread(slot) : slot->num - 1, pznum);
+    _lock_global(zcache, slot);
+    ec = ufs_zlist_pop(zcache->zlist, pznum);
+    if(ec != UFS_ENOSPC) return ec;
+    return _steal(zcache, slot, pznum);
+}
+UFS_HIDDEN int ufs_zcache_pop_extent(ufs_zcache_t* ufs_restrict zcache, uint64_t goal, uint64_t n,
+        uint64_t* ufs_restrict pstart, uint64_t* ufs_restrict plen) {
+    int ec;
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) return ufs_zlist_pop_extent(zcache->zlist, goal, n, pstart, plen);
+    if(ufs_unlikely(n == 0)) return UFS_EINVAL;
+    slot = _slot(zcache);
+    if(n > 1) {
+        _lock_global(zcache, slot);
+        ec = ufs_zlist_pop_extent(zcache->zlist, goal, n, pstart, plen);
+        if(ec != UFS_ENOSPC) return ec;
+    }
+    *plen = 1;
+    return ufs_zcache_pop(zcache, goal, pstart);
+}
+UFS_HIDDEN int ufs_zcache_push(ufs_zcache_t* zcache, uint64_t znum) {
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) return ufs_zlist_push(zcache->zlist, znum);
+    slot = _slot(zcache);
+    if(ufs_unlikely(slot->num == UFS_ZCACHE_CAP)) {
+        _lock_global(zcache, slot);
+        return ufs_zlist_push(zcache->zlist, znum);
+    }
+    _save(slot, slot->num);
+    slot->zones[slot->num++] = znum;
+    return 0;
+}
+UFS_HIDDEN int ufs_zcache_push_range(ufs_zcache_t* zcache, uint64_t znum, uint64_t len) {
+    if(zcache->slots == NULL) return ufs_zlist_push_range(zcache->zlist, znum, len);
+    if(len == 1) return ufs_zcache_push(zcache, znum);
+    _lock_global(zcache, _slot(zcache));
+    return ufs_zlist_push_range(zcache->zlist, znum, len);
+}
+UFS_HIDDEN int ufs_zcache_sync(ufs_zcache_t* zcache) {
+    int ec, i;
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) return ufs_zlist_sync(zcache->zlist);
+    slot = _slot(zcache);
+    if(slot->num != slot->lnum || slot->saved_from != slot->lnum) {
+        ec = _write_slot(slot, slot->transcation);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i) {
+        if(!(slot->victims & (1u << i))) continue;
+        ec = _write_slot(zcache->slots + i, slot->transcation);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    if(slot->global) return ufs_zlist_sync(zcache->zlist);
+    return 0;
+}
+UFS_HIDDEN void ufs_zcache_rollback(ufs_zcache_t* zcache) {
+    int i;
+    _ufs_zcache_slot_t* slot;
+    if(zcache->slots == NULL) { ufs_zlist_rollback(zcache->zlist); return; }
+    slot = _slot(zcache);
+    _rollback_slot(slot);
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i)
+        if(slot->victims & (1u << i)) _rollback_slot(zcache->slots + i);
+    if(slot->global) ufs_zlist_rollback(zcache->zlist);
+}
+
+UFS_HIDDEN uint64_t ufs_zcache_cached(ufs_zcache_t* zcache) {
+    return ul_static_cast(uint64_t, ulatomic_load_explicit_64(&zcache->cached, ulatomic_memory_order_relaxed));
+}
+UFS_HIDDEN void ufs_zcache_debug(const ufs_zcache_t* zcache, FILE* fp) {
+    int i;
+    fprintf(fp, "zcache [%p]\n", ufs_const_cast(void*, zcache));
+    if(zcache->slots == NULL) {
+        fprintf(fp, "\tdisabled\n");
+        return;
+    }
+    for(i = 0; i < UFS_ZCACHE_SLOTS; ++i)
+        fprintf(fp, "\tslot %d: bnum %" PRIu64 ", cached %d\n", i, zcache->slots[i].bnum, zcache->slots[i].num);
+}
@@ -1,5 +1,12 @@
 #include "libufs_internel.h"
 
+// 栈中的一项：低48位为起始区块，高16位为连续区块数减1（未设置UFS_SB_EXT_ZRANGE时总是单个区块）
+#define _ENT_SHIFT 48
+#define _ENT_MAX (UINT64_C(1) << (64 - _ENT_SHIFT)) // 一项最多记录的区块数
+static uint64_t _ent_start(uint64_t e) { return e & ((UINT64_C(1) << _ENT_SHIFT) - 1); }
+static uint64_t _ent_len(uint64_t e) { return (e >> _ENT_SHIFT) + 1; }
+static uint64_t _ent(uint64_t start, uint64_t len) { return start | ((len - 1) << _ENT_SHIFT); }
+
 static void _trans_zlist(_ufs_zlist_item_t* item) {
     int i;
     item->next = ul_trans_i64_le(item->next);
@@ -8,7 +15,7 @@ static void _trans_zlist(_ufs_zlist_item_t* item) {
 }
 static _ufs_zlist_item_t* _todisk_alloc(const _ufs_zlist_item_t* item) {
     int i;
-    _ufs_zlist_item_t* ret = ul_reinterpret_cast(_ufs_zlist_item_t*, ufs_malloc(sizeof(_ufs_zlist_item_t)));
+    _ufs_zlist_item_t* ret = ul_reinterpret_cast(_ufs_zlist_item_t*, ufs_block_alloc());
     if(ufs_unlikely(ret == NULL)) return ret;
     ret->next = ul_trans_u64_le(item->next);
     for(i = 0; i < item->num; ++i)
@@ -70,50 +77,161 @@ static int _write_multi_zlist(const _ufs_zlist_t* ufs_restrict zlist, ufs_transc
     return 0;
 }
 
-UFS_HIDDEN int ufs_zlist_init(ufs_zlist_t* zlist, uint64_t start, uint64_t block) {
-    int ec;
+#define _UNDO_POP 0 // 从栈中弹出
+#define _UNDO_POP_ITEM 1 // 弹出空的栈顶节点
+#define _UNDO_PUSH 2 // 压入栈中
+#define _UNDO_PUSH_ITEM 3 // 压入新的栈顶节点
+#define _UNDO_SYNC 4 // 只修改了stop
+#define _UNDO_SNAP 5 // 整体修改缓存，需要快照
+#define _UNDO_POP_LAZY 6 // 取出未使用过的区块（记录取出的数量）
+#define _UNDO_SET 7 // 修改栈顶的一项（记录修改前的内容）
+// 在修改之前记录操作，撤销日志已满时改为快照
+static void _undo_log(ufs_zlist_t* zlist, int op, uint64_t znum) {
+    _ufs_zlist_undo_t* undo;
+    if(zlist->undo_snap) return;
+    if(op == _UNDO_SNAP || zlist->undo_num == UFS_ZLIST_UNDO_MAX) {
+        zlist->backup = zlist->now;
+        zlist->undo_snap = 1;
+        return;
+    }
+    undo = zlist->undo + zlist->undo_num++;
+    undo->znum = znum;
+    undo->op = op;
+    undo->stop = zlist->now.stop;
+}
+UFS_HIDDEN void ufs_zlist_rollback(ufs_zlist_t* zlist) {
+    _ufs_zlist_t* now = &zlist->now;
+    const _ufs_zlist_undo_t* undo;
+    if(zlist->bitmap) {
+        ufs_zbitmap_rollback(zlist->bitmap);
+        now->block = zlist->bitmap->free;
+        return;
+    }
+    if(zlist->undo_snap) *now = zlist->backup;
+    while(zlist->undo_num > 0) {
+        undo = zlist->undo + --zlist->undo_num;
+        switch(undo->op) {
+        case _UNDO_POP:
+            now->item[now->top - 1].stack[now->item[now->top - 1].num++] = undo->znum;
+            now->block += _ent_len(undo->znum);
+            break;
+        case _UNDO_POP_ITEM:
+            now->item[now->top - 1].znum = now->item[now->top].next = undo->znum;
+            now->item[now->top].num = 0;
+            ++now->top;
+            ++now->block;
+            break;
+        case _UNDO_PUSH:
+            now->block -= _ent_len(now->item[now->top - 1].stack[--now->item[now->top - 1].num]);
+            break;
+        case _UNDO_PUSH_ITEM:
+            --now->top;
+            --now->block;
+            break;
+        case _UNDO_POP_LAZY:
+            now->lazy -= undo->znum;
+            now->block += undo->znum;
+            break;
+        case _UNDO_SET: {
+            uint64_t* e = now->item[now->top - 1].stack + now->item[now->top - 1].num - 1;
+            now->block = now->block - _ent_len(*e) + _ent_len(undo->znum);
+            *e = undo->znum;
+            break;
+        }
+        default:
+            break;
+        }
+        now->stop = undo->stop;
+    }
+    zlist->undo_snap = 0;
+}
 
+UFS_HIDDEN int ufs_zlist_init(ufs_zlist_t* zlist, uint64_t start, uint64_t block, uint64_t lazy, uint64_t lazy_end) {
     zlist->bnum = start;
+    zlist->bitmap = NULL;
+    zlist->lazy_end = lazy_end;
+    zlist->range = 0;
     // zlist->transcation = NULL;
     ulatomic_spinlock_init(&zlist->lock);
+    return ufs_zlist_reload(zlist, block, lazy);
+}
+UFS_HIDDEN int ufs_zlist_init_bitmap(ufs_zlist_t* zlist, uint64_t start) {
+    int ec;
+    zlist->bnum = start;
+    zlist->bitmap = NULL;
+    zlist->lazy_end = 0;
+    zlist->range = 0;
+    zlist->now.lazy = 0;
+    ulatomic_spinlock_init(&zlist->lock);
+    ec = ufs_zbitmap_load(&zlist->bitmap, zlist->transcation, start);
+    if(ufs_unlikely(ec)) return ec;
+    zlist->now.block = zlist->bitmap->free;
+    zlist->undo_num = 0;
+    zlist->undo_snap = 0;
+    return 0;
+}
+UFS_HIDDEN int ufs_zlist_reload(ufs_zlist_t* zlist, uint64_t block, uint64_t lazy) {
+    int ec;
 
+    if(zlist->bitmap) { // 空闲区块数以位图为准
+        ec = ufs_zbitmap_reload(zlist->bitmap, zlist->transcation);
+        zlist->now.block = zlist->bitmap->free;
+        return ec;
+    }
     zlist->now.block = block;
-    ec = _rewind_zlist(&zlist->now, zlist->transcation, start);
+    zlist->now.lazy = lazy;
+    ec = _rewind_zlist(&zlist->now, zlist->transcation, zlist->bnum);
     if(ufs_unlikely(ec)) return ec;
     if(ufs_unlikely(zlist->now.top == 0)) { // 内存中必须至少滞留一个块
         zlist->now.item[0].next = 0;
         zlist->now.item[0].num = 0;
-        zlist->now.block = 0;
+        zlist->now.block = zlist->lazy_end - lazy;
         zlist->now.top = 1;
         zlist->now.stop = 0;
     }
 
-    zlist->backup.item[0].next = 0;
-    zlist->backup.item[0].num = 0;
-    zlist->backup.block = 0;
-    zlist->backup.top = 1;
-    zlist->backup.stop = 0;
+    zlist->undo_num = 0;
+    zlist->undo_snap = 0;
     return 0;
 }
 UFS_HIDDEN void ufs_zlist_deinit(ufs_zlist_t* zlist) {
-    (void)zlist;
+    ufs_zbitmap_destroy(zlist->bitmap);
+    zlist->bitmap = NULL;
 }
 UFS_HIDDEN int ufs_zlist_create_empty(ufs_zlist_t* zlist, uint64_t start) {
     zlist->bnum = start;
+    zlist->bitmap = NULL;
+    zlist->lazy_end = 0;
+    zlist->range = 0;
     zlist->transcation = NULL;
     ulatomic_spinlock_init(&zlist->lock);
 
     zlist->now.item[0].next = 0;
     zlist->now.item[0].num = 0;
     zlist->now.block = 0;
+    zlist->now.lazy = 0;
     zlist->now.top = 1;
     zlist->now.stop = 0;
 
-    zlist->backup.item[0].next = 0;
-    zlist->backup.item[0].num = 0;
-    zlist->backup.block = 0;
-    zlist->backup.top = 1;
-    zlist->backup.stop = 0;
+    zlist->undo_num = 0;
+    zlist->undo_snap = 0;
+    return 0;
+}
+UFS_HIDDEN int ufs_zlist_create_lazy(ufs_zlist_t* zlist, uint64_t start, uint64_t lazy, uint64_t lazy_end) {
+    int ec;
+    ec = ufs_zlist_create_empty(zlist, start);
+    if(ufs_unlikely(ec)) return ec;
+    zlist->lazy_end = lazy_end;
+    zlist->now.lazy = lazy;
+    zlist->now.block = lazy_end - lazy;
+    return 0;
+}
+
+UFS_HIDDEN int ufs_zlist_create_bitmap(ufs_zlist_t* zlist, uint64_t start, uint64_t zstart, uint64_t zsize) {
+    int ec;
+    ec = ufs_zbitmap_create(&zlist->bitmap, zlist->transcation, start, zstart, zsize);
+    if(ufs_unlikely(ec)) return ec;
+    zlist->now.block = zlist->bitmap->free;
     return 0;
 }
 
@@ -121,7 +239,13 @@ UFS_HIDDEN int ufs_zlist_sync(ufs_zlist_t* zlist) {
     int ec;
     uint64_t block = ul_trans_u64_le(zlist->now.block);
 
+    if(zlist->bitmap) {
+        ec = ufs_zbitmap_sync(zlist->bitmap, zlist->transcation);
+        if(ufs_unlikely(ec)) return ec;
+        return ufs_transcation_add(zlist->transcation, &block, UFS_BNUM_SB, offsetof(ufs_sb_t, zblock), 8, UFS_JORNAL_ADD_COPY);
+    }
     ufs_assert(zlist->now.top > 0);
+    _undo_log(zlist, _UNDO_SYNC, 0);
     ec = _write_multi_zlist(&zlist->now, zlist->transcation, zlist->now.stop, zlist->now.top - 1);
     if(ufs_unlikely(ec)) return ec;
     ec = _write_zlist(zlist->now.item + zlist->now.top - 1, zlist->transcation, zlist->bnum);
@@ -129,61 +253,215 @@ UFS_HIDDEN int ufs_zlist_sync(ufs_zlist_t* zlist) {
     zlist->now.stop = zlist->now.top;
     ec = ufs_transcation_add(zlist->transcation, &block, UFS_BNUM_SB, offsetof(ufs_sb_t, zblock), 8, UFS_JORNAL_ADD_COPY);
     if(ufs_unlikely(ec)) return ec;
+    if(zlist->lazy_end) {
+        uint64_t lazy = ul_trans_u64_le(zlist->now.lazy);
+        ec = ufs_transcation_add(zlist->transcation, &lazy, UFS_BNUM_ILIST, UFS_LAZY_OFFSET + offsetof(ufs_lazy_t, zlazy), 8, UFS_JORNAL_ADD_COPY);
+        if(ufs_unlikely(ec)) return ec;
+    }
     return 0;
 }
-UFS_HIDDEN int ufs_zlist_pop(ufs_zlist_t* ufs_restrict zlist, uint64_t* ufs_restrict pznum) {
+// 位图中从上一次分配的位置开始查找（连续分配的区块尽量相邻）
+static int _zbitmap_pop(ufs_zlist_t* ufs_restrict zlist, uint64_t* ufs_restrict pznum) {
     int ec;
-    int n = zlist->now.top;
+    uint64_t pos;
+    _ufs_zbitmap_t* bm = zlist->bitmap;
 
-    ufs_assert(n > 0);
-    if(zlist->now.item[n - 1].num != 0) { // 栈还足够
-        _ufs_zlist_item_t* item = zlist->now.item + n - 1;
-        *pznum = item->stack[--item->num];
-        --zlist->now.block;
-        zlist->now.stop = ufs_min(zlist->now.stop, n - 1);
+    ec = ufs_zbitmap_find(bm, bm->hint, 1, &pos);
+    if(ufs_unlikely(ec)) return ec;
+    ec = ufs_zbitmap_alloc(bm, pos);
+    if(ufs_unlikely(ec)) return ec;
+    bm->hint = pos + 1;
+    zlist->now.block = bm->free;
+    *pznum = bm->base + pos;
+    return 0;
+}
+// 栈节点所在的块作为空闲区块弹出后，磁盘上的链表在提交持久化之前仍然指向它。
+// 将清零写入事务，使其提交后留在日志中，直接写入之前的ufs_jornal_reuse会先持久化这次提交。
+static int _claim_item(ufs_zlist_t* zlist, uint64_t znum) {
+    return ufs_transcation_add_zero_block(zlist->transcation, znum);
+}
+// 弹出至多n个连续的区块[*pznum, *pznum + *plen)，只有栈顶的一段和未使用过的区块可以一次弹出多个
+static int _zlist_pop(ufs_zlist_t* ufs_restrict zlist, uint64_t n, uint64_t* ufs_restrict pznum, uint64_t* ufs_restrict plen) {
+    int ec;
+    int top = zlist->now.top;
+
+    *plen = 1;
+    if(zlist->bitmap) return _zbitmap_pop(zlist, pznum);
+    ufs_assert(top > 0);
+    if(zlist->now.item[top - 1].num != 0) { // 栈还足够
+        _ufs_zlist_item_t* item = zlist->now.item + top - 1;
+        const uint64_t e = item->stack[item->num - 1];
+        *pznum = _ent_start(e);
+        *plen = _ent_len(e);
+        if(*plen > n) { // 从一段的开头取出一部分
+            _undo_log(zlist, _UNDO_SET, e);
+            item->stack[item->num - 1] = _ent(*pznum + n, *plen - n);
+            *plen = n;
+        } else {
+            _undo_log(zlist, _UNDO_POP, e);
+            --item->num;
+        }
+        zlist->now.block -= *plen;
+        zlist->now.stop = ufs_min(zlist->now.stop, top - 1);
         return 0;
     }
-    if(n > 1) { // 内存中还存有多余的链表
-        *pznum = zlist->now.item[n - 1].next;
-        zlist->now.top = --n;
+    if(top > 1) { // 内存中还存有多余的链表
+        ec = _claim_item(zlist, zlist->now.item[top - 1].next);
+        if(ufs_unlikely(ec)) return ec;
+        _undo_log(zlist, _UNDO_POP_ITEM, zlist->now.item[top - 1].next);
+        *pznum = zlist->now.item[top - 1].next;
+        zlist->now.top = --top;
         --zlist->now.block;
         zlist->now.stop = ufs_min(zlist->now.stop, zlist->now.top);
         return 0;
     }
-    if(zlist->now.item[0].next == 0) // 磁盘耗尽
-        return UFS_ENOSPC;
+    if(zlist->now.item[0].next == 0) { // 链表耗尽，取出未使用过的区块
+        if(zlist->now.lazy >= zlist->lazy_end) return UFS_ENOSPC; // 磁盘耗尽
+        *plen = ufs_min(n, zlist->lazy_end - zlist->now.lazy);
+        _undo_log(zlist, _UNDO_POP_LAZY, *plen);
+        *pznum = zlist->now.lazy;
+        zlist->now.lazy += *plen;
+        zlist->now.block -= *plen;
+        return 0;
+    }
+    _undo_log(zlist, _UNDO_SNAP, 0);
     *pznum = zlist->now.item[0].next;
     ec = _rewind_zlist(&zlist->now, zlist->transcation, *pznum);
+    if(ufs_likely(ec == 0)) ec = _claim_item(zlist, *pznum); // 读取之后才能清零
     if(ufs_unlikely(ec)) { *pznum = 0; return ec; }
     --zlist->now.block;
     return 0;
 }
-UFS_HIDDEN int ufs_zlist_push(ufs_zlist_t* zlist, uint64_t znum) {
+UFS_HIDDEN int ufs_zlist_pop(ufs_zlist_t* ufs_restrict zlist, uint64_t* ufs_restrict pznum) {
+    uint64_t len;
+    return _zlist_pop(zlist, 1, pznum, &len);
+}
+static int _zbitmap_pop_extent(ufs_zlist_t* ufs_restrict zlist, uint64_t goal, uint64_t n,
+        uint64_t* ufs_restrict pstart, uint64_t* ufs_restrict plen) {
+    int ec;
+    uint64_t pos, len, i;
+    _ufs_zbitmap_t* bm = zlist->bitmap;
+    const uint64_t from = goal >= bm->base ? goal - bm->base : bm->hint;
+
+    if(ufs_zbitmap_find(bm, from, ufs_min(n, bm->free), &pos) == 0) len = ufs_min(n, bm->free);
+    else {
+        ec = ufs_zbitmap_find(bm, from, 1, &pos);
+        if(ufs_unlikely(ec)) return ec;
+        len = ufs_zbitmap_run(bm, pos, n);
+    }
+    for(i = 0; i < len; ++i) {
+        ec = ufs_zbitmap_alloc(bm, pos + i);
+        if(ufs_unlikely(ec)) return ec;
+    }
+    if(goal < bm->base) bm->hint = pos + len; // 按目标分配不影响其余分配的位置
+    zlist->now.block = bm->free;
+    *pstart = bm->base + pos;
+    *plen = len;
+    return 0;
+}
+UFS_HIDDEN uint64_t ufs_zlist_goal(const ufs_zlist_t* zlist, uint64_t key) {
+    const _ufs_zbitmap_t* bm = zlist->bitmap;
+    if(bm == NULL) return 0;
+    // 乘以2^64除以黄金分割数，取高24位作为比例（相邻的key落在相距较远的位置，且分布均匀）
+    return bm->base + (((key * UINT64_C(0x9e3779b97f4a7c15)) >> 40) * bm->bits >> 24);
+}
+// 不修改链表，查看下一个将要弹出的区块（需要从磁盘读取时返回0）
+static uint64_t _zlist_peek(const ufs_zlist_t* zlist) {
+    const _ufs_zlist_item_t* item = zlist->now.item + zlist->now.top - 1;
+    if(item->num != 0) return _ent_start(item->stack[item->num - 1]);
+    if(zlist->now.top > 1) return item->next;
+    if(item->next == 0 && zlist->now.lazy < zlist->lazy_end) return zlist->now.lazy;
+    return 0;
+}
+UFS_HIDDEN int ufs_zlist_pop_extent(ufs_zlist_t* ufs_restrict zlist, uint64_t goal, uint64_t n,
+        uint64_t* ufs_restrict pstart, uint64_t* ufs_restrict plen) {
+    int ec;
+    uint64_t znum, len;
+
+    if(ufs_unlikely(n == 0)) return UFS_EINVAL;
+    if(zlist->bitmap) {
+        ec = _zbitmap_pop_extent(zlist, goal, n, pstart, plen);
+        if(ufs_unlikely(ec)) return ec;
+    } else {
+        ec = _zlist_pop(zlist, n, pstart, plen);
+        if(ufs_unlikely(ec)) return ec;
+        for(; *plen < n && _zlist_peek(zlist) == *pstart + *plen; *plen += len) {
+            ec = _zlist_pop(zlist, n - *plen, &znum, &len);
+            if(ufs_unlikely(ec)) return ec;
+        }
+    }
+    return 0;
+}
+// 压入连续的区块[znum, znum + len)（len <= _ENT_MAX，不支持UFS_SB_EXT_ZRANGE时len为1），栈已满时第一个区块作为新的栈节点
+static int _zlist_push(ufs_zlist_t* zlist, uint64_t znum, uint64_t len) {
     int ec;
     int n = zlist->now.top;
+    _ufs_zlist_item_t* item = zlist->now.item + n - 1;
 
     ufs_assert(n > 0);
-    if(zlist->now.item[n - 1].num != UFS_ZLIST_ENTRY_NUM_MAX) {  // 栈还足够
-        _ufs_zlist_item_t* item = zlist->now.item + n - 1;
-        item->stack[item->num++] = znum;
-        ++zlist->now.block;
+    if(zlist->range && item->num != 0) { // 与栈顶的一段相邻时直接合并
+        const uint64_t e = item->stack[item->num - 1];
+        const uint64_t start = _ent_start(e), elen = _ent_len(e);
+        if(elen + len <= _ENT_MAX && (start + elen == znum || znum + len == start)) {
+            _undo_log(zlist, _UNDO_SET, e);
+            item->stack[item->num - 1] = _ent(ufs_min(start, znum), elen + len);
+            zlist->now.block += len;
+            zlist->now.stop = ufs_min(zlist->now.stop, n - 1);
+            return 0;
+        }
+    }
+    if(item->num != UFS_ZLIST_ENTRY_NUM_MAX) {  // 栈还足够
+        _undo_log(zlist, _UNDO_PUSH, _ent(znum, len));
+        item->stack[item->num++] = _ent(znum, len);
+        zlist->now.block += len;
         zlist->now.stop = ufs_min(zlist->now.stop, n - 1);
         return 0;
     }
-    if(n == UFS_ZLIST_CACHE_LIST_LIMIT) { // 内存中空间不足，我们写回链表
-        ec = _write_multi_zlist(&zlist->now, zlist->transcation, 0, UFS_ZLIST_CACHE_LIST_LIMIT);
+    if(n == UFS_ZLIST_CACHE_LIST_LIMIT) { // 内存中空间不足，我们写回链表（栈顶节点保存在固定位置，同步时再写入）
+        _undo_log(zlist, _UNDO_SNAP, 0);
+        ec = _write_multi_zlist(&zlist->now, zlist->transcation, 0, UFS_ZLIST_CACHE_LIST_LIMIT - 1);
         if(ufs_unlikely(ec)) return ec;
         memmove(zlist->now.item, zlist->now.item + UFS_ZLIST_CACHE_LIST_LIMIT / 2,
             (UFS_ZLIST_CACHE_LIST_LIMIT - UFS_ZLIST_CACHE_LIST_LIMIT / 2) * sizeof(zlist->now.item[0]));
         n = UFS_ZLIST_CACHE_LIST_LIMIT / 2;
+        zlist->now.stop = n - 1;
+    } else {
+        _undo_log(zlist, _UNDO_PUSH_ITEM, znum);
     }
     zlist->now.item[n - 1].znum = zlist->now.item[n].next = znum;
     zlist->now.item[n].num = 0;
     zlist->now.top = ++n;
     ++zlist->now.block;
     zlist->now.stop = ufs_min(zlist->now.stop, n - 2);
+    if(len > 1) return _zlist_push(zlist, znum + 1, len - 1); // 新的栈为空，不会再次分裂
     return 0;
 }
+UFS_HIDDEN int ufs_zlist_push(ufs_zlist_t* zlist, uint64_t znum) {
+    int ec;
+    if(zlist->bitmap) {
+        if(ufs_unlikely(znum < zlist->bitmap->base)) return UFS_EINVAL;
+        ec = ufs_zbitmap_free(zlist->bitmap, znum - zlist->bitmap->base);
+        zlist->now.block = zlist->bitmap->free;
+        return ec;
+    }
+    return _zlist_push(zlist, znum, 1);
+}
+UFS_HIDDEN int ufs_zlist_push_range(ufs_zlist_t* zlist, uint64_t znum, uint64_t len) {
+    int ec = 0;
+    uint64_t n;
+    if(ufs_unlikely(len == 0)) return UFS_EINVAL;
+    for(; len > 0; znum += n, len -= n) {
+        if(zlist->bitmap || !zlist->range) {
+            n = 1;
+            ec = ufs_zlist_push(zlist, znum);
+        } else {
+            n = ufs_min(len, _ENT_MAX);
+            ec = _zlist_push(zlist, znum, n);
+        }
+        if(ufs_unlikely(ec)) break;
+    }
+    return ec;
+}
 
 UFS_HIDDEN void ufs_zlist_debug(const ufs_zlist_t* zlist, FILE* fp) {
     fprintf(fp, "zlist [%p]\n", ufs_const_cast(void*, zlist));
@@ -191,10 +469,13 @@ UFS_HIDDEN void ufs_zlist_debug(const ufs_zlist_t* zlist, FILE* fp) {
     fprintf(fp, "\ttranscation: [%p]\n", ufs_const_cast(void*, zlist->transcation));
 
     fprintf(fp, "\tavailable: %" PRIu64 "\n", zlist->now.block);
+    if(zlist->bitmap) {
+        ufs_zbitmap_debug(zlist->bitmap, fp);
+        return;
+    }
+    if(zlist->lazy_end) fprintf(fp, "\tuntouched: [%" PRIu64 ", %" PRIu64 ")\n", zlist->now.lazy, zlist->lazy_end);
     fprintf(fp, "\tcached length: %d\n", zlist->now.top);
     fprintf(fp, "\tsynced length: %d\n", zlist->now.stop);
 
-    fprintf(fp, "\t<backup>available: %" PRIu64 "\n", zlist->now.block);
-    fprintf(fp, "\t<backup>cached length: %d\n", zlist->now.top);
-    fprintf(fp, "\t<backup>synced length: %d\n", zlist->now.stop);
+    fprintf(fp, "\tundo length: %d%s\n", zlist->undo_num, zlist->undo_snap ? " (snapshot)" : "");
 }
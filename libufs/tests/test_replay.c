@@ -0,0 +1,647 @@
+/**
+ * 重放与重新挂载的一致性测试
+ *
+ * 对每一种格式化/挂载选项：格式化内存磁盘，写入并同步若干文件，在运行中途复制磁盘镜像（相当于此时断电），
+ * 然后挂载镜像，检查已同步文件的内容以及statvfs中空闲区块和inode的数量，再次挂载检查重放的结果不变。
+ * 之后是单独构造的场景：日志中有足够多的区块时使用多个线程重放。
+*/
+#include "libufs.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef LIBUFS_NO_THREAD_SAFE
+    #ifdef _WIN32
+        #include <windows.h>
+    #else
+        #include <pthread.h>
+    #endif
+#endif
+
+#define DISK_SIZE (16ull << 20) // 磁盘大小
+#define FILE_NUM 12 // 同步后检查的文件数量
+#define BUF_SIZE (64 * 1024) // 最大文件大小
+#define APPEND_SIZE 30000 // 交替追加的文件大小
+#define APPEND_CHUNK 1000 // 每次追加的大小
+#define THREAD_NUM 4 // 并发写入的线程数
+#define THREAD_FILES 6 // 每个线程写入并删除的文件数
+
+typedef struct test_case_t {
+    const char* name;
+    ufs_format_opt_t format;
+    ufs_mount_opt_t mount;
+    // 同步不一定立即持久化（UFS_DURABILITY_PERIODIC）：运行中途的快照只检查两次挂载的结果一致
+    int lossy;
+} test_case_t;
+
+#define CHECK(expr) do { int _ec = (expr); if(_ec) { \
+    fprintf(stderr, "%s:%d: %s -> [%d] %s\n", __FILE__, __LINE__, #expr, _ec, ufs_strerror(_ec)); \
+    return 1; } } while(0)
+#define EXPECT(cond, ...) do { if(!(cond)) { \
+    fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); \
+    return 1; } } while(0)
+
+// 第i个文件的大小（跨越直接块和间接块）
+static size_t file_size(int i) {
+    static const size_t sizes[] = { 0, 1, 100, 1023, 1024, 3000, 8192, 9000, 20000, 33000, 50000, BUF_SIZE };
+    return sizes[i % (int)(sizeof(sizes) / sizeof(sizes[0]))];
+}
+// 第i个文件的内容
+static void file_fill(unsigned char* buf, size_t len, int i) {
+    size_t k;
+    uint32_t x = 2166136261u ^ (uint32_t)i;
+    for(k = 0; k < len; ++k) {
+        x = x * 16777619u + 1u;
+        buf[k] = (unsigned char)(x >> 24);
+    }
+}
+static void file_name(char* name, int i) {
+    snprintf(name, 32, "/d%d/f%d", i % 3, i);
+}
+
+static void context_init(ufs_context_t* context, ufs_t* ufs) {
+    context->ufs = ufs;
+    context->uid = 0;
+    context->gid = 0;
+    context->umask = 0;
+}
+
+static int write_file(ufs_context_t* context, const char* path, const unsigned char* buf, size_t len, int sync) {
+    ufs_file_t* file;
+    size_t written;
+    CHECK(ufs_open(context, &file, path, UFS_O_CREAT | UFS_O_TRUNC | UFS_O_WRONLY, 0644));
+    if(len) CHECK(ufs_write(file, buf, len, &written));
+    if(sync) CHECK(ufs_fsync(file, 0));
+    CHECK(ufs_close(file));
+    return 0;
+}
+static int check_file(ufs_context_t* context, const char* path, const unsigned char* buf, size_t len) {
+    static unsigned char rbuf[BUF_SIZE + 1];
+    ufs_file_t* file;
+    size_t nread = 0;
+    CHECK(ufs_open(context, &file, path, UFS_O_RDONLY, 0));
+    CHECK(ufs_read(file, rbuf, sizeof(rbuf), &nread));
+    CHECK(ufs_close(file));
+    EXPECT(nread == len, "%s: size %zu, expected %zu", path, nread, len);
+    EXPECT(memcmp(rbuf, buf, len) == 0, "%s: content mismatch", path);
+    return 0;
+}
+static int check_files(ufs_context_t* context) {
+    static unsigned char buf[BUF_SIZE];
+    char name[32];
+    int i;
+    for(i = 0; i < FILE_NUM; ++i) {
+        file_fill(buf, file_size(i), i);
+        file_name(name, i);
+        if(check_file(context, name, buf, file_size(i))) return 1;
+    }
+    for(i = 0; i < 2; ++i) {
+        file_fill(buf, APPEND_SIZE, 300 + i);
+        if(check_file(context, i ? "/d0/b" : "/d0/a", buf, APPEND_SIZE)) return 1;
+    }
+    return 0;
+}
+
+// 复制磁盘的当前内容
+static int snapshot(ufs_vfs_t* vfs, ufs_vfs_t** pcopy) {
+    int ec;
+    size_t len;
+    const char* mem;
+    ufs_vfs_lock_memory(vfs);
+    mem = ufs_vfs_get_memory(vfs, &len);
+    ec = ufs_vfs_open_memory(pcopy, mem, len);
+    ufs_vfs_unlock_memory(vfs);
+    return ec;
+}
+
+typedef struct test_thread_t {
+    int (*func)(void* arg);
+    void* arg;
+    int ret;
+} test_thread_t;
+#if defined(LIBUFS_NO_THREAD_SAFE)
+#elif defined(_WIN32)
+static DWORD WINAPI thread_entry(LPVOID opaque) {
+    test_thread_t* thread = (test_thread_t*)opaque;
+    thread->ret = thread->func(thread->arg);
+    return 0;
+}
+#else
+static void* thread_entry(void* opaque) {
+    test_thread_t* thread = (test_thread_t*)opaque;
+    thread->ret = thread->func(thread->arg);
+    return NULL;
+}
+#endif
+// 在n个线程中分别执行func(args[i])（单线程模式下依次执行），任一失败时返回1
+static int run_threads(int (*func)(void* arg), void* const* args, int n) {
+    test_thread_t threads[THREAD_NUM];
+#if defined(LIBUFS_NO_THREAD_SAFE)
+#elif defined(_WIN32)
+    HANDLE handles[THREAD_NUM];
+#else
+    pthread_t handles[THREAD_NUM];
+#endif
+    int i, started, failed = 0;
+    for(started = 0; started < n; ++started) {
+        threads[started].func = func;
+        threads[started].arg = args[started];
+        threads[started].ret = 0;
+#if defined(LIBUFS_NO_THREAD_SAFE)
+        threads[started].ret = func(args[started]);
+#elif defined(_WIN32)
+        handles[started] = CreateThread(NULL, 0, thread_entry, threads + started, 0, NULL);
+        if(handles[started] == NULL) { failed = 1; break; }
+#else
+        if(pthread_create(handles + started, NULL, thread_entry, threads + started) != 0) { failed = 1; break; }
+#endif
+    }
+    for(i = 0; i < started; ++i) {
+#if defined(LIBUFS_NO_THREAD_SAFE)
+#elif defined(_WIN32)
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+        if(threads[i].ret) failed = 1;
+    }
+    if(failed) fprintf(stderr, "%d of %d threads failed\n", failed, n);
+    return failed;
+}
+
+typedef struct writer_t {
+    ufs_t* ufs;
+    int id;
+    unsigned char buf[BUF_SIZE];
+    unsigned char rbuf[BUF_SIZE];
+} writer_t;
+// 写入、只同步数据、读回后删除若干文件，结束后空闲数量不变
+static int writer(void* arg) {
+    writer_t* w = (writer_t*)arg;
+    ufs_context_t context;
+    ufs_file_t* file;
+    size_t len, done;
+    char name[32];
+    int i;
+    context_init(&context, w->ufs);
+    for(i = 0; i < THREAD_FILES; ++i) {
+        len = file_size(w->id + i * THREAD_NUM);
+        file_fill(w->buf, len, 400 + w->id * THREAD_FILES + i);
+        snprintf(name, sizeof(name), "/d2/t%d_%d", w->id, i);
+        CHECK(ufs_open(&context, &file, name, UFS_O_CREAT | UFS_O_TRUNC | UFS_O_RDWR, 0644));
+        if(len) CHECK(ufs_write(file, w->buf, len, &done));
+        CHECK(ufs_fsync(file, 1));
+        done = 0;
+        CHECK(ufs_pread(file, w->rbuf, BUF_SIZE, 0, &done));
+        CHECK(ufs_close(file));
+        EXPECT(done == len && memcmp(w->rbuf, w->buf, len) == 0, "%s: read back mismatch", name);
+        CHECK(ufs_unlink(&context, name));
+    }
+    return 0;
+}
+
+/**
+ * 挂载镜像两次，检查两次的空闲数量相同、已同步的文件完好，
+ * expect不为NULL时还要求空闲数量与之相同；durable为0时镜像中不一定包含同步的修改，只检查两次挂载一致
+*/
+static int remount(const test_case_t* test, ufs_vfs_t* vfs, const ufs_statvfs_t* expect, int durable) {
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_statvfs_t first, second;
+    ufs_mount_opt_t mount = test->mount;
+    int round;
+
+    // 不启动后台回收，挂载时回收完上次遗留的孤儿
+    mount.reclaim_batch = 0;
+    for(round = 0; round < 2; ++round) {
+        ufs_statvfs_t* st = round ? &second : &first;
+        CHECK(ufs_new_ex(&ufs, vfs, &mount));
+        context_init(&context, ufs);
+        if(durable && check_files(&context)) { ufs_destroy(ufs); return 1; }
+        CHECK(ufs_statvfs(ufs, st));
+        ufs_destroy(ufs);
+    }
+    EXPECT(first.f_bfree == second.f_bfree && first.f_ffree == second.f_ffree,
+        "free count changed between mounts: blocks %" PRIu64 "/%" PRIu64 ", inodes %" PRIu64 "/%" PRIu64,
+        first.f_bfree, second.f_bfree, first.f_ffree, second.f_ffree);
+    if(expect && durable) EXPECT(first.f_bfree == expect->f_bfree && first.f_ffree == expect->f_ffree,
+        "free count after replay: blocks %" PRIu64 " expected %" PRIu64 ", inodes %" PRIu64 " expected %" PRIu64,
+        first.f_bfree, expect->f_bfree, first.f_ffree, expect->f_ffree);
+    return 0;
+}
+
+static int run(const test_case_t* test) {
+    static unsigned char buf[BUF_SIZE];
+    static writer_t writers[THREAD_NUM];
+    void* args[THREAD_NUM];
+    ufs_vfs_t *vfs, *synced, *reclaim, *midway;
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_file_t* file;
+    ufs_statvfs_t st_synced, st;
+    size_t written;
+    char name[32];
+    int i;
+
+    CHECK(ufs_vfs_open_memory(&vfs, NULL, 0));
+    CHECK(ufs_new_format_ex(&ufs, vfs, DISK_SIZE, &test->format));
+    // 重新挂载，只在挂载已有磁盘时生效的选项（例如zcache_upgrade）也作用于之后的修改
+    ufs_destroy(ufs);
+    CHECK(ufs_new_ex(&ufs, vfs, &test->mount));
+    context_init(&context, ufs);
+
+    // 写入并同步，随后的修改不再触及这些文件
+    CHECK(ufs_mkdir(&context, "/d0", 0755));
+    CHECK(ufs_mkdir(&context, "/d1", 0755));
+    CHECK(ufs_mkdir(&context, "/d2", 0755));
+    for(i = 0; i < FILE_NUM; ++i) {
+        file_fill(buf, file_size(i), i);
+        file_name(name, i);
+        if(write_file(&context, name, buf, file_size(i), 1)) return 1;
+    }
+    // 交替追加两个文件，各自的区块应当仍然可以正确读回
+    do {
+        static unsigned char abuf[APPEND_SIZE];
+        ufs_file_t* other;
+        size_t off;
+        file_fill(buf, APPEND_SIZE, 300);
+        file_fill(abuf, APPEND_SIZE, 301);
+        CHECK(ufs_open(&context, &file, "/d0/a", UFS_O_CREAT | UFS_O_WRONLY | UFS_O_APPEND, 0644));
+        CHECK(ufs_open(&context, &other, "/d0/b", UFS_O_CREAT | UFS_O_WRONLY | UFS_O_APPEND, 0644));
+        for(off = 0; off < APPEND_SIZE; off += APPEND_CHUNK) {
+            CHECK(ufs_write(file, buf + off, APPEND_CHUNK, &written));
+            CHECK(ufs_write(other, abuf + off, APPEND_CHUNK, &written));
+        }
+        CHECK(ufs_fsync(file, 0));
+        CHECK(ufs_fsync(other, 0));
+        CHECK(ufs_close(file));
+        CHECK(ufs_close(other));
+    } while(0);
+    // 预分配、截断和重命名
+    CHECK(ufs_open(&context, &file, "/pre", UFS_O_CREAT | UFS_O_RDWR, 0644));
+    CHECK(ufs_fallocate(file, 0, 40000));
+    CHECK(ufs_ftruncate(file, 5000));
+    CHECK(ufs_close(file));
+    CHECK(ufs_rename(&context, "/pre", "/d1/pre"));
+    CHECK(ufs_sync(ufs));
+    CHECK(ufs_statvfs(ufs, &st_synced));
+    // 中止的事务撤销其中的分配，不影响空闲数量和快照
+    CHECK(ufs_txn_begin(&context));
+    file_fill(buf, BUF_SIZE, 150);
+    if(write_file(&context, "/d2/txn", buf, BUF_SIZE, 1)) return 1;
+    CHECK(ufs_unlink(&context, "/d0/f0"));
+    CHECK(ufs_txn_abort(&context));
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == st_synced.f_bfree && st.f_ffree == st_synced.f_ffree, "free count changed by an aborted transaction");
+    CHECK(snapshot(vfs, &synced));
+
+    // 多个线程同时写入并删除文件
+    for(i = 0; i < THREAD_NUM; ++i) {
+        writers[i].ufs = ufs;
+        writers[i].id = i;
+        args[i] = writers + i;
+    }
+    if(run_threads(writer, args, THREAD_NUM)) return 1;
+
+    // 删除仍被打开的文件，关闭后回收（使用孤儿链表和后台回收时快照中还有没有回收完的孤儿）
+    file_fill(buf, BUF_SIZE, 100);
+    CHECK(ufs_open(&context, &file, "/tmp", UFS_O_CREAT | UFS_O_RDWR, 0644));
+    CHECK(ufs_write(file, buf, BUF_SIZE, &written));
+    CHECK(ufs_fsync(file, 0));
+    CHECK(ufs_unlink(&context, "/tmp"));
+    CHECK(ufs_close(file));
+    CHECK(ufs_sync(ufs));
+    CHECK(snapshot(vfs, &reclaim));
+
+    // 运行中途：没有同步的写入
+    for(i = 0; i < 6; ++i) {
+        snprintf(name, sizeof(name), "/d2/w%d", i);
+        file_fill(buf, file_size(FILE_NUM - 1 - i), 200 + i);
+        if(write_file(&context, name, buf, file_size(FILE_NUM - 1 - i), 0)) return 1;
+    }
+    CHECK(ufs_unlink(&context, "/d1/pre"));
+    CHECK(snapshot(vfs, &midway));
+    ufs_destroy(ufs);
+
+    if(remount(test, synced, &st_synced, !test->lossy)) return 1;
+    if(remount(test, reclaim, &st_synced, !test->lossy)) return 1;
+    if(remount(test, midway, NULL, !test->lossy)) return 1;
+    if(remount(test, vfs, NULL, 1)) return 1;
+
+    synced->close(synced);
+    reclaim->close(reclaim);
+    midway->close(midway);
+    vfs->close(vfs);
+    return 0;
+}
+
+#define RECOVERY_FILES 24 // 多线程重放测试的文件数
+#define RECOVERY_SIZE (16 * 1024) // 每个文件的大小（一次写入，经过日志）
+#define RECOVERY_THREADS 4
+
+/**
+ * 多线程重放：文件数据经过日志（data=journal），同步后日志区中有足够多的区块需要写回，
+ * 复制镜像后破坏这些文件直接块的原位置，挂载时只有重放才能恢复其内容
+*/
+static int run_parallel_recovery(void) {
+    static unsigned char buf[RECOVERY_SIZE];
+    static unsigned char garbage[1024];
+    static ufs_physics_addr_t addr[RECOVERY_FILES];
+    ufs_mount_opt_t mount = { 0 };
+    ufs_format_opt_t format = { 0 };
+    ufs_vfs_t *vfs, *image;
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_mount_stat_t stat;
+    size_t written;
+    char name[32];
+    int i, k;
+
+    mount.data_jornal = RECOVERY_SIZE;
+    format.jornal_size = 4096;
+    format.zalloc = UFS_ZALLOC_BITMAP; // 链表节点块被分配为数据块时需要先检查点
+    format.mount = &mount;
+    CHECK(ufs_vfs_open_memory(&vfs, NULL, 0));
+    CHECK(ufs_new_format_ex(&ufs, vfs, DISK_SIZE, &format));
+    context_init(&context, ufs);
+    for(i = 0; i < RECOVERY_FILES; ++i) {
+        snprintf(name, sizeof(name), "/r%d", i);
+        file_fill(buf, RECOVERY_SIZE, 500 + i);
+        if(write_file(&context, name, buf, RECOVERY_SIZE, 1)) return 1;
+        CHECK(ufs_physics_addr(&context, name, addr + i));
+    }
+    CHECK(snapshot(vfs, &image));
+    ufs_destroy(ufs);
+    vfs->close(vfs);
+
+    memset(garbage, 0xA5, sizeof(garbage));
+    for(i = 0; i < RECOVERY_FILES; ++i)
+        for(k = 0; k < 12; ++k)
+            CHECK(image->pwrite(image, garbage, sizeof(garbage), (int64_t)addr[i].zone_off[k], &written));
+
+    mount.recovery_threads = RECOVERY_THREADS;
+    CHECK(ufs_new_ex(&ufs, image, &mount));
+    CHECK(ufs_mount_stat(ufs, &stat));
+    EXPECT(stat.replay_blocks >= RECOVERY_FILES * 12, "replayed %" PRIu64 " blocks", stat.replay_blocks);
+#ifdef LIBUFS_NO_THREAD_SAFE
+    EXPECT(stat.replay_threads == 1, "replayed with %u threads", (unsigned)stat.replay_threads);
+#else
+    EXPECT(stat.replay_threads > 1, "replayed with %u threads", (unsigned)stat.replay_threads);
+#endif
+    context_init(&context, ufs);
+    for(i = 0; i < RECOVERY_FILES; ++i) {
+        snprintf(name, sizeof(name), "/r%d", i);
+        file_fill(buf, RECOVERY_SIZE, 500 + i);
+        if(check_file(&context, name, buf, RECOVERY_SIZE)) return 1;
+    }
+    ufs_destroy(ufs);
+    image->close(image);
+    return 0;
+}
+
+/**
+ * 只同步数据：覆盖已同步文件的一部分，ufs_fsync(file, 1)之后复制镜像，
+ * 重放后应当读到新的内容（data=journal时数据还在待提交的日志中）
+*/
+static int run_fdatasync(uint32_t data_jornal) {
+    static unsigned char buf[BUF_SIZE];
+    ufs_mount_opt_t mount = { 0 };
+    ufs_format_opt_t format = { 0 };
+    ufs_vfs_t *vfs, *image;
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_file_t* file;
+    size_t written;
+
+    mount.data_jornal = data_jornal;
+    format.mount = &mount;
+    CHECK(ufs_vfs_open_memory(&vfs, NULL, 0));
+    CHECK(ufs_new_format_ex(&ufs, vfs, DISK_SIZE, &format));
+    context_init(&context, ufs);
+    file_fill(buf, 20000, 600);
+    if(write_file(&context, "/f", buf, 20000, 1)) return 1;
+    CHECK(ufs_open(&context, &file, "/f", UFS_O_RDWR, 0));
+    file_fill(buf + 5000, 3000, 601);
+    CHECK(ufs_pwrite(file, buf + 5000, 3000, 5000, &written));
+    CHECK(ufs_fsync(file, 1));
+    CHECK(snapshot(vfs, &image));
+    CHECK(ufs_close(file));
+    ufs_destroy(ufs);
+    vfs->close(vfs);
+
+    CHECK(ufs_new_ex(&ufs, image, &mount));
+    context_init(&context, ufs);
+    if(check_file(&context, "/f", buf, 20000)) return 1;
+    ufs_destroy(ufs);
+    image->close(image);
+    return 0;
+}
+
+#define LOCALITY_BLOCKS 12 // 交替追加的块数（全部位于直接块中）
+#define LOCALITY_EXTENTS 2 // 每个文件最多允许的连续段数
+
+/**
+ * 分配的局部性：逐块交替追加两个文件，每个文件的区块应当大致连续，而不是与另一个文件交错
+ * （链表分配器只能弹出栈顶，启用区块缓存时才能按目标分配）
+*/
+static int run_locality(int zalloc, int zcache) {
+    static const char* const names[2] = { "/a", "/b" };
+    static unsigned char buf[LOCALITY_BLOCKS * UFS_BLOCK_SIZE];
+    ufs_format_opt_t format = { 0 };
+    ufs_vfs_t* vfs;
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_file_t* files[2];
+    ufs_physics_addr_t addr;
+    size_t written;
+    int i, k, extents;
+
+    format.zalloc = zalloc;
+    format.zcache = zcache;
+    CHECK(ufs_vfs_open_memory(&vfs, NULL, 0));
+    CHECK(ufs_new_format_ex(&ufs, vfs, DISK_SIZE, &format));
+    context_init(&context, ufs);
+    file_fill(buf, sizeof(buf), 700);
+    for(i = 0; i < 2; ++i)
+        CHECK(ufs_open(&context, files + i, names[i], UFS_O_CREAT | UFS_O_WRONLY | UFS_O_APPEND, 0644));
+    for(k = 0; k < LOCALITY_BLOCKS; ++k)
+        for(i = 0; i < 2; ++i) CHECK(ufs_write(files[i], buf + k * UFS_BLOCK_SIZE, UFS_BLOCK_SIZE, &written));
+    for(i = 0; i < 2; ++i) CHECK(ufs_close(files[i]));
+
+    for(i = 0; i < 2; ++i) {
+        CHECK(ufs_physics_addr(&context, names[i], &addr));
+        for(extents = 1, k = 1; k < LOCALITY_BLOCKS; ++k)
+            if(addr.zone_off[k] != addr.zone_off[k - 1] + UFS_BLOCK_SIZE) ++extents;
+        EXPECT(extents <= LOCALITY_EXTENTS, "%s: %d extents in %d blocks", names[i], extents, LOCALITY_BLOCKS);
+        if(check_file(&context, names[i], buf, sizeof(buf))) return 1;
+    }
+    ufs_destroy(ufs);
+    vfs->close(vfs);
+    return 0;
+}
+
+#define ZCACHE_DISK_SIZE (4ull << 20) // 区块缓存测试的磁盘大小，便于写满
+#define ZCACHE_ROUNDS 16 // 磁盘几乎写满后每个线程写入并删除文件的次数
+#define ZCACHE_SPARE 48 // 磁盘写满后再释放的区块数，少于各线程同时写入所需
+
+typedef struct churner_t {
+    ufs_t* ufs;
+    int id;
+    unsigned char buf[BUF_SIZE];
+} churner_t;
+// 磁盘几乎已满时反复写入并删除文件，允许空间不足（UFS_ENOSPC），删除后占用的区块应当全部归还
+static int churner(void* arg) {
+    churner_t* c = (churner_t*)arg;
+    ufs_context_t context;
+    ufs_file_t* file;
+    size_t written;
+    char name[32];
+    int i, ec;
+    context_init(&context, c->ufs);
+    file_fill(c->buf, BUF_SIZE, 500 + c->id);
+    snprintf(name, sizeof(name), "/d2/c%d", c->id);
+    for(i = 0; i < ZCACHE_ROUNDS; ++i) {
+        CHECK(ufs_open(&context, &file, name, UFS_O_CREAT | UFS_O_TRUNC | UFS_O_WRONLY, 0644));
+        ec = ufs_write(file, c->buf, file_size(c->id + i), &written);
+        if(ec != UFS_ENOSPC) CHECK(ec);
+        CHECK(ufs_close(file));
+        CHECK(ufs_unlink(&context, name));
+    }
+    return 0;
+}
+// 写入/fill直到空间不足
+static int fill_disk(ufs_context_t* context, ufs_file_t** pfile) {
+    static unsigned char buf[BUF_SIZE];
+    size_t written;
+    int ec;
+    file_fill(buf, BUF_SIZE, 510);
+    CHECK(ufs_open(context, pfile, "/fill", UFS_O_CREAT | UFS_O_TRUNC | UFS_O_WRONLY, 0644));
+    do ec = ufs_write(*pfile, buf, BUF_SIZE, &written); while(ec == 0);
+    EXPECT(ec == UFS_ENOSPC, "fill: [%d] %s", ec, ufs_strerror(ec));
+    return 0;
+}
+
+/**
+ * 区块缓存的多线程分配与释放：各线程的槽中缓存了区块之后写满磁盘，
+ * 本线程的槽和zlist耗尽时从其他槽借用区块，中止事务时连同借用一起回滚；
+ * 每一步之后statvfs中的空闲区块数（包括槽中缓存的区块）都应当回到写满之前，重新挂载之后也不变
+*/
+static int run_zone_cache(void) {
+    static churner_t churners[THREAD_NUM];
+    static writer_t writers[THREAD_NUM];
+    void* args[THREAD_NUM];
+    ufs_format_opt_t format = { 0 };
+    ufs_vfs_t* vfs;
+    ufs_t* ufs;
+    ufs_context_t context;
+    ufs_file_t* file;
+    static unsigned char buf[ZCACHE_SPARE * UFS_BLOCK_SIZE];
+    ufs_statvfs_t empty, st, spare;
+    int i;
+
+    format.zcache = 1;
+    CHECK(ufs_vfs_open_memory(&vfs, NULL, 0));
+    CHECK(ufs_new_format_ex(&ufs, vfs, ZCACHE_DISK_SIZE, &format));
+    context_init(&context, ufs);
+    CHECK(ufs_mkdir(&context, "/d2", 0755));
+    // 目录的区块在第一次创建文件时分配，之后不再释放
+    if(write_file(&context, "/d2/t", NULL, 0, 0)) return 1;
+    CHECK(ufs_unlink(&context, "/d2/t"));
+    CHECK(ufs_statvfs(ufs, &empty));
+
+    // 各线程分配并释放，释放的区块留在各自的槽中
+    for(i = 0; i < THREAD_NUM; ++i) {
+        writers[i].ufs = ufs;
+        writers[i].id = i;
+        args[i] = writers + i;
+    }
+    if(run_threads(writer, args, THREAD_NUM)) return 1;
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == empty.f_bfree, "free blocks after writers: %" PRIu64 " expected %" PRIu64, st.f_bfree, empty.f_bfree);
+
+    // 在事务中写满（借用其他槽的区块）后中止
+    CHECK(ufs_txn_begin(&context));
+    if(fill_disk(&context, &file)) return 1;
+    CHECK(ufs_close(file));
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree < ZCACHE_SPARE, "%" PRIu64 " blocks still free after filling the disk", st.f_bfree);
+    CHECK(ufs_txn_abort(&context));
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == empty.f_bfree, "free blocks after abort: %" PRIu64 " expected %" PRIu64, st.f_bfree, empty.f_bfree);
+
+    // 写满后只留下少量区块，多个线程同时争用（只尝试加锁借用，失败时空间不足）
+    file_fill(buf, ZCACHE_SPARE * UFS_BLOCK_SIZE, 511);
+    if(write_file(&context, "/spare", buf, ZCACHE_SPARE * UFS_BLOCK_SIZE, 0)) return 1;
+    if(fill_disk(&context, &file)) return 1;
+    CHECK(ufs_close(file));
+    CHECK(ufs_unlink(&context, "/spare"));
+    CHECK(ufs_statvfs(ufs, &spare));
+    for(i = 0; i < THREAD_NUM; ++i) {
+        churners[i].ufs = ufs;
+        churners[i].id = i;
+        args[i] = churners + i;
+    }
+    if(run_threads(churner, args, THREAD_NUM)) return 1;
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == spare.f_bfree, "free blocks after churners: %" PRIu64 " expected %" PRIu64, st.f_bfree, spare.f_bfree);
+    CHECK(ufs_unlink(&context, "/fill"));
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == empty.f_bfree, "free blocks after unlink: %" PRIu64 " expected %" PRIu64, st.f_bfree, empty.f_bfree);
+    ufs_destroy(ufs);
+
+    CHECK(ufs_new(&ufs, vfs));
+    CHECK(ufs_statvfs(ufs, &st));
+    EXPECT(st.f_bfree == empty.f_bfree, "free blocks after remount: %" PRIu64 " expected %" PRIu64, st.f_bfree, empty.f_bfree);
+    ufs_destroy(ufs);
+    vfs->close(vfs);
+    return 0;
+}
+
+static int report(const char* name, int failed) {
+    if(failed) fprintf(stderr, "[%s] FAILED\n", name);
+    else printf("[%s] OK\n", name);
+    return failed;
+}
+
+int main(void) {
+    test_case_t tests[] = {
+        { .name = "default" },
+        { .name = "ring jornal", .format = { .jornal_size = 1024 } },
+        { .name = "bitmap", .format = { .zalloc = UFS_ZALLOC_BITMAP } },
+        { .name = "zone cache", .format = { .zcache = 1 } },
+        { .name = "zone cache upgrade", .mount = { .zcache_upgrade = 1 } },
+        { .name = "lazy", .format = { .lazy = 1 } },
+        { .name = "lazy bitmap", .format = { .zalloc = UFS_ZALLOC_BITMAP, .lazy = 1 } },
+        { .name = "zone range", .format = { .zrange = 1 } },
+        { .name = "lazy zone range", .format = { .lazy = 1, .zrange = 1 } },
+        { .name = "orphan", .format = { .orphan = 1 }, .mount = { .reclaim_batch = 1, .reclaim_interval = 60000 } },
+        { .name = "data jornal", .format = { .jornal_size = 1024 }, .mount = { .data_jornal = 60 * 1024 } },
+        { .name = "fast commit", .mount = { .fast_commit = 1 } },
+        { .name = "ordered", .mount = { .durability = UFS_DURABILITY_ORDERED } },
+        { .name = "periodic", .mount = { .durability = UFS_DURABILITY_PERIODIC, .sync_interval = 60000 }, .lossy = 1 },
+        { .name = "no flush", .mount = { .durability = UFS_DURABILITY_NONE } },
+        { .name = "checkpointer", .format = { .jornal_size = 1024 },
+            .mount = { .checkpoint_interval = 1, .checkpoint_threshold = 10 } },
+        { .name = "recovery threads", .format = { .jornal_size = 1024 }, .mount = { .recovery_threads = RECOVERY_THREADS } },
+        { .name = "delay alloc", .mount = { .delay_alloc = 1 } },
+        { .name = "all", .format = { .jornal_size = 1024, .lazy = 1, .zcache = 1, .zrange = 1, .orphan = 1 },
+            .mount = { .checkpoint_threshold = 50, .data_jornal = 4096, .recovery_threads = RECOVERY_THREADS,
+                .fast_commit = 1, .delay_alloc = 1, .reclaim_batch = 1, .reclaim_interval = 60000 } },
+    };
+    size_t i;
+    int failed = 0;
+
+    for(i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        tests[i].format.mount = &tests[i].mount;
+        failed |= report(tests[i].name, run(&tests[i]));
+    }
+    failed |= report("parallel recovery", run_parallel_recovery());
+    failed |= report("fdatasync", run_fdatasync(0));
+    failed |= report("fdatasync data jornal", run_fdatasync(60 * 1024));
+    failed |= report("locality list zone cache", run_locality(UFS_ZALLOC_LIST, 1));
+    failed |= report("locality bitmap", run_locality(UFS_ZALLOC_BITMAP, 0));
+    failed |= report("locality bitmap zone cache", run_locality(UFS_ZALLOC_BITMAP, 1));
+    failed |= report("zone cache threads", run_zone_cache());
+    return failed;
+}